@@ -0,0 +1,515 @@
+#include "archivepacker.h"
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+#include "vfs.h"
+#ifdef FM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+constexpr qint64 tarBlockSize = 512;
+// Larger than pigz's 128 KiB: fewer sync markers and dictionary copies,
+// still plenty of blocks to spread over the cores.
+constexpr int compressionBlockSize = 1 << 20;
+constexpr int dictionarySize = 32 * 1024;
+constexpr qint64 readChunkSize = 1 << 20;
+constexpr size_t walkQueueCapacity = 4096;
+constexpr int progressInterval = 100;
+constexpr int gzipLevel = 6;
+constexpr int zstdLevel = 3;
+
+
+namespace {
+
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity)
+    {}
+
+    // Blocks while the queue is full; fails once it is closed.
+    bool push(T item)
+    {
+        std::unique_lock lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty; items pushed before close() are
+    // still handed out.
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        std::lock_guard lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+
+struct Entry {
+    QString sourcePath;
+    QByteArray name;
+    qint64 size;
+    qint64 lastModified;
+    int mode;
+    bool isDir;
+};
+
+struct CompressedBlock {
+    QByteArray bytes;
+    quint32 checksum;
+    qint64 inputSize;
+    bool ok;
+};
+
+struct CompressionJob {
+    QByteArray data;
+    QByteArray dictionary;
+    std::promise<CompressedBlock> result;
+};
+
+
+struct Pipeline {
+    const std::atomic_bool& cancelled;
+    EArchiveFormat format;
+    std::atomic_bool failed{false};
+    std::mutex errorMutex;
+    QString error;
+    BoundedQueue<Entry> entries{walkQueueCapacity};
+    BoundedQueue<CompressionJob> jobs{std::numeric_limits<size_t>::max()};
+    // Results in archive order; its capacity bounds the blocks in flight.
+    BoundedQueue<std::future<CompressedBlock>> results{2 * getWorkerCount()};
+    std::atomic_int fileCount{0};
+    std::atomic<qint64> bytesRead{0};
+
+    Pipeline(const std::atomic_bool& cancelled, EArchiveFormat format)
+        : cancelled(cancelled)
+        , format(format)
+    {}
+
+    bool isStopped() const
+    {
+        return cancelled || failed;
+    }
+
+    void fail(const QString& message)
+    {
+        {
+            std::lock_guard lock(errorMutex);
+            if (error.isEmpty())
+                error = message;
+        }
+        failed = true;
+        entries.close();
+        results.close();
+    }
+};
+
+
+// Walks the source trees depth first, in name order, so the same input
+// always packs to the same archive. Symlinked directories are stored but
+// not followed.
+void walkSources(Pipeline& pipeline, const QStringList& sourcePaths)
+{
+    for (const QString& sourcePath : sourcePaths) {
+        const QFileInfo root(sourcePath);
+        std::vector<std::pair<QFileInfo, QByteArray>> stack{{root, root.fileName().toUtf8()}};
+        while (!stack.empty() && !pipeline.isStopped()) {
+            auto [info, name] = std::move(stack.back());
+            stack.pop_back();
+            const bool isDir = info.isDir();
+            const int mode = isDir || (info.permissions() & QFile::ExeOwner) ? 0755 : 0644;
+            if (!pipeline.entries.push({info.filePath(), name, isDir ? 0 : info.size(),
+                                        info.lastModified().toSecsSinceEpoch(), mode, isDir}))
+                return;
+            if (!isDir || info.isSymLink())
+                continue;
+            const QFileInfoList children = QDir(info.filePath()).entryInfoList(
+                QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden, QDir::Name | QDir::Reversed);
+            for (const QFileInfo& child : children)
+                stack.emplace_back(child, name + '/' + child.fileName().toUtf8());
+        }
+    }
+    pipeline.entries.close();
+}
+
+
+// Octal with a terminating NUL, or GNU base-256 for values that need
+// more digits than the field has.
+void writeNumber(char* field, int length, qint64 value)
+{
+    if (value >= (qint64(1) << (3 * (length - 1)))) {
+        field[0] = static_cast<char>(0x80);
+        for (int i = length - 1; i > 0; --i, value >>= 8)
+            field[i] = static_cast<char>(value & 0xff);
+        return;
+    }
+    std::snprintf(field, static_cast<size_t>(length), "%0*llo", length - 1, static_cast<unsigned long long>(value));
+}
+
+QByteArray makeHeader(const QByteArray& name, char type, qint64 size, qint64 lastModified, int mode)
+{
+    QByteArray header(static_cast<int>(tarBlockSize), '\0');
+    char* fields = header.data();
+    std::memcpy(fields, name.constData(), static_cast<size_t>(std::min(name.size(), 100)));
+    writeNumber(fields + 100, 8, mode);
+    writeNumber(fields + 108, 8, 0);
+    writeNumber(fields + 116, 8, 0);
+    writeNumber(fields + 124, 12, size);
+    writeNumber(fields + 136, 12, lastModified);
+    fields[156] = type;
+    // GNU magic, since long names use GNU 'L' records.
+    std::memcpy(fields + 257, "ustar  ", 8);
+    std::memset(fields + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (char byte : header)
+        checksum += static_cast<unsigned char>(byte);
+    std::snprintf(fields + 148, 7, "%06o", checksum);
+    return header;
+}
+
+
+// Cuts the tar stream into compression blocks and queues them, keeping
+// the results queue in stream order.
+class BlockWriter {
+public:
+    explicit BlockWriter(Pipeline& pipeline)
+        : pipeline(pipeline)
+    {
+        buffer.reserve(compressionBlockSize);
+    }
+
+    bool append(const char* data, qint64 size)
+    {
+        while (size > 0) {
+            const qint64 chunk = std::min<qint64>(size, compressionBlockSize - buffer.size());
+            buffer.append(data, static_cast<int>(chunk));
+            data += chunk;
+            size -= chunk;
+            if (buffer.size() == compressionBlockSize && !emitBlock())
+                return false;
+        }
+        return true;
+    }
+
+    bool append(const QByteArray& data)
+    {
+        return append(data.constData(), data.size());
+    }
+
+    bool pad(qint64 size)
+    {
+        const QByteArray zeros(static_cast<int>(std::min(size, readChunkSize)), '\0');
+        for (; size > 0; size -= zeros.size()) {
+            if (!append(zeros.constData(), std::min<qint64>(size, zeros.size())))
+                return false;
+        }
+        return true;
+    }
+
+    bool finish()
+    {
+        return buffer.isEmpty() || emitBlock();
+    }
+
+private:
+    bool emitBlock()
+    {
+        CompressionJob job;
+        job.data = std::move(buffer);
+        job.dictionary = std::move(dictionary);
+        dictionary = job.data.right(dictionarySize);
+        buffer = QByteArray();
+        buffer.reserve(compressionBlockSize);
+        if (!pipeline.results.push(job.result.get_future()))
+            return false;
+        return pipeline.jobs.push(std::move(job));
+    }
+
+    Pipeline& pipeline;
+    QByteArray buffer;
+    QByteArray dictionary;
+};
+
+
+bool writeEntry(Pipeline& pipeline, BlockWriter& writer, const Entry& entry)
+{
+    const QByteArray name = entry.isDir ? entry.name + '/' : entry.name;
+    if (name.size() > 100) {
+        QByteArray longName = name + '\0';
+        if (!writer.append(makeHeader("././@LongLink", 'L', longName.size(), 0, 0)) || !writer.append(longName)
+            || !writer.pad(-longName.size() & (tarBlockSize - 1)))
+            return false;
+    }
+    if (!writer.append(makeHeader(name, entry.isDir ? '5' : '0', entry.size, entry.lastModified, entry.mode)))
+        return false;
+    pipeline.fileCount.fetch_add(1, std::memory_order_relaxed);
+    if (entry.isDir)
+        return true;
+
+    QString error;
+    const std::unique_ptr<QIODevice> file = Vfs::get().open(entry.sourcePath, QIODevice::ReadOnly, error);
+    if (!file) {
+        pipeline.fail(error);
+        return false;
+    }
+    // The header already promised entry.size bytes: a file that grew is
+    // cut there and one that shrank is padded with zeros, as tar does.
+    QByteArray chunk(static_cast<int>(readChunkSize), Qt::Uninitialized);
+    qint64 copied = 0;
+    while (copied < entry.size && !pipeline.isStopped()) {
+        const qint64 readSize = file->read(chunk.data(), std::min(entry.size - copied, readChunkSize));
+        if (readSize <= 0)
+            break;
+        if (!writer.append(chunk.constData(), readSize))
+            return false;
+        copied += readSize;
+        pipeline.bytesRead.fetch_add(readSize, std::memory_order_relaxed);
+    }
+    return writer.pad(entry.size - copied) && writer.pad(-entry.size & (tarBlockSize - 1));
+}
+
+void readEntries(Pipeline& pipeline)
+{
+    BlockWriter writer(pipeline);
+    bool ok = true;
+    while (ok && !pipeline.isStopped()) {
+        const std::optional<Entry> entry = pipeline.entries.pop();
+        if (!entry)
+            break;
+        ok = writeEntry(pipeline, writer, *entry);
+    }
+    // End of archive: two zero blocks.
+    if (ok && !pipeline.isStopped() && writer.pad(2 * tarBlockSize))
+        writer.finish();
+    // Unblocks the walker when reading stopped early.
+    pipeline.entries.close();
+    pipeline.jobs.close();
+    pipeline.results.close();
+}
+
+
+CompressedBlock compress(EArchiveFormat format, const CompressionJob& job)
+{
+    const auto inputSize = static_cast<qint64>(job.data.size());
+    switch (format) {
+    case EArchiveFormat::TAR:
+        return {job.data, 0, inputSize, true};
+    case EArchiveFormat::TAR_GZ: {
+#ifdef FM_HAVE_ZLIB
+        z_stream stream{};
+        if (deflateInit2(&stream, gzipLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return {{}, 0, inputSize, false};
+        if (!job.dictionary.isEmpty())
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(job.dictionary.constData()), static_cast<uInt>(job.dictionary.size()));
+        // A sync flush adds an empty stored block on top of the bound.
+        QByteArray output(static_cast<int>(deflateBound(&stream, static_cast<uLong>(inputSize))) + 16, Qt::Uninitialized);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(job.data.constData()));
+        stream.avail_in = static_cast<uInt>(inputSize);
+        stream.next_out = reinterpret_cast<Bytef*>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        const int result = deflate(&stream, Z_SYNC_FLUSH);
+        const bool ok = result == Z_OK && stream.avail_in == 0;
+        output.resize(output.size() - static_cast<int>(stream.avail_out));
+        deflateEnd(&stream);
+        const auto checksum = static_cast<quint32>(crc32(0, reinterpret_cast<const Bytef*>(job.data.constData()), static_cast<uInt>(inputSize)));
+        return {std::move(output), checksum, inputSize, ok};
+#else
+        break;
+#endif
+    }
+    case EArchiveFormat::TAR_ZST: {
+#ifdef FM_HAVE_ZSTD
+        QByteArray output(static_cast<int>(ZSTD_compressBound(static_cast<size_t>(inputSize))), Qt::Uninitialized);
+        const size_t size = ZSTD_compress(output.data(), static_cast<size_t>(output.size()), job.data.constData(),
+                                          static_cast<size_t>(inputSize), zstdLevel);
+        if (ZSTD_isError(size))
+            return {{}, 0, inputSize, false};
+        output.resize(static_cast<int>(size));
+        return {std::move(output), 0, inputSize, true};
+#else
+        break;
+#endif
+    }
+    }
+    return {{}, 0, inputSize, false};
+}
+
+void compressBlocks(Pipeline& pipeline)
+{
+    // Every queued job gets a result, even after a failure, so the writer
+    // never waits on a block nobody will produce.
+    while (std::optional<CompressionJob> job = pipeline.jobs.pop()) {
+        if (pipeline.isStopped())
+            job->result.set_value({{}, 0, 0, false});
+        else
+            job->result.set_value(compress(pipeline.format, *job));
+    }
+}
+
+
+void appendLittleEndian(QByteArray& bytes, quint32 value)
+{
+    for (int i = 0; i < 4; ++i, value >>= 8)
+        bytes.append(static_cast<char>(value & 0xff));
+}
+
+}
+
+
+std::optional<EArchiveFormat> ArchivePacker::getFormat(const QString& archivePath)
+{
+    if (archivePath.endsWith(".tar", Qt::CaseInsensitive))
+        return EArchiveFormat::TAR;
+    if (archivePath.endsWith(".tar.gz", Qt::CaseInsensitive) || archivePath.endsWith(".tgz", Qt::CaseInsensitive))
+        return EArchiveFormat::TAR_GZ;
+    if (archivePath.endsWith(".tar.zst", Qt::CaseInsensitive))
+        return EArchiveFormat::TAR_ZST;
+    return std::nullopt;
+}
+
+bool ArchivePacker::isFormatAvailable(EArchiveFormat format)
+{
+    switch (format) {
+    case EArchiveFormat::TAR:
+        return true;
+    case EArchiveFormat::TAR_GZ:
+#ifdef FM_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case EArchiveFormat::TAR_ZST:
+#ifdef FM_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool ArchivePacker::pack(const QStringList& sourcePaths, const QString& archivePath, EArchiveFormat format,
+                         const std::atomic_bool& cancelled, const ProgressCallback& onProgress, QString& error)
+{
+    if (!isFormatAvailable(format)) {
+        error = "This build cannot write that archive format";
+        return false;
+    }
+    // The trees are walked with QDir, which sees the members of a browsed
+    // archive as missing; packing them would silently store nothing.
+    for (const QString& sourcePath : sourcePaths) {
+        const QFileInfo info(sourcePath);
+        if (info.exists() || info.isSymLink())
+            continue;
+        error = Vfs::get().stat(sourcePath)
+            ? QString("%1 is inside an archive; extract it before packing").arg(sourcePath)
+            : QString("%1 does not exist").arg(sourcePath);
+        return false;
+    }
+    QSaveFile file(archivePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = QString("Cannot create %1: %2").arg(archivePath, file.errorString());
+        return false;
+    }
+
+    Pipeline pipeline(cancelled, format);
+    std::vector<std::thread> threads;
+    threads.emplace_back(walkSources, std::ref(pipeline), std::cref(sourcePaths));
+    threads.emplace_back(readEntries, std::ref(pipeline));
+    for (size_t i = 0; i < getWorkerCount(); ++i)
+        threads.emplace_back(compressBlocks, std::ref(pipeline));
+
+    if (format == EArchiveFormat::TAR_GZ)
+        file.write("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+    quint32 checksum = 0;
+    qint64 totalSize = 0;
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+    while (std::optional<std::future<CompressedBlock>> result = pipeline.results.pop()) {
+        const CompressedBlock block = result->get();
+        if (!block.ok) {
+            pipeline.fail("Compression failed");
+            break;
+        }
+        if (file.write(block.bytes) != block.bytes.size()) {
+            pipeline.fail(QString("Cannot write %1: %2").arg(archivePath, file.errorString()));
+            break;
+        }
+#ifdef FM_HAVE_ZLIB
+        if (format == EArchiveFormat::TAR_GZ)
+            checksum = static_cast<quint32>(crc32_combine(checksum, block.checksum, static_cast<z_off_t>(block.inputSize)));
+#endif
+        totalSize += block.inputSize;
+        if (progressTimer.elapsed() >= progressInterval) {
+            progressTimer.restart();
+            onProgress({pipeline.fileCount, pipeline.bytesRead, file.pos()});
+        }
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (pipeline.isStopped()) {
+        file.cancelWriting();
+        error = cancelled ? QString("Cancelled") : pipeline.error;
+        return false;
+    }
+    if (format == EArchiveFormat::TAR_GZ) {
+        // Every block ended in a sync flush; an empty final fixed block
+        // ends the deflate stream.
+        QByteArray trailer("\x03\x00", 2);
+        appendLittleEndian(trailer, checksum);
+        appendLittleEndian(trailer, static_cast<quint32>(totalSize));
+        file.write(trailer);
+    }
+    if (!file.commit()) {
+        error = QString("Cannot write %1: %2").arg(archivePath, file.errorString());
+        return false;
+    }
+    onProgress({pipeline.fileCount, pipeline.bytesRead, QFileInfo(archivePath).size()});
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <optional>
+
+
+enum class EArchiveFormat {
+    TAR,
+    TAR_GZ,
+    TAR_ZST,
+};
+
+
+// Writes a tar archive of files and directory trees as a pipeline: one
+// thread walks the trees, one reads files into tar blocks, all cores
+// compress blocks independently and the calling thread writes them out in
+// order. Gzip blocks are raw deflate streams ended with a sync flush and
+// primed with the previous block's last 32 KiB (as pigz does), so the
+// result is one ordinary gzip member; zstd blocks are separate frames,
+// which every zstd reader concatenates.
+class ArchivePacker {
+public:
+    struct Progress {
+        int fileCount;
+        qint64 bytesRead;
+        qint64 bytesWritten;
+    };
+    using ProgressCallback = std::function<void(const Progress&)>;
+
+    static std::optional<EArchiveFormat> getFormat(const QString& archivePath);
+    static bool isFormatAvailable(EArchiveFormat);
+    // Entries are named relative to the parent of each source path.
+    static bool pack(const QStringList& sourcePaths, const QString& archivePath, EArchiveFormat,
+                     const std::atomic_bool& cancelled, const ProgressCallback&, QString& error);
+};
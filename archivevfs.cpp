@@ -0,0 +1,276 @@
+#include "archivevfs.h"
+#include <QFileInfo>
+#include <chrono>
+#include "util.h"
+
+
+constexpr int maxCachedIndexes = 8;
+constexpr std::chrono::milliseconds cancelCheckInterval(20);
+
+
+namespace {
+
+const std::atomic_bool notCancelled{false};
+
+QString getReadOnlyError(const QString& path)
+{
+    return QString("%1 is inside an archive, which is read-only").arg(path);
+}
+
+}
+
+
+ArchiveVfs::ArchiveVfs(std::unique_ptr<IVfs> inner)
+    : inner(std::move(inner))
+    , indexes(maxCachedIndexes)
+{
+    buildPool.setMaxThreadCount(1);
+}
+
+ArchiveVfs::~ArchiveVfs()
+{
+    stopping = true;
+    buildPool.waitForDone();
+}
+
+std::vector<VfsStat> ArchiveVfs::list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+    const std::optional<ArchivePath> archivePath = split(dirPath, true);
+    if (!archivePath)
+        return inner->list(dirPath, cancelled, error);
+    std::vector<VfsStat> result;
+    if (const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, cancelled, error)) {
+        for (const QString& name : index->listNames(archivePath->member)) {
+            if (std::optional<VfsStat> stat = index->stat(archivePath->member / name))
+                result.push_back(std::move(*stat));
+        }
+    }
+    return result;
+}
+
+QStringList ArchiveVfs::listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+    const std::optional<ArchivePath> archivePath = split(dirPath, true);
+    if (!archivePath)
+        return inner->listNames(dirPath, cancelled, error);
+    const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, cancelled, error);
+    return index ? index->listNames(archivePath->member) : QStringList();
+}
+
+std::optional<VfsStat> ArchiveVfs::stat(const QString& path)
+{
+    const std::optional<ArchivePath> archivePath = split(path, false);
+    if (!archivePath)
+        return inner->stat(path);
+    QString error;
+    const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, notCancelled, error);
+    return index ? index->stat(archivePath->member) : std::nullopt;
+}
+
+std::optional<VfsStat> ArchiveVfs::statQuick(const QString& path)
+{
+    const std::optional<ArchivePath> archivePath = split(path, false);
+    if (!archivePath)
+        return inner->statQuick(path);
+    if (const std::shared_ptr<const TarIndex> index = findIndex(*archivePath))
+        return index->stat(archivePath->member);
+    if (findFailure(*archivePath))
+        return std::nullopt;
+    // Whether the member exists is known once the archive is indexed; the
+    // listing waits for that on its worker thread.
+    startBuild(*archivePath);
+    return VfsStat{QFileInfo(path).fileName(), -1, archivePath->archiveModified, true};
+}
+
+std::vector<std::optional<VfsStat>> ArchiveVfs::statBatch(const QString& dirPath, const QStringList& names)
+{
+    const std::optional<ArchivePath> archivePath = split(dirPath, true);
+    if (!archivePath)
+        return inner->statBatch(dirPath, names);
+    std::vector<std::optional<VfsStat>> result(static_cast<size_t>(names.size()));
+    QString error;
+    if (const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, notCancelled, error)) {
+        for (int i = 0; i < names.size(); ++i)
+            result[static_cast<size_t>(i)] = index->stat(archivePath->member / names[i]);
+    }
+    return result;
+}
+
+bool ArchiveVfs::listsInOnePass(const QString& dirPath)
+{
+    // Members are listed and stated from the same in-memory index.
+    return split(dirPath, true) || inner->listsInOnePass(dirPath);
+}
+
+bool ArchiveVfs::isLocal(const QString& path)
+{
+    return !split(path, true) && inner->isLocal(path);
+}
+
+std::unique_ptr<QIODevice> ArchiveVfs::open(const QString& path, QIODevice::OpenMode mode, QString& error)
+{
+    const std::optional<ArchivePath> archivePath = split(path, false);
+    if (!archivePath)
+        return inner->open(path, mode, error);
+    if (mode & QIODevice::WriteOnly) {
+        error = getReadOnlyError(path);
+        return nullptr;
+    }
+    const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, notCancelled, error);
+    if (!index)
+        return nullptr;
+    const TarIndex::Member* member = index->find(archivePath->member);
+    if (!member || member->isDir) {
+        error = QString("%1 is not a file").arg(path);
+        return nullptr;
+    }
+    return index->openMember(archivePath->archive, *member, error);
+}
+
+bool ArchiveVfs::rename(const QString& from, const QString& to, QString& error)
+{
+    for (const QString& path : {from, to}) {
+        if (split(path, false)) {
+            error = getReadOnlyError(path);
+            return false;
+        }
+    }
+    return inner->rename(from, to, error);
+}
+
+bool ArchiveVfs::unlink(const QString& path, QString& error)
+{
+    if (split(path, false)) {
+        error = getReadOnlyError(path);
+        return false;
+    }
+    return inner->unlink(path, error);
+}
+
+bool ArchiveVfs::mkdir(const QString& path, QString& error)
+{
+    if (split(path, false)) {
+        error = getReadOnlyError(path);
+        return false;
+    }
+    return inner->mkdir(path, error);
+}
+
+bool ArchiveVfs::copy(const QString& from, const QString& to, QString& error)
+{
+    if (split(to, false)) {
+        error = getReadOnlyError(to);
+        return false;
+    }
+    const std::optional<ArchivePath> archivePath = split(from, false);
+    if (!archivePath)
+        return inner->copy(from, to, error);
+
+    const std::shared_ptr<const TarIndex> index = getIndex(*archivePath, notCancelled, error);
+    if (!index)
+        return false;
+    const TarIndex::Member* member = index->find(archivePath->member);
+    if (!member) {
+        error = QString("%1 does not exist").arg(from);
+        return false;
+    }
+    if (member->isDir) {
+        error = QString("Cannot copy directory %1 out of an archive").arg(from);
+        return false;
+    }
+    std::unique_ptr<QIODevice> target = inner->open(to, QIODevice::WriteOnly | QIODevice::NewOnly, error);
+    if (!target)
+        return false;
+    if (!index->extract(archivePath->archive, *member, *target, error)) {
+        target.reset();
+        QString ignored;
+        inner->unlink(to, ignored);
+        return false;
+    }
+    return true;
+}
+
+std::optional<ArchiveVfs::ArchivePath> ArchiveVfs::split(const QString& path, bool asDirectory)
+{
+    // Only components that look like archives cost a stat, so paths
+    // without one pass straight through.
+    for (int end = path.indexOf('/', 1);; end = path.indexOf('/', end + 1)) {
+        const int prefixSize = end < 0 ? path.size() : end;
+        if ((end >= 0 || asDirectory) && TarIndex::isArchiveName(QStringView(path).left(prefixSize))) {
+            const QString archive = path.left(prefixSize);
+            if (const std::optional<VfsStat> stat = inner->stat(archive); stat && !stat->isDir)
+                return ArchivePath{archive, end < 0 ? QString() : path.mid(end + 1), stat->size, stat->lastModified};
+        }
+        if (end < 0)
+            return std::nullopt;
+    }
+}
+
+std::shared_ptr<const TarIndex> ArchiveVfs::findIndex(const ArchivePath& archivePath)
+{
+    std::lock_guard lock(indexesMutex);
+    const std::shared_ptr<const TarIndex>* index = indexes.object(archivePath.archive);
+    if (index && (*index)->getArchiveSize() == archivePath.archiveSize
+        && (*index)->getArchiveModified() == archivePath.archiveModified)
+        return *index;
+    return nullptr;
+}
+
+std::optional<QString> ArchiveVfs::findFailure(const ArchivePath& archivePath)
+{
+    std::lock_guard lock(indexesMutex);
+    const auto iter = failures.constFind(archivePath.archive);
+    if (iter != failures.constEnd() && iter->archiveSize == archivePath.archiveSize
+        && iter->archiveModified == archivePath.archiveModified)
+        return iter->error;
+    return std::nullopt;
+}
+
+std::shared_ptr<const TarIndex> ArchiveVfs::getIndex(const ArchivePath& archivePath, const std::atomic_bool& cancelled, QString& error)
+{
+    if (std::shared_ptr<const TarIndex> index = findIndex(archivePath))
+        return index;
+    if (std::optional<QString> failure = findFailure(archivePath)) {
+        error = std::move(*failure);
+        return nullptr;
+    }
+    const std::shared_future<BuildResult> build = startBuild(archivePath);
+    while (build.wait_for(cancelCheckInterval) != std::future_status::ready) {
+        if (cancelled) {
+            error = "Cancelled";
+            return nullptr;
+        }
+    }
+    const BuildResult& result = build.get();
+    if (!result.index)
+        error = result.error;
+    return result.index;
+}
+
+std::shared_future<ArchiveVfs::BuildResult> ArchiveVfs::startBuild(const ArchivePath& archivePath)
+{
+    std::lock_guard lock(indexesMutex);
+    if (const auto iter = builds.constFind(archivePath.archive); iter != builds.constEnd())
+        return *iter;
+    auto promise = std::make_shared<std::promise<BuildResult>>();
+    const std::shared_future<BuildResult> build = promise->get_future().share();
+    builds.insert(archivePath.archive, build);
+    buildPool.start([this, archivePath, promise] {
+        const QString& archive = archivePath.archive;
+        BuildResult result;
+        if (std::optional<TarIndex> opened = TarIndex::open(archive, stopping, result.error))
+            result.index = std::make_shared<const TarIndex>(std::move(*opened));
+        {
+            std::lock_guard lock(indexesMutex);
+            if (result.index) {
+                indexes.insert(archive, new std::shared_ptr<const TarIndex>(result.index));
+                failures.remove(archive);
+            } else if (!stopping) {
+                failures.insert(archive, {archivePath.archiveSize, archivePath.archiveModified, result.error});
+            }
+            builds.remove(archive);
+        }
+        promise->set_value(std::move(result));
+    });
+    return build;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <QCache>
+#include <QHash>
+#include <QThreadPool>
+#include <future>
+#include <memory>
+#include <mutex>
+#include "vfs.h"
+#include "tarindex.h"
+
+
+// Presents tar archives as read-only directories: "/logs/a.tar.gz/x/y"
+// is member x/y of /logs/a.tar.gz. Paths outside archives go to the inner
+// backend untouched. Indexes of recently used archives stay in memory,
+// the least recently used dropped first. Archives are indexed on a thread
+// of their own, one at a time, so the parallel requests of a listing wait
+// for one scan instead of each starting their own, a cancelled request
+// leaves the scan running for the next one, and statQuick() can answer
+// the GUI without waiting for it. An archive that cannot be indexed lists
+// with the error until it changes.
+class ArchiveVfs : public IVfs {
+public:
+    explicit ArchiveVfs(std::unique_ptr<IVfs> inner);
+    ~ArchiveVfs() override;
+
+    std::vector<VfsStat> list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    QStringList listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    std::optional<VfsStat> stat(const QString& path) override;
+    std::optional<VfsStat> statQuick(const QString& path) override;
+    std::vector<std::optional<VfsStat>> statBatch(const QString& dirPath, const QStringList& names) override;
+    bool listsInOnePass(const QString& dirPath) override;
+    bool isLocal(const QString& path) override;
+    std::unique_ptr<QIODevice> open(const QString& path, QIODevice::OpenMode mode, QString& error) override;
+    bool rename(const QString& from, const QString& to, QString& error) override;
+    bool unlink(const QString& path, QString& error) override;
+    bool mkdir(const QString& path, QString& error) override;
+    bool copy(const QString& from, const QString& to, QString& error) override;
+
+private:
+    struct ArchivePath {
+        QString archive;
+        QString member;
+        qint64 archiveSize;
+        qint64 archiveModified;
+    };
+
+    struct BuildResult {
+        std::shared_ptr<const TarIndex> index;
+        QString error;
+    };
+
+    // Archives that could not be indexed, so they are not retried until
+    // they change.
+    struct Failure {
+        qint64 archiveSize;
+        qint64 archiveModified;
+        QString error;
+    };
+
+    // Splits paths at the first component naming an archive file; the
+    // archive itself splits only when it is used as a directory.
+    std::optional<ArchivePath> split(const QString& path, bool asDirectory);
+    std::shared_ptr<const TarIndex> findIndex(const ArchivePath&);
+    std::optional<QString> findFailure(const ArchivePath&);
+    // Waits for the index, which is built in the background if needed.
+    std::shared_ptr<const TarIndex> getIndex(const ArchivePath&, const std::atomic_bool& cancelled, QString& error);
+    std::shared_future<BuildResult> startBuild(const ArchivePath&);
+
+private:
+    std::unique_ptr<IVfs> inner;
+    std::mutex indexesMutex;
+    QCache<QString, std::shared_ptr<const TarIndex>> indexes;
+    QHash<QString, std::shared_future<BuildResult>> builds;
+    QHash<QString, Failure> failures;
+    std::atomic_bool stopping{false};
+    QThreadPool buildPool;
+};
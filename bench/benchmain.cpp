@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <random>
+#include "syntheticview.h"
+#include "vimodel.h"
+#include "commandcompletion.h"
+#include "directorymodel.h"
+#include "listingpipeline.h"
+#include "lineindex.h"
+
+// Run with --benchmark_format=json (or --benchmark_out=<file>) to get
+// machine-readable results for regression tracking. Set FM_BENCH_HUGE=1 to
+// add 10M-entry cases, which need several GB of memory.
+
+
+constexpr int minEntries = 1000;
+constexpr int maxEntries = 1000000;
+constexpr int hugeEntries = 10000000;
+constexpr qint64 listingBudget = qint64(16) * 1024 * 1024 * 1024;
+
+
+static void applyEntryRange(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->RangeMultiplier(10)->Range(minEntries, maxEntries);
+    if (qEnvironmentVariableIntValue("FM_BENCH_HUGE") != 0)
+        benchmark->Arg(hugeEntries);
+}
+
+
+static DirectoryModel::Entries generateEntries(int count)
+{
+    static const char* const extensions[] = {"txt", "cpp", "h", "png", "tar.gz", "md", ""};
+    std::mt19937 random(static_cast<std::mt19937::result_type>(count));
+    DirectoryModel::Entries entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const char* extension = extensions[random() % std::size(extensions)];
+        QString name = QString("file%1").arg(i);
+        if (*extension)
+            name += '.' + QString(extension);
+        const qint64 size = random() % (1 << 30);
+        const qint64 lastModified = random();
+        entries.push_back({std::move(name), size, lastModified, false});
+    }
+    std::shuffle(entries.begin(), entries.end(), random);
+    return entries;
+}
+
+
+static void keyDispatch(benchmark::State& state)
+{
+    SyntheticView view(static_cast<int>(state.range(0)));
+    ViModel viModel(view);
+    const Key next{EKey::J};
+    const int lastRow = view.getRowCount() - 1;
+    for (auto _ : state) {
+        viModel.handleKeyPress(next);
+        if (view.getCurrentRow() == lastRow)
+            view.selectRow(0);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(keyDispatch)->Apply(applyEntryRange);
+
+
+static void motions(benchmark::State& state)
+{
+    SyntheticView view(static_cast<int>(state.range(0)));
+    ViModel viModel(view);
+    view.selectRow(view.getRowCount() / 2);
+    const Key high{EKey::SHIFT, EKey::H};
+    const Key middle{EKey::SHIFT, EKey::M};
+    const Key low{EKey::SHIFT, EKey::L};
+    for (auto _ : state) {
+        viModel.handleKeyPress(high);
+        viModel.handleKeyPress(middle);
+        viModel.handleKeyPress(low);
+    }
+    state.SetItemsProcessed(state.iterations() * 3);
+}
+BENCHMARK(motions)->Apply(applyEntryRange);
+
+
+static void search(benchmark::State& state)
+{
+    // The target sits right before the cursor, so every search scans
+    // the whole listing.
+    SyntheticView view(static_cast<int>(state.range(0)));
+    ViModel viModel(view);
+    const QString target = view.getName(view.getRowCount() - 1);
+    for (auto _ : state) {
+        view.selectRow(0);
+        viModel.getSearchController().enterSearchLine(target);
+        benchmark::DoNotOptimize(view.getCurrentRow());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(search)->Apply(applyEntryRange);
+
+
+static void completion(benchmark::State& state)
+{
+    SyntheticView view(1);
+    ViModel viModel(view);
+    CommandCompletion commandCompletion(viModel);
+    for (auto _ : state) {
+        commandCompletion.reset();
+        commandCompletion.setInitialString("c");
+        for (int i = 0; i < 4; ++i)
+            benchmark::DoNotOptimize(commandCompletion.getNext());
+    }
+}
+BENCHMARK(completion);
+
+
+static void listing(benchmark::State& state)
+{
+    // Two generated listings are seeded into the model's cache and visited
+    // in turn, so every iteration installs, indexes and sorts one of them.
+    // The follow-up rescan of the (non-existent) path runs on a worker and
+    // is never delivered, since no event loop is running.
+    const int count = static_cast<int>(state.range(0));
+    DirectoryModel model;
+    model.setMemoryBudget(listingBudget);
+    model.addListings({{"/synthetic/a", generateEntries(count)}, {"/synthetic/b", generateEntries(count)}});
+    bool first = true;
+    for (auto _ : state) {
+        model.setPath(first ? "/synthetic/a" : "/synthetic/b");
+        first = !first;
+        benchmark::DoNotOptimize(model.rowCount());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(listing)->Apply(applyEntryRange)->Unit(benchmark::kMillisecond);
+
+
+static void sortModeSwitch(benchmark::State& state)
+{
+    const ESortMode sortModes[] = {ESortMode::NATURAL, ESortMode::EXTENSION, ESortMode::SIZE,
+                                   ESortMode::MTIME, ESortMode::NAME};
+    const int count = static_cast<int>(state.range(0));
+    DirectoryModel model;
+    model.setMemoryBudget(listingBudget);
+    model.addListings({{"/synthetic", generateEntries(count)}});
+    model.setPath("/synthetic");
+    size_t next = 0;
+    for (auto _ : state) {
+        model.setSortMode(sortModes[next]);
+        next = (next + 1) % std::size(sortModes);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(sortModeSwitch)->Apply(applyEntryRange)->Unit(benchmark::kMillisecond);
+
+
+static void remoteListing(benchmark::State& state)
+{
+    // A real 10k-entry directory behind a 5 ms round trip per request, as
+    // on an NFS mount; the argument is the number of requests in flight.
+    constexpr int fileCount = 10000;
+    static QTemporaryDir dir;
+    static const bool populated = [] {
+        for (int i = 0; i < fileCount; ++i)
+            QFile(dir.filePath(QString("file%1").arg(i))).open(QIODevice::WriteOnly);
+        return true;
+    }();
+    benchmark::DoNotOptimize(populated);
+    ThrottledVfs vfs(std::make_unique<LocalVfs>(), std::chrono::milliseconds(5), 0);
+    ListingPipeline pipeline;
+    pipeline.setInFlight(static_cast<int>(state.range(0)));
+    const std::atomic_bool cancelled{false};
+    QString error;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(pipeline.list(vfs, dir.path(), cancelled, error).size());
+    state.SetItemsProcessed(state.iterations() * fileCount);
+}
+BENCHMARK(remoteListing)->RangeMultiplier(4)->Range(1, 64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+
+static void lineIndexing(benchmark::State& state)
+{
+    // 256 MiB of log-like lines, 40 to 160 bytes long, so the scan is
+    // measured from the page cache rather than the disk.
+    constexpr qint64 fileSize = 256 * 1024 * 1024;
+    static QTemporaryDir dir;
+    static const QString filePath = dir.filePath("log.txt");
+    static const bool written = [] {
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> lineLength(40, 160);
+        QByteArray data(static_cast<int>(fileSize), 'x');
+        for (qint64 i = lineLength(random); i < fileSize; i += lineLength(random))
+            data[static_cast<int>(i)] = '\n';
+        QFile file(filePath);
+        return file.open(QIODevice::WriteOnly) && file.write(data) == fileSize;
+    }();
+    benchmark::DoNotOptimize(written);
+    const std::atomic_bool cancelled{false};
+    for (auto _ : state) {
+        QFile file(filePath);
+        file.open(QIODevice::ReadOnly);
+        LineIndex index;
+        benchmark::DoNotOptimize(index.build(file, cancelled));
+    }
+    state.SetBytesProcessed(state.iterations() * fileSize);
+}
+BENCHMARK(lineIndexing)->Unit(benchmark::kMillisecond);
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
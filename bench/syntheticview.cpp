@@ -0,0 +1,191 @@
+#include "syntheticview.h"
+#include "util.h"
+
+
+SyntheticView::SyntheticView(int rowCount, int viewportHeight)
+    : currentDirectory("/synthetic")
+    , currentRow(0)
+    , firstVisibleRow(0)
+    , viewportHeight(viewportHeight)
+    , multiSelectionEnabled(false)
+{
+    names.reserve(rowCount);
+    for (int i = 0; i < rowCount; ++i)
+        names.push_back(QString("entry_%1.txt").arg(i, 8, 10, QChar('0')));
+}
+
+const QString& SyntheticView::getName(int row) const
+{
+    return names[row];
+}
+
+QString SyntheticView::getCurrentDirectory() const
+{
+    return currentDirectory;
+}
+
+void SyntheticView::showStatus(const QString&, int)
+{
+}
+
+void SyntheticView::searchForward(const QString& line)
+{
+    // Same semantics as QAbstractItemView::keyboardSearch: the first row
+    // after the cursor whose name starts with the line, wrapping around.
+    const int rowCount = getRowCount();
+    for (int i = 1; i <= rowCount; ++i) {
+        const int row = (currentRow + i) % rowCount;
+        if (names[row].startsWith(line, Qt::CaseInsensitive)) {
+            selectRow(row);
+            return;
+        }
+    }
+}
+
+void SyntheticView::selectRow(int row)
+{
+    if (row < 0 || row >= getRowCount())
+        return;
+    currentRow = row;
+    if (row < firstVisibleRow)
+        firstVisibleRow = row;
+    else if (row >= firstVisibleRow + viewportHeight)
+        firstVisibleRow = row - viewportHeight + 1;
+}
+
+int SyntheticView::getRowCount() const
+{
+    return names.size();
+}
+
+int SyntheticView::getCurrentRow() const
+{
+    return currentRow;
+}
+
+QString SyntheticView::getCurrentFile() const
+{
+    if (names.isEmpty())
+        return {};
+    return currentDirectory / names[currentRow];
+}
+
+QString SyntheticView::getCurrentDir() const
+{
+    return currentDirectory;
+}
+
+bool SyntheticView::changeDirectoryIfCan(const QString&)
+{
+    return false;
+}
+
+void SyntheticView::setColorSchemeName(const QString&)
+{
+}
+
+void SyntheticView::openCurrentDirectory()
+{
+}
+
+void SyntheticView::openParentDirectory()
+{
+}
+
+void SyntheticView::focusToCommandLine(const QString&)
+{
+}
+
+void SyntheticView::activateFileViewer()
+{
+}
+
+void SyntheticView::setMultiSelectionEnabled(bool enabled)
+{
+    multiSelectionEnabled = enabled;
+}
+
+bool SyntheticView::isMultiSelectionEnabled() const
+{
+    return multiSelectionEnabled;
+}
+
+bool SyntheticView::showQuestion(const QString&)
+{
+    return false;
+}
+
+bool SyntheticView::isRowVisible(int row) const
+{
+    return row >= firstVisibleRow && row < firstVisibleRow + viewportHeight && row < getRowCount();
+}
+
+QStringList SyntheticView::getSelectedFiles() const
+{
+    return {getCurrentFile()};
+}
+
+void SyntheticView::showFileList(const QString&, std::vector<FileListEntry>)
+{
+}
+
+void SyntheticView::onFilesRemoved(const QStringList&)
+{
+}
+
+void SyntheticView::setSortMode(ESortMode)
+{
+}
+
+void SyntheticView::setMemoryBudget(qint64)
+{
+}
+
+void SyntheticView::setListingConcurrency(int)
+{
+}
+
+void SyntheticView::showReport(const QString&, const QStringList&)
+{
+}
+
+std::optional<quint64> SyntheticView::getListingGeneration(const QString&) const
+{
+    return std::nullopt;
+}
+
+void SyntheticView::visitCachedListing(const QString&, const std::function<void(const QString&)>&) const
+{
+}
+
+std::optional<QStringList> SyntheticView::editLines(const QString&, const QStringList&)
+{
+    return std::nullopt;
+}
+
+void SyntheticView::setListingUpdatesEnabled(bool)
+{
+}
+
+QStringList SyntheticView::getRowNames() const
+{
+    return names;
+}
+
+void SyntheticView::setRowsSelected(const std::vector<int>&, bool)
+{
+}
+
+void SyntheticView::setPreviewMode(EPreviewMode)
+{
+}
+
+EPreviewMode SyntheticView::getPreviewMode() const
+{
+    return EPreviewMode::OFF;
+}
+
+bool SyntheticView::scrollPreviewToLine(qint64)
+{
+    return false;
+}
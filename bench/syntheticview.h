@@ -0,0 +1,58 @@
+#pragma once
+#include "vimodel.h"
+#include <QStringList>
+
+
+// In-memory IViView for driving ViModel without a display. It keeps a flat
+// list of generated names, a cursor and a fixed-height viewport that scrolls
+// the way a table view does, so motions and search see realistic state.
+class SyntheticView final : public IViView {
+public:
+    explicit SyntheticView(int rowCount, int viewportHeight = 50);
+
+    const QString& getName(int row) const;
+
+    QString getCurrentDirectory() const override;
+    void showStatus(const QString&, int secTimeout = 0) override;
+    void searchForward(const QString&) override;
+    void selectRow(int) override;
+    int getRowCount() const override;
+    int getCurrentRow() const override;
+
+    QString getCurrentFile() const override;
+    QString getCurrentDir() const override;
+    bool changeDirectoryIfCan(const QString& dirPath) override;
+    void setColorSchemeName(const QString&) override;
+    void openCurrentDirectory() override;
+    void openParentDirectory() override;
+    void focusToCommandLine(const QString& = {}) override;
+    void activateFileViewer() override;
+    void setMultiSelectionEnabled(bool) override;
+    bool isMultiSelectionEnabled() const override;
+    bool showQuestion(const QString&) override;
+    bool isRowVisible(int) const override;
+    QStringList getSelectedFiles() const override;
+    void showFileList(const QString& rootPath, std::vector<FileListEntry>) override;
+    void onFilesRemoved(const QStringList&) override;
+    void setSortMode(ESortMode) override;
+    void setMemoryBudget(qint64 bytes) override;
+    void setListingConcurrency(int inFlight) override;
+    void showReport(const QString& title, const QStringList& lines) override;
+    std::optional<quint64> getListingGeneration(const QString& dirPath) const override;
+    void visitCachedListing(const QString& dirPath, const std::function<void(const QString&)>& visit) const override;
+    std::optional<QStringList> editLines(const QString& title, const QStringList& lines) override;
+    void setListingUpdatesEnabled(bool) override;
+    QStringList getRowNames() const override;
+    void setRowsSelected(const std::vector<int>& rows, bool selected) override;
+    void setPreviewMode(EPreviewMode) override;
+    EPreviewMode getPreviewMode() const override;
+    bool scrollPreviewToLine(qint64 line) override;
+
+private:
+    QString currentDirectory;
+    QStringList names;
+    int currentRow;
+    int firstVisibleRow;
+    int viewportHeight;
+    bool multiSelectionEnabled;
+};
@@ -0,0 +1,212 @@
+#include "checksummanifest.h"
+#include "parallel.h"
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <functional>
+#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
+#include <fcntl.h>
+#endif
+
+
+namespace {
+
+constexpr qint64 blockSize = 4 * 1024 * 1024;
+constexpr int digestLength = 64;
+
+bool readBlock(QFile& file, QByteArray& buffer)
+{
+    buffer.resize(static_cast<int>(blockSize));
+    const qint64 readSize = file.read(buffer.data(), blockSize);
+    if (readSize < 0)
+        return false;
+    buffer.resize(static_cast<int>(readSize));
+    return true;
+}
+
+// sha256sum marks a line whose name holds a backslash, newline or carriage
+// return with a leading backslash and escapes those characters.
+bool needsEscape(const QByteArray& name)
+{
+    return name.contains('\\') || name.contains('\n') || name.contains('\r');
+}
+
+QByteArray escapeName(const QByteArray& name)
+{
+    QByteArray result;
+    result.reserve(name.size() + 8);
+    for (const char c : name) {
+        if (c == '\\')
+            result += "\\\\";
+        else if (c == '\n')
+            result += "\\n";
+        else if (c == '\r')
+            result += "\\r";
+        else
+            result += c;
+    }
+    return result;
+}
+
+QByteArray unescapeName(const QByteArray& name)
+{
+    QByteArray result;
+    result.reserve(name.size());
+    for (int i = 0; i < name.size(); ++i) {
+        if (name[i] != '\\' || i + 1 == name.size()) {
+            result += name[i];
+            continue;
+        }
+        const char c = name[++i];
+        result += c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+    }
+    return result;
+}
+
+}
+
+
+QStringList ChecksumManifest::collectFiles(const QStringList& paths)
+{
+    QStringList result;
+    for (const QString& path : paths) {
+        const QFileInfo info(path);
+        if (!info.isDir()) {
+            result.push_back(info.absoluteFilePath());
+            continue;
+        }
+        QDirIterator iter(info.absoluteFilePath(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+        while (iter.hasNext())
+            result.push_back(iter.next());
+    }
+    return result;
+}
+
+bool ChecksumManifest::write(const QString& manifestPath, QStringList files,
+                             const std::atomic_bool& cancelled, QString& error)
+{
+    const QFileInfo manifestInfo(manifestPath);
+    files.removeAll(manifestInfo.absoluteFilePath());
+    files.sort();
+
+    const std::vector<QByteArray> digests = hashFiles(files, cancelled);
+    if (cancelled) {
+        error = "Cancelled";
+        return false;
+    }
+
+    QSaveFile output(manifestInfo.absoluteFilePath());
+    if (!output.open(QIODevice::WriteOnly)) {
+        error = output.errorString();
+        return false;
+    }
+    const QDir baseDir = manifestInfo.absoluteDir();
+    for (int i = 0; i < files.size(); ++i) {
+        const QByteArray& digest = digests[static_cast<size_t>(i)];
+        if (digest.isEmpty()) {
+            error = QString("Cannot read %1").arg(files[i]);
+            return false;
+        }
+        const QByteArray name = baseDir.relativeFilePath(files[i]).toUtf8();
+        const bool escaped = needsEscape(name);
+        if (escaped)
+            output.write("\\");
+        output.write(digest);
+        output.write("  ");
+        output.write(escaped ? escapeName(name) : name);
+        output.write("\n");
+    }
+    if (!output.commit()) {
+        error = output.errorString();
+        return false;
+    }
+    return true;
+}
+
+ChecksumManifest::VerifyResult ChecksumManifest::verify(const QString& manifestPath,
+                                                        const std::atomic_bool& cancelled, QString& error)
+{
+    VerifyResult result;
+    QFile manifest(manifestPath);
+    if (!manifest.open(QIODevice::ReadOnly)) {
+        error = manifest.errorString();
+        return result;
+    }
+
+    const QDir baseDir = QFileInfo(manifestPath).absoluteDir();
+    QStringList files;
+    std::vector<QByteArray> expected;
+    for (QByteArray line : manifest.readAll().split('\n')) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        const bool escaped = line.startsWith('\\');
+        if (escaped)
+            line.remove(0, 1);
+        if (line.size() <= digestLength + 2 || line[digestLength] != ' ')
+            continue;
+        const QByteArray name = line.mid(digestLength + 2);
+        const QString path = baseDir.absoluteFilePath(QString::fromUtf8(escaped ? unescapeName(name) : name));
+        if (!QFileInfo::exists(path)) {
+            result.missing.push_back(path);
+            continue;
+        }
+        files.push_back(path);
+        expected.push_back(line.left(digestLength).toLower());
+    }
+
+    const std::vector<QByteArray> digests = hashFiles(files, cancelled);
+    if (cancelled) {
+        error = "Cancelled";
+        return result;
+    }
+    for (int i = 0; i < files.size(); ++i) {
+        if (digests[static_cast<size_t>(i)] == expected[static_cast<size_t>(i)])
+            ++result.passedCount;
+        else
+            result.failed.push_back(files[i]);
+    }
+    return result;
+}
+
+QByteArray ChecksumManifest::hashFile(const QString& path, const std::atomic_bool& cancelled)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return {};
+
+#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
+    // The kernel reads ahead while a block is hashed.
+    posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray block;
+    do {
+        if (cancelled || !readBlock(file, block))
+            return {};
+        hash.addData(block);
+    } while (!block.isEmpty());
+    return hash.result().toHex();
+}
+
+std::vector<QByteArray> ChecksumManifest::hashFiles(const QStringList& files, const std::atomic_bool& cancelled)
+{
+    // Largest files first, so a huge file picked up last does not leave
+    // every other core idle.
+    std::vector<std::pair<qint64, int>> order;
+    order.reserve(static_cast<size_t>(files.size()));
+    for (int i = 0; i < files.size(); ++i)
+        order.emplace_back(QFileInfo(files[i]).size(), i);
+    std::sort(order.begin(), order.end(), std::greater<>());
+
+    std::vector<QByteArray> result(static_cast<size_t>(files.size()));
+    parallelFor(order.size(), [&](size_t i) {
+        const int fileIndex = order[i].second;
+        if (!cancelled)
+            result[static_cast<size_t>(fileIndex)] = hashFile(files[fileIndex], cancelled);
+    });
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <atomic>
+#include <vector>
+
+
+// Writes and checks sha256sum-compatible manifests. Paths inside a manifest
+// are relative to the manifest's directory, so `sha256sum -c` works from there.
+// Names holding a backslash or a line break are escaped as sha256sum does.
+// Files are hashed in parallel on one set of workers; each file is read in
+// big sequential blocks with the kernel reading ahead.
+class ChecksumManifest {
+public:
+    struct VerifyResult {
+        int passedCount = 0;
+        QStringList failed;
+        QStringList missing;
+    };
+
+    static QStringList collectFiles(const QStringList& paths);
+    static bool write(const QString& manifestPath, QStringList files,
+                      const std::atomic_bool& cancelled, QString& error);
+    static VerifyResult verify(const QString& manifestPath, const std::atomic_bool& cancelled, QString& error);
+    static QByteArray hashFile(const QString& path, const std::atomic_bool& cancelled);
+
+private:
+    static std::vector<QByteArray> hashFiles(const QStringList& files, const std::atomic_bool& cancelled);
+};
@@ -0,0 +1,30 @@
+#include "colorscheme.h"
+#include <QApplication>
+#include <QStyle>
+#include <QHash>
+
+
+static QPalette makeDarkPalette()
+{
+    QPalette palette;
+    for (const QPalette::ColorRole role : {QPalette::Window, QPalette::Base, QPalette::AlternateBase, QPalette::Button})
+        palette.setColor(role, Qt::black);
+    for (const QPalette::ColorRole role : {QPalette::WindowText, QPalette::Text, QPalette::ButtonText})
+        palette.setColor(role, Qt::white);
+    palette.setColor(QPalette::Highlight, Qt::yellow);
+    palette.setColor(QPalette::HighlightedText, Qt::black);
+    return palette;
+}
+
+
+const QPalette* findColorScheme(const QString& name)
+{
+    static const QHash<QString, QPalette> colorSchemes = {
+        {"light", QApplication::style()->standardPalette()},
+        {"dark", makeDarkPalette()},
+    };
+    const auto iter = colorSchemes.constFind(name);
+    if (iter == colorSchemes.constEnd())
+        return nullptr;
+    return &iter.value();
+}
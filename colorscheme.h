@@ -0,0 +1,8 @@
+#pragma once
+#include <QPalette>
+#include <QString>
+
+
+// Color schemes are plain palettes built once on first use, so switching
+// schemes never goes through the stylesheet parser.
+const QPalette* findColorScheme(const QString& name);
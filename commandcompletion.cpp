@@ -1,16 +1,22 @@
 #include "commandcompletion.h"
 
 
-CommandCompletion::CommandCompletion(const ViModel& newViModel)
+CommandCompletion::CommandCompletion(const ViModel& newViModel, std::function<void()> newOnPathsReady)
     : viModel(&newViModel)
+    , onPathsReady(std::move(newOnPathsReady))
+    , pathCompletion(newViModel.getUi())
+    , nextPathCandidate(0)
     , valid(false)
+    , completingInPlace(false)
 {}
 
 void CommandCompletion::setInitialString(const QString& value)
 {
     initialString = value;
-    if (!isOneWordLine(*initialString))
+    if (!isOneWordLine(*initialString)) {
+        initPathCompletion();
         return;
+    }
     nextCommand = viModel->cbegin();
     valid = true;
 }
@@ -27,6 +33,13 @@ bool CommandCompletion::isEmpty() const
 
 QString CommandCompletion::getNext()
 {
+    if (!pathCandidates.isEmpty()) {
+        if (nextPathCandidate == pathCandidates.size()) {
+            nextPathCandidate = 0;
+            return *initialString;
+        }
+        return argumentPrefix + pathCandidates[nextPathCandidate++];
+    }
     for (; nextCommand != viModel->cend(); ++nextCommand) {
         const auto& [name, func] = *nextCommand;
         if (name.startsWith(*initialString)) {
@@ -41,6 +54,8 @@ QString CommandCompletion::getNext()
 void CommandCompletion::reset()
 {
     valid = false;
+    pathCompletion.cancel();
+    pathCandidates.clear();
     if (initialString.has_value())
         initialString.reset();
 }
@@ -52,3 +67,24 @@ bool CommandCompletion::isOneWordLine(const QString& line)
     auto charIter = std::find(line.rbegin(), line.rend(), QChar(' '));
     return charIter == line.rend();
 }
+
+void CommandCompletion::initPathCompletion()
+{
+    // Only the last argument is completed, and only for commands that
+    // take paths.
+    const QString& line = *initialString;
+    const QString command = line.section(' ', 0, 0, QString::SectionSkipEmpty);
+    if (!viModel->takesPathArgument(command))
+        return;
+    const int argumentStart = line.lastIndexOf(' ') + 1;
+    argumentPrefix = line.left(argumentStart);
+    completingInPlace = true;
+    pathCompletion.complete(viModel->getUi().getCurrentDirectory(), line.mid(argumentStart), [this](QStringList candidates) {
+        pathCandidates = std::move(candidates);
+        nextPathCandidate = 0;
+        valid = !pathCandidates.isEmpty();
+        if (!completingInPlace && valid && onPathsReady)
+            onPathsReady();
+    });
+    completingInPlace = false;
+}
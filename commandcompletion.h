@@ -1,5 +1,7 @@
 #pragma once
 #include "vimodel.h"
+#include "pathcompletion.h"
+#include <functional>
 #include <optional>
 
 
@@ -7,7 +9,9 @@ class CommandCompletion {
 public:
     using Commands = ViModel::Commands;
 
-    explicit CommandCompletion(const ViModel&);
+    // onPathsReady, if set, is called when path candidates arrive after
+    // the directory had to be listed first.
+    explicit CommandCompletion(const ViModel&, std::function<void()> onPathsReady = {});
     void setInitialString(const QString&);
     bool isValid() const;
     bool isEmpty() const;
@@ -16,10 +20,17 @@ public:
 
 private:
     static bool isOneWordLine(const QString&);
+    void initPathCompletion();
 
 private:
     const ViModel* viModel;
+    std::function<void()> onPathsReady;
+    PathCompletion pathCompletion;
     std::optional<QString> initialString;
     Commands::const_iterator nextCommand;
+    QString argumentPrefix;
+    QStringList pathCandidates;
+    int nextPathCandidate;
     bool valid;
+    bool completingInPlace;
 };
@@ -0,0 +1,79 @@
+#include "datafilereader.h"
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+// Serves reads straight from a mapped file, with 64-bit offsets.
+class MappedDevice : public QIODevice {
+public:
+    MappedDevice(const uchar* data, qint64 size)
+        : data(data)
+        , dataSize(size)
+    {
+        // Unbuffered, as a buffer would only copy the mapped pages again.
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    qint64 size() const override
+    {
+        return dataSize;
+    }
+
+protected:
+    qint64 readData(char* target, qint64 maxSize) override
+    {
+        const qint64 count = std::min(maxSize, dataSize - pos());
+        if (count <= 0)
+            return count < 0 ? -1 : 0;
+        std::memcpy(target, data + pos(), static_cast<size_t>(count));
+        return count;
+    }
+
+    qint64 writeData(const char*, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    const uchar* data;
+    qint64 dataSize;
+};
+
+}
+
+
+DataFileReader::DataFileReader(const QString& filePath, quint32 magic, quint32 version)
+    : file(filePath)
+    , valid(false)
+{
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return;
+    if (const uchar* data = file.map(0, file.size())) {
+        mapped = std::make_unique<MappedDevice>(data, file.size());
+        stream.setDevice(mapped.get());
+    } else {
+        stream.setDevice(&file);
+    }
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 fileMagic = 0;
+    quint32 fileVersion = 0;
+    stream >> fileMagic >> fileVersion;
+    valid = stream.status() == QDataStream::Ok && fileMagic == magic && fileVersion == version;
+}
+
+bool DataFileReader::isValid() const
+{
+    return valid;
+}
+
+qint64 DataFileReader::getSize() const
+{
+    return file.size();
+}
+
+QDataStream& DataFileReader::getStream()
+{
+    return stream;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <QDataStream>
+#include <QFile>
+#include <memory>
+
+
+// Reads the binary files the app keeps for itself (directory history,
+// operation journal, listing snapshot, archive indexes): a QDataStream over
+// a memory map of the file, after the magic number and version the file
+// starts with have been checked. The map is read through a device of its
+// own rather than a QByteArray, so files past 2 GiB are read whole; where
+// the file cannot be mapped, the stream reads it through the file instead.
+class DataFileReader {
+public:
+    DataFileReader(const QString& filePath, quint32 magic, quint32 version);
+
+    // False when the file is missing, empty or of another format.
+    bool isValid() const;
+    qint64 getSize() const;
+    QDataStream& getStream();
+
+private:
+    // Declared in this order so the stream and the device go before the
+    // file, which unmaps on close.
+    QFile file;
+    std::unique_ptr<QIODevice> mapped;
+    QDataStream stream;
+    bool valid;
+};
@@ -0,0 +1,254 @@
+#include "directoryhistory.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include "datafilereader.h"
+#include "util.h"
+
+
+constexpr quint32 historyMagic = 0x464d5a48;
+constexpr quint32 historyVersion = 1;
+constexpr double removedRank = -1e9;
+constexpr double maxTotalRank = 10000;
+constexpr double agingFactor = 0.9;
+constexpr int minCompactionRecordCount = 1000;
+constexpr qint64 hour = 3600;
+constexpr qint64 day = 24 * hour;
+constexpr qint64 week = 7 * day;
+
+
+static qint64 getCurrentTime()
+{
+    return QDateTime::currentSecsSinceEpoch();
+}
+
+
+DirectoryHistory::DirectoryHistory(QString newFilePath)
+    : filePath(std::move(newFilePath))
+    , recordCount(0)
+    , loaded(false)
+{
+    writer.setMaxThreadCount(1);
+}
+
+QString DirectoryHistory::getDefaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) / QString("directories.log");
+}
+
+void DirectoryHistory::addVisit(const QString& dirPath)
+{
+    // The log is read before anything is appended to it, so records of
+    // this session are never counted from the file as well.
+    ensureLoaded();
+    const qint64 now = getCurrentTime();
+    append(dirPath, 1, now);
+    apply(dirPath, 1, now);
+    if (recordCount > minCompactionRecordCount && recordCount > 2 * static_cast<int>(entries.size()))
+        compact();
+}
+
+void DirectoryHistory::remove(const QString& dirPath)
+{
+    ensureLoaded();
+    append(dirPath, removedRank, getCurrentTime());
+    apply(dirPath, removedRank, 0);
+}
+
+QStringList DirectoryHistory::findMatches(const QStringList& terms)
+{
+    ensureLoaded();
+    QStringList foldedTerms;
+    for (const QString& term : terms)
+        foldedTerms.push_back(term.toCaseFolded());
+
+    const qint64 now = getCurrentTime();
+    std::vector<std::pair<double, int>> matches;
+    for (int i = 0; i < static_cast<int>(entries.size()); ++i) {
+        const Entry& entry = entries[static_cast<size_t>(i)];
+        if (entry.rank <= 0)
+            continue;
+        const double matchScore = getMatchScore(entry, foldedTerms);
+        if (matchScore <= 0)
+            continue;
+        const qint64 age = now - entry.lastAccess;
+        const double recency = age < hour ? 4 : age < day ? 2 : age < week ? 0.5 : 0.25;
+        matches.emplace_back(entry.rank * recency * matchScore, i);
+    }
+    std::sort(matches.begin(), matches.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first > rhs.first;
+    });
+
+    QStringList result;
+    for (const auto& [score, i] : matches)
+        result.push_back(entries[static_cast<size_t>(i)].path);
+    return result;
+}
+
+double DirectoryHistory::getMatchScore(const Entry& entry, const QStringList& foldedTerms)
+{
+    // Every term has to appear in order as a subsequence of the path.
+    // Terms found as a whole score higher, and the last term scores highest
+    // when it is part of the final path component, so "z proj" prefers
+    // .../proj over .../proj/src.
+    const QString& path = entry.foldedPath;
+    double score = 1;
+    int position = 0;
+    for (const QString& term : foldedTerms) {
+        const int found = path.indexOf(term, position);
+        if (found >= 0) {
+            score *= 2;
+            position = found + term.size();
+            continue;
+        }
+        for (QChar character : term) {
+            position = path.indexOf(character, position);
+            if (position < 0)
+                return 0;
+            ++position;
+        }
+    }
+    if (!foldedTerms.isEmpty()) {
+        const int lastComponent = path.lastIndexOf('/') + 1;
+        if (path.indexOf(foldedTerms.back(), lastComponent) >= 0)
+            score *= 4;
+    }
+    return score;
+}
+
+void DirectoryHistory::ensureLoaded()
+{
+    if (loaded)
+        return;
+    loaded = true;
+
+    DataFileReader reader(filePath, historyMagic, historyVersion);
+    if (!reader.isValid())
+        return;
+    QDataStream& stream = reader.getStream();
+
+    // A record cut short by a crash ends the log; everything before it
+    // is still used.
+    while (!stream.atEnd()) {
+        QString path;
+        double rank = 0;
+        qint64 time = 0;
+        stream >> path >> rank >> time;
+        if (stream.status() != QDataStream::Ok)
+            break;
+        apply(path, rank, time);
+        ++recordCount;
+    }
+
+    if (recordCount > minCompactionRecordCount && recordCount > 2 * static_cast<int>(entries.size()))
+        compact();
+}
+
+void DirectoryHistory::apply(const QString& dirPath, double rank, qint64 time)
+{
+    const auto found = entryByPath.constFind(dirPath);
+    if (found == entryByPath.cend()) {
+        if (rank <= 0)
+            return;
+        entryByPath.insert(dirPath, static_cast<int>(entries.size()));
+        entries.push_back({dirPath, dirPath.toCaseFolded(), rank, time});
+        return;
+    }
+    Entry& entry = entries[static_cast<size_t>(*found)];
+    entry.rank = rank <= removedRank ? 0 : entry.rank + rank;
+    entry.lastAccess = std::max(entry.lastAccess, time);
+}
+
+void DirectoryHistory::append(const QString& dirPath, double rank, qint64 time)
+{
+    ++recordCount;
+    std::lock_guard lock(pendingMutex);
+    pending.appended.push_back({dirPath, rank, time});
+    scheduleWrite();
+}
+
+void DirectoryHistory::compact()
+{
+    // Ranks are aged like z does: once their sum passes the limit every
+    // rank shrinks, and directories that fall below one visit are forgotten.
+    double totalRank = 0;
+    for (const Entry& entry : entries)
+        totalRank += std::max(0.0, entry.rank);
+    const double factor = totalRank > maxTotalRank ? agingFactor : 1;
+
+    std::vector<Entry> kept;
+    for (Entry& entry : entries) {
+        entry.rank *= factor;
+        if (entry.rank >= 1)
+            kept.push_back(std::move(entry));
+    }
+    entries = std::move(kept);
+    entryByPath.clear();
+    for (int i = 0; i < static_cast<int>(entries.size()); ++i)
+        entryByPath.insert(entries[static_cast<size_t>(i)].path, i);
+
+    // The entries already include every record still waiting to be
+    // appended, so those are dropped.
+    std::vector<Record> records;
+    records.reserve(entries.size());
+    for (const Entry& entry : entries)
+        records.push_back({entry.path, entry.rank, entry.lastAccess});
+    recordCount = static_cast<int>(entries.size());
+    std::lock_guard lock(pendingMutex);
+    pending.compacted = std::move(records);
+    pending.appended.clear();
+    scheduleWrite();
+}
+
+void DirectoryHistory::scheduleWrite()
+{
+    // Records that come in while a write is queued join it.
+    if (writeScheduled)
+        return;
+    writeScheduled = true;
+    writer.run([this](const std::atomic_bool&) {
+        PendingWrites writes;
+        {
+            std::lock_guard lock(pendingMutex);
+            std::swap(writes, pending);
+            writeScheduled = false;
+        }
+        write(writes);
+        return true;
+    }, [](bool) {});
+}
+
+void DirectoryHistory::write(const PendingWrites& writes) const
+{
+    const auto writeRecords = [](QDataStream& stream, const std::vector<Record>& records) {
+        for (const Record& record : records)
+            stream << record.path << record.rank << record.time;
+    };
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    if (writes.compacted) {
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly))
+            return;
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << historyMagic << historyVersion;
+        writeRecords(stream, *writes.compacted);
+        writeRecords(stream, writes.appended);
+        if (stream.status() == QDataStream::Ok)
+            file.commit();
+        return;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::Append))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    if (file.size() == 0)
+        stream << historyMagic << historyVersion;
+    writeRecords(stream, writes.appended);
+}
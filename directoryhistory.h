@@ -0,0 +1,65 @@
+#pragma once
+#include <QHash>
+#include <QStringList>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "taskrunner.h"
+
+
+// Frecency-ranked record of visited directories, in the style of z.
+// Visits are appended to a log file and are cheap enough to record on every
+// directory change: the log is read (through a memory map) on first use,
+// and new records are written in batches on a worker thread, which also
+// rewrites the log into one record per directory once it has grown well
+// past that. Lookups never touch the filesystem.
+class DirectoryHistory {
+public:
+    explicit DirectoryHistory(QString filePath = getDefaultPath());
+
+    void addVisit(const QString& dirPath);
+    void remove(const QString& dirPath);
+    QStringList findMatches(const QStringList& terms);
+
+    static QString getDefaultPath();
+
+private:
+    struct Entry {
+        QString path;
+        QString foldedPath;
+        double rank;
+        qint64 lastAccess;
+    };
+
+    struct Record {
+        QString path;
+        double rank;
+        qint64 time;
+    };
+
+    struct PendingWrites {
+        // Replaces the whole log when set, before the appended records.
+        std::optional<std::vector<Record>> compacted;
+        std::vector<Record> appended;
+    };
+
+    void ensureLoaded();
+    void apply(const QString& dirPath, double rank, qint64 time);
+    void append(const QString& dirPath, double rank, qint64 time);
+    void compact();
+    void scheduleWrite();
+    void write(const PendingWrites&) const;
+    static double getMatchScore(const Entry&, const QStringList& foldedTerms);
+
+private:
+    QString filePath;
+    std::vector<Entry> entries;
+    QHash<QString, int> entryByPath;
+    int recordCount;
+    bool loaded;
+    std::mutex pendingMutex;
+    PendingWrites pending;
+    bool writeScheduled = false;
+    // Last, so queued writes finish before the rest is destroyed.
+    TaskRunner writer;
+};
@@ -0,0 +1,890 @@
+#include "directorymodel.h"
+#include <QDateTime>
+#include <QLocale>
+#include <QSet>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include "util.h"
+#include "parallel.h"
+#include "latencystats.h"
+#include "eventtracer.h"
+#include "vfs.h"
+
+
+enum EDirectoryColumn {
+    NAME,
+    SIZE,
+    LAST_MODIFIED,
+
+    COLUMN_COUNT,
+};
+
+
+constexpr int resortDelay = 100;
+// 60 Hz, until the owner passes the display's frame interval.
+constexpr int defaultFrameInterval = 16;
+constexpr size_t parallelSortThreshold = 50000;
+constexpr size_t keyChunkSize = 4096;
+constexpr qint64 defaultMemoryBudget = 256 * 1024 * 1024;
+// Row index of entries that were removed but not compacted away yet.
+constexpr quint32 noRow = std::numeric_limits<quint32>::max();
+// Removed entries are compacted away once they are over a quarter of all.
+constexpr size_t deadEntryShare = 4;
+// Removals scattered over more ranges are one layout change.
+constexpr size_t maxRemovedRanges = 16;
+
+
+static void appendCollationKeys(std::vector<QCollatorSortKey>& keys, const DirectoryModel::Entries& entries,
+                                bool numericMode)
+{
+    // QCollator instances are not safe to share between threads,
+    // so every chunk gets its own. Sort keys cannot be default-constructed,
+    // so chunks are collected apart and appended in order.
+    const size_t first = keys.size();
+    std::mutex chunksMutex;
+    std::vector<std::pair<size_t, std::vector<QCollatorSortKey>>> chunks;
+    parallelForChunks(entries.size() - first, keyChunkSize, [&](size_t begin, size_t end) {
+        QCollator collator;
+        collator.setCaseSensitivity(Qt::CaseInsensitive);
+        collator.setNumericMode(numericMode);
+        std::vector<QCollatorSortKey> chunk;
+        chunk.reserve(end - begin);
+        for (size_t i = first + begin; i < first + end; ++i)
+            chunk.push_back(collator.sortKey(entries[i].name));
+        const std::lock_guard<std::mutex> lock(chunksMutex);
+        chunks.emplace_back(begin, std::move(chunk));
+    });
+    std::sort(chunks.begin(), chunks.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    keys.reserve(entries.size());
+    for (auto& [begin, chunk] : chunks)
+        std::move(chunk.begin(), chunk.end(), std::back_inserter(keys));
+}
+
+static qint64 estimateBytes(const DirectoryModel::Entry& entry)
+{
+    return static_cast<qint64>(sizeof(entry)) + entry.name.size() * 2;
+}
+
+static qint64 estimateBytes(const DirectoryModel::Entries& entries)
+{
+    qint64 bytes = 0;
+    for (const DirectoryModel::Entry& entry : entries)
+        bytes += estimateBytes(entry);
+    return bytes;
+}
+
+// Cache costs are in KiB and clamped, so even a listing of hundreds of
+// millions of names has a valid cost.
+static int toCost(qint64 bytes)
+{
+    return static_cast<int>(std::clamp<qint64>(bytes / 1024 + 1, 0, std::numeric_limits<int>::max()));
+}
+
+static int estimateCost(const DirectoryModel::Entries& entries)
+{
+    return toCost(estimateBytes(entries));
+}
+
+template<typename T>
+static void compactKeys(std::vector<T>& keys, const std::vector<bool>& alive)
+{
+    if (keys.size() != alive.size()) {
+        keys.clear();
+        return;
+    }
+    size_t target = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (alive[i])
+            keys[target++] = std::move(keys[i]);
+    }
+    keys.erase(keys.begin() + static_cast<std::ptrdiff_t>(target), keys.end());
+}
+
+
+DirectoryModel::DirectoryModel(QObject* parent)
+    : QAbstractTableModel(parent)
+    , sortMode(ESortMode::NAME)
+    , watchingEnabled(false)
+    , listingComplete(false)
+    , listingBudget(0)
+    , shownBytes(0)
+    , deadEntryCount(0)
+    , listingGeneration(0)
+    , contentGeneration(0)
+{
+    resortTimer.setSingleShot(true);
+    resortTimer.setInterval(resortDelay);
+    QObject::connect(&resortTimer, &QTimer::timeout, this, &DirectoryModel::sortEntries);
+    sizeUpdateTimer.setSingleShot(true);
+    sizeUpdateTimer.setInterval(defaultFrameInterval);
+    QObject::connect(&sizeUpdateTimer, &QTimer::timeout, this, &DirectoryModel::applyDirectorySizes);
+    entryMergeTimer.setSingleShot(true);
+    entryMergeTimer.setInterval(defaultFrameInterval);
+    QObject::connect(&entryMergeTimer, &QTimer::timeout, this, &DirectoryModel::mergePendingEntries);
+    QObject::connect(&watcher, &DirectoryWatcher::changed, this, &DirectoryModel::refreshEntries);
+    QObject::connect(&watcher, &DirectoryWatcher::rescanRequired, this, &DirectoryModel::reload);
+    listingRunner.setMaxThreadCount(1);
+    setMemoryBudget(defaultMemoryBudget);
+}
+
+void DirectoryModel::setPath(const QString& newPath)
+{
+    listingRunner.cancel();
+    sizeRunner.cancel();
+    ++listingGeneration;
+    ++contentGeneration;
+    beginResetModel();
+    shownBytes = 0;
+    updateCacheBudget();
+    storeListing();
+    path = newPath;
+    listingComplete = false;
+    entries.clear();
+    rows.clear();
+    clearSortKeys();
+    rowByEntry.clear();
+    entryByName.clear();
+    deadEntryCount = 0;
+    endResetModel();
+    loadTimer.start();
+    if (watchingEnabled)
+        watcher.setPath(path);
+
+    if (Entries* cached = listingCache.take(path)) {
+        listingComplete = true;
+        setEntries(std::move(*cached));
+        delete cached;
+        // Turning watching on rescans anyway.
+        if (watchingEnabled)
+            reload();
+        return;
+    }
+    streamDirectory();
+}
+
+void DirectoryModel::streamDirectory()
+{
+    const quint64 generation = listingGeneration;
+    listingRunner.run([this, dirPath = path, pipeline = listingPipeline, generation](const std::atomic_bool& cancelled) {
+        QString error;
+        pipeline.run(Vfs::get(), dirPath, cancelled, [this, generation](std::vector<VfsStat> batch) {
+            // Batches come back out of order from several requests at
+            // once; they are merged once per frame, not one by one.
+            QMutexLocker locker(&pendingEntriesMutex);
+            pendingEntries.push_back({generation, toEntries(std::move(batch))});
+            if (pendingEntries.size() == 1) {
+                listingRunner.post([this] {
+                    if (!entryMergeTimer.isActive())
+                        entryMergeTimer.start();
+                });
+            }
+        }, error);
+        return error;
+    }, [this, generation](const QString& error) {
+        static LatencyHistogram& listingLatency = LatencyStats::getHistogram("model.listing");
+        if (generation != listingGeneration)
+            return;
+        entryMergeTimer.stop();
+        mergePendingEntries();
+        if (!error.isEmpty()) {
+            // Left incomplete, so what little was listed is not cached.
+            emit listingFailed(error);
+            return;
+        }
+        listingComplete = true;
+        listingLatency.record(loadTimer.nsecsElapsed());
+        emit directoryLoaded(path);
+    });
+}
+
+void DirectoryModel::mergePendingEntries()
+{
+    std::vector<PendingEntries> batches;
+    {
+        QMutexLocker locker(&pendingEntriesMutex);
+        batches.swap(pendingEntries);
+    }
+    Entries merged;
+    for (PendingEntries& batch : batches) {
+        if (batch.generation == listingGeneration)
+            std::move(batch.entries.begin(), batch.entries.end(), std::back_inserter(merged));
+    }
+    if (merged.empty())
+        return;
+    if (entries.empty())
+        setEntries(std::move(merged));
+    else
+        applyChanges(Changes{std::move(merged), {}, false});
+}
+
+void DirectoryModel::storeListing()
+{
+    // A listing left while it was still streaming in would be shown as
+    // the whole directory on the next visit.
+    if (path.isEmpty() || entries.empty() || !listingComplete)
+        return;
+    if (deadEntryCount > 0)
+        compactEntries();
+    const int cost = estimateCost(entries);
+    listingCache.insert(path, new Entries(std::move(entries)), cost);
+}
+
+std::vector<DirectoryModel::Listing> DirectoryModel::getListings() const
+{
+    std::vector<Listing> result;
+    if (!path.isEmpty() && listingComplete) {
+        Entries shown;
+        shown.reserve(rows.size());
+        visitListing(path, [&shown](const Entry& entry) {
+            shown.push_back(entry);
+        });
+        result.push_back({path, std::move(shown)});
+    }
+    for (const QString& cachedPath : listingCache.keys()) {
+        if (const Entries* cached = listingCache.object(cachedPath))
+            result.push_back({cachedPath, *cached});
+    }
+    return result;
+}
+
+bool DirectoryModel::hasListing(const QString& dirPath) const
+{
+    return dirPath == path ? !rows.empty() : listingCache.contains(dirPath);
+}
+
+void DirectoryModel::visitListing(const QString& dirPath, const std::function<void(const Entry&)>& visit) const
+{
+    if (dirPath == path) {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (rowByEntry[i] != noRow)
+                visit(entries[i]);
+        }
+    } else if (const Entries* cached = listingCache.object(dirPath)) {
+        for (const Entry& entry : *cached)
+            visit(entry);
+    }
+}
+
+quint64 DirectoryModel::getContentGeneration() const
+{
+    return contentGeneration;
+}
+
+QStringList DirectoryModel::getRowNames() const
+{
+    QStringList names;
+    names.reserve(static_cast<int>(rows.size()));
+    for (quint32 entry : rows)
+        names.push_back(entries[entry].name);
+    return names;
+}
+
+void DirectoryModel::addListings(std::vector<Listing> listings)
+{
+    ++contentGeneration;
+    // Listings already held are newer than the ones passed in.
+    for (Listing& listing : listings) {
+        if (listing.path == path || listingCache.contains(listing.path))
+            continue;
+        const int cost = estimateCost(listing.entries);
+        listingCache.insert(listing.path, new Entries(std::move(listing.entries)), cost);
+    }
+}
+
+void DirectoryModel::setWatchingEnabled(bool enabled)
+{
+    if (enabled == watchingEnabled)
+        return;
+    watchingEnabled = enabled;
+    watcher.setPath(enabled ? path : QString());
+    if (enabled && !path.isEmpty())
+        reload();
+}
+
+void DirectoryModel::setDecorationProvider(DecorationProvider provider)
+{
+    decorationProvider = std::move(provider);
+    updateDecorations();
+}
+
+void DirectoryModel::updateDecorations()
+{
+    if (!rows.empty())
+        emit dataChanged(index(0, NAME), index(rowCount() - 1, NAME), {Qt::DecorationRole});
+}
+
+void DirectoryModel::setFrameInterval(int msec)
+{
+    sizeUpdateTimer.setInterval(msec);
+    entryMergeTimer.setInterval(msec);
+}
+
+void DirectoryModel::setListingConcurrency(int inFlight)
+{
+    listingPipeline.setInFlight(inFlight);
+}
+
+void DirectoryModel::setMemoryBudget(qint64 bytes)
+{
+    // Listings and directory sizes share the budget evenly.
+    listingBudget = bytes / 2;
+    updateCacheBudget();
+    sizeCalculator.setCacheLimit(bytes / 2);
+}
+
+void DirectoryModel::updateCacheBudget()
+{
+    // The listing on screen counts against the budget too; cached ones
+    // only get what it leaves.
+    const qint64 available = listingBudget - shownBytes;
+    listingCache.setMaxCost(available > 0 ? toCost(available) : 0);
+}
+
+void DirectoryModel::reload()
+{
+    listingRunner.run([dirPath = path, pipeline = listingPipeline](const std::atomic_bool& cancelled) {
+        QString error;
+        Entries present = toEntries(pipeline.list(Vfs::get(), dirPath, cancelled, error));
+        return std::make_pair(Changes{std::move(present), {}, true}, error);
+    }, [this, dirPath = path](std::pair<Changes, QString> result) {
+        if (dirPath != path)
+            return;
+        // A failed listing is not applied, as it would remove every row.
+        if (!result.second.isEmpty())
+            emit listingFailed(result.second);
+        else
+            applyChanges(std::move(result.first));
+    });
+}
+
+const QString& DirectoryModel::getPath() const
+{
+    return path;
+}
+
+bool DirectoryModel::isListingComplete() const
+{
+    return listingComplete;
+}
+
+QString DirectoryModel::filePath(int row) const
+{
+    if (row < 0 || row >= rowCount())
+        return {};
+    return path / getEntry(row).name;
+}
+
+const DirectoryModel::Entry& DirectoryModel::rowEntry(int row) const
+{
+    return getEntry(row);
+}
+
+bool DirectoryModel::isDir(int row) const
+{
+    if (row < 0 || row >= rowCount())
+        return false;
+    return getEntry(row).isDir;
+}
+
+int DirectoryModel::findRow(const QString& name) const
+{
+    const auto iter = entryByName.constFind(name);
+    if (iter == entryByName.constEnd())
+        return -1;
+    return static_cast<int>(rowByEntry[*iter]);
+}
+
+void DirectoryModel::setSortMode(ESortMode newSortMode)
+{
+    sortMode = newSortMode;
+    sortEntries();
+}
+
+ESortMode DirectoryModel::getSortMode() const
+{
+    return sortMode;
+}
+
+int DirectoryModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return static_cast<int>(rows.size());
+}
+
+int DirectoryModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return COLUMN_COUNT;
+}
+
+QVariant DirectoryModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid())
+        return {};
+    const Entry& entry = getEntry(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case NAME:
+            return entry.name;
+        case SIZE:
+            if (entry.size < 0)
+                return {};
+            return QLocale().formattedDataSize(entry.size);
+        case LAST_MODIFIED:
+            return QDateTime::fromMSecsSinceEpoch(entry.lastModified);
+        }
+        break;
+
+    case Qt::DecorationRole:
+        if (index.column() == NAME && decorationProvider)
+            return decorationProvider(entry);
+        break;
+
+    case Qt::TextAlignmentRole:
+        if (index.column() == SIZE)
+            return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+        break;
+    }
+    return {};
+}
+
+void DirectoryModel::setEntries(Entries newEntries)
+{
+    static LatencyHistogram& loadLatency = LatencyStats::getHistogram("model.load");
+    static std::atomic<quint64>& loadedEntryCount = LatencyStats::getCounter("model.entries");
+    const ScopedTrace trace("DirectoryModel::setEntries");
+    ++contentGeneration;
+    beginResetModel();
+    entries = std::move(newEntries);
+    deadEntryCount = 0;
+    rowByEntry.clear();
+    rows.resize(entries.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+        rows[i] = static_cast<quint32>(i);
+    clearSortKeys();
+    entryByName.clear();
+    entryByName.reserve(static_cast<int>(entries.size()));
+    for (size_t i = 0; i < entries.size(); ++i)
+        entryByName.insert(entries[i].name, static_cast<quint32>(i));
+    applySort();
+    endResetModel();
+    shownBytes = estimateBytes(entries);
+    updateCacheBudget();
+    loadLatency.record(loadTimer.nsecsElapsed());
+    loadedEntryCount.fetch_add(entries.size(), std::memory_order_relaxed);
+    emit directoryLoaded(path);
+
+    QStringList dirNames;
+    for (const Entry& entry : entries) {
+        if (entry.isDir)
+            dirNames.push_back(entry.name);
+    }
+    calculateDirectorySizes(dirNames);
+}
+
+void DirectoryModel::refreshEntries(const QStringList& names)
+{
+    listingRunner.run([dirPath = path, names](const std::atomic_bool&) {
+        return statEntries(dirPath, names);
+    }, [this, dirPath = path](Changes changes) {
+        if (dirPath == path)
+            applyChanges(std::move(changes));
+    });
+}
+
+void DirectoryModel::applyChanges(Changes changes)
+{
+    static LatencyHistogram& changesLatency = LatencyStats::getHistogram("model.changes");
+    const ScopedLatency latency(changesLatency);
+    const ScopedTrace trace("DirectoryModel::applyChanges");
+    ++contentGeneration;
+    std::vector<int> removedRows;
+    if (changes.complete) {
+        QSet<QString> presentNames;
+        presentNames.reserve(static_cast<int>(changes.present.size()));
+        for (const Entry& entry : changes.present)
+            presentNames.insert(entry.name);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (!presentNames.contains(entries[rows[i]].name))
+                removedRows.push_back(static_cast<int>(i));
+        }
+    } else {
+        for (const QString& name : changes.missing) {
+            if (const int row = findRow(name); row >= 0)
+                removedRows.push_back(row);
+        }
+    }
+
+    Entries added;
+    QStringList addedDirNames;
+    bool updated = false;
+    for (Entry& entry : changes.present) {
+        const auto iter = entryByName.constFind(entry.name);
+        if (iter == entryByName.constEnd()) {
+            if (entry.isDir)
+                addedDirNames.push_back(entry.name);
+            added.push_back(std::move(entry));
+            continue;
+        }
+        Entry& current = entries[*iter];
+        if (entry.isDir && current.isDir)
+            entry.size = current.size;
+        if (current.size == entry.size && current.lastModified == entry.lastModified && current.isDir == entry.isDir)
+            continue;
+        current = std::move(entry);
+        updated = true;
+        const int row = static_cast<int>(rowByEntry[*iter]);
+        emit dataChanged(index(row, 0), index(row, COLUMN_COUNT - 1));
+    }
+    if (updated && sortMode != ESortMode::NAME && !resortTimer.isActive())
+        resortTimer.start();
+
+    removeEntryRows(std::move(removedRows));
+    insertEntries(std::move(added));
+    calculateDirectorySizes(addedDirNames);
+}
+
+void DirectoryModel::removeEntryRows(std::vector<int> removedRows)
+{
+    if (removedRows.empty())
+        return;
+    std::sort(removedRows.begin(), removedRows.end());
+    removedRows.erase(std::unique(removedRows.begin(), removedRows.end()), removedRows.end());
+    // Removed entries stay where they are, marked dead, and only their
+    // rows go; the rows after the first one removed are renumbered once.
+    const auto markDead = [this](int first, int last) {
+        for (int row = first; row <= last; ++row) {
+            const quint32 entryIndex = rows[static_cast<size_t>(row)];
+            entryByName.remove(entries[entryIndex].name);
+            shownBytes -= estimateBytes(entries[entryIndex]);
+            rowByEntry[entryIndex] = noRow;
+        }
+        deadEntryCount += static_cast<size_t>(last - first + 1);
+    };
+    const auto renumberRows = [this, first = static_cast<size_t>(removedRows.front())] {
+        for (size_t i = first; i < rows.size(); ++i)
+            rowByEntry[rows[i]] = static_cast<quint32>(i);
+    };
+
+    std::vector<std::pair<int, int>> ranges;
+    for (size_t begin = 0; begin < removedRows.size();) {
+        size_t end = begin + 1;
+        while (end < removedRows.size() && removedRows[end] == removedRows[end - 1] + 1)
+            ++end;
+        ranges.emplace_back(removedRows[begin], removedRows[end - 1]);
+        begin = end;
+    }
+    if (ranges.size() > maxRemovedRanges) {
+        changeLayout([&] {
+            for (const auto& [first, last] : ranges)
+                markDead(first, last);
+            rows.erase(std::remove_if(rows.begin(), rows.end(), [this](quint32 entryIndex) {
+                return rowByEntry[entryIndex] == noRow;
+            }), rows.end());
+            renumberRows();
+        });
+    } else {
+        // Back to front, so the rows of the ranges still to go stay put.
+        for (auto iter = ranges.rbegin(); iter != ranges.rend(); ++iter) {
+            beginRemoveRows({}, iter->first, iter->second);
+            markDead(iter->first, iter->second);
+            rows.erase(rows.begin() + iter->first, rows.begin() + iter->second + 1);
+            endRemoveRows();
+        }
+        renumberRows();
+    }
+
+    if (deadEntryCount * deadEntryShare > entries.size())
+        compactEntries();
+    else
+        updateCacheBudget();
+}
+
+void DirectoryModel::insertEntries(Entries added)
+{
+    if (added.empty())
+        return;
+    const int first = rowCount();
+    beginInsertRows({}, first, first + static_cast<int>(added.size()) - 1);
+    for (Entry& entry : added) {
+        shownBytes += estimateBytes(entry);
+        const auto entryIndex = static_cast<quint32>(entries.size());
+        entryByName.insert(entry.name, entryIndex);
+        rows.push_back(entryIndex);
+        rowByEntry.push_back(static_cast<quint32>(rows.size() - 1));
+        entries.push_back(std::move(entry));
+    }
+    endInsertRows();
+    updateCacheBudget();
+    // The rows before the new ones are in order already, so only the new
+    // ones are sorted and then merged in.
+    changeLayout([this, first] { mergeRows(static_cast<size_t>(first)); });
+}
+
+void DirectoryModel::compactEntries()
+{
+    std::vector<bool> alive(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        alive[i] = rowByEntry[i] != noRow;
+
+    std::vector<quint32> newIndexes(entries.size());
+    size_t target = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        newIndexes[i] = static_cast<quint32>(target);
+        if (alive[i])
+            entries[target++] = std::move(entries[i]);
+    }
+    entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(target), entries.end());
+    for (quint32& entryIndex : rows)
+        entryIndex = newIndexes[entryIndex];
+
+    compactKeys(nameKeys, alive);
+    compactKeys(naturalKeys, alive);
+    compactKeys(extensionKeys, alive);
+    deadEntryCount = 0;
+
+    entryByName.clear();
+    for (size_t i = 0; i < entries.size(); ++i)
+        entryByName.insert(entries[i].name, static_cast<quint32>(i));
+    updateRowIndex();
+    shownBytes = estimateBytes(entries);
+    updateCacheBudget();
+}
+
+void DirectoryModel::calculateDirectorySizes(const QStringList& names)
+{
+    if (names.isEmpty())
+        return;
+
+    sizeRunner.run([this, dirPath = path, names](const std::atomic_bool& cancelled) {
+        sizeCalculator.calculate(dirPath, names, cancelled, [this, &dirPath](const QString& name, qint64 size) {
+            // Results are batched and applied once per frame instead of
+            // one event and one dataChanged per directory.
+            QMutexLocker locker(&pendingSizesMutex);
+            pendingSizes.push_back({dirPath, name, size});
+            if (pendingSizes.size() == 1) {
+                sizeRunner.post([this] {
+                    if (!sizeUpdateTimer.isActive())
+                        sizeUpdateTimer.start();
+                });
+            }
+        });
+        return true;
+    }, [](bool) {});
+}
+
+void DirectoryModel::applyDirectorySizes()
+{
+    std::vector<PendingSize> sizes;
+    {
+        QMutexLocker locker(&pendingSizesMutex);
+        sizes.swap(pendingSizes);
+    }
+    int firstRow = rowCount();
+    int lastRow = -1;
+    for (const PendingSize& pending : sizes) {
+        if (pending.dirPath != path)
+            continue;
+        const int row = findRow(pending.name);
+        if (row < 0)
+            continue;
+        getEntry(row).size = pending.size;
+        firstRow = std::min(firstRow, row);
+        lastRow = std::max(lastRow, row);
+    }
+    if (lastRow < 0)
+        return;
+    emit dataChanged(index(firstRow, SIZE), index(lastRow, SIZE));
+    if (sortMode == ESortMode::SIZE && !resortTimer.isActive())
+        resortTimer.start();
+}
+
+void DirectoryModel::sortEntries()
+{
+    changeLayout([this] { applySort(); });
+}
+
+template<typename Reorder>
+void DirectoryModel::changeLayout(Reorder reorder)
+{
+    emit layoutAboutToBeChanged();
+    const QModelIndexList oldIndexes = persistentIndexList();
+    std::vector<quint32> oldEntries;
+    for (const QModelIndex& oldIndex : oldIndexes)
+        oldEntries.push_back(rows[static_cast<size_t>(oldIndex.row())]);
+
+    reorder();
+
+    QModelIndexList newIndexes;
+    for (int i = 0; i < oldIndexes.size(); ++i) {
+        const quint32 newRow = rowByEntry[oldEntries[static_cast<size_t>(i)]];
+        newIndexes.push_back(newRow == noRow ? QModelIndex() : index(static_cast<int>(newRow), oldIndexes[i].column()));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+    emit layoutChanged();
+}
+
+void DirectoryModel::applySort()
+{
+    static LatencyHistogram& sortLatency = LatencyStats::getHistogram("model.sort");
+    const ScopedLatency latency(sortLatency);
+    const ScopedTrace trace("DirectoryModel::applySort");
+    withRowOrder([this](const auto& compare) {
+        sortRows(compare);
+    });
+    updateRowIndex();
+}
+
+void DirectoryModel::mergeRows(size_t sortedCount)
+{
+    static LatencyHistogram& mergeLatency = LatencyStats::getHistogram("model.merge");
+    const ScopedLatency latency(mergeLatency);
+    const ScopedTrace trace("DirectoryModel::mergeRows");
+    const auto middle = rows.begin() + static_cast<std::ptrdiff_t>(sortedCount);
+    withRowOrder([&](const auto& compare) {
+        std::sort(middle, rows.end(), compare);
+        std::inplace_merge(rows.begin(), middle, rows.end(), compare);
+    });
+    updateRowIndex();
+}
+
+template<typename Function>
+void DirectoryModel::withRowOrder(Function function)
+{
+    ensureSortKeys(sortMode);
+    const auto compareNames = [this](quint32 lhs, quint32 rhs) {
+        const int result = nameKeys[lhs].compare(nameKeys[rhs]);
+        return result != 0 ? result < 0 : lhs < rhs;
+    };
+
+    switch (sortMode) {
+    case ESortMode::NAME:
+        function([&](quint32 lhs, quint32 rhs) {
+            if (entries[lhs].isDir != entries[rhs].isDir)
+                return entries[lhs].isDir;
+            return compareNames(lhs, rhs);
+        });
+        break;
+
+    case ESortMode::NATURAL:
+        function([&](quint32 lhs, quint32 rhs) {
+            if (entries[lhs].isDir != entries[rhs].isDir)
+                return entries[lhs].isDir;
+            const int result = naturalKeys[lhs].compare(naturalKeys[rhs]);
+            return result != 0 ? result < 0 : lhs < rhs;
+        });
+        break;
+
+    case ESortMode::EXTENSION:
+        function([&](quint32 lhs, quint32 rhs) {
+            if (entries[lhs].isDir != entries[rhs].isDir)
+                return entries[lhs].isDir;
+            const int result = extensionKeys[lhs].compare(extensionKeys[rhs]);
+            return result != 0 ? result < 0 : compareNames(lhs, rhs);
+        });
+        break;
+
+    case ESortMode::SIZE:
+    case ESortMode::MTIME: {
+        // Packed copies keep the hot comparison on a contiguous array.
+        std::vector<qint64> keys(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            keys[i] = sortMode == ESortMode::SIZE ? entries[i].size : entries[i].lastModified;
+        function([&](quint32 lhs, quint32 rhs) {
+            if (keys[lhs] != keys[rhs])
+                return keys[lhs] > keys[rhs];
+            return compareNames(lhs, rhs);
+        });
+        break;
+    }
+    }
+}
+
+template<typename Compare>
+void DirectoryModel::sortRows(Compare compare)
+{
+    if (rows.size() > parallelSortThreshold)
+        parallelSort(rows.begin(), rows.end(), compare);
+    else
+        std::sort(rows.begin(), rows.end(), compare);
+}
+
+void DirectoryModel::ensureSortKeys(ESortMode mode)
+{
+    // Keys are only ever missing for entries appended since the last sort.
+    if (mode == ESortMode::NATURAL) {
+        if (naturalKeys.size() != entries.size())
+            appendCollationKeys(naturalKeys, entries, true);
+        return;
+    }
+    if (nameKeys.size() != entries.size())
+        appendCollationKeys(nameKeys, entries, false);
+    if (mode == ESortMode::EXTENSION && extensionKeys.size() != entries.size()) {
+        const size_t first = extensionKeys.size();
+        extensionKeys.resize(entries.size());
+        parallelForChunks(entries.size() - first, keyChunkSize, [&](size_t begin, size_t end) {
+            for (size_t i = first + begin; i < first + end; ++i) {
+                const QString& name = entries[i].name;
+                const int dotPos = name.lastIndexOf('.');
+                if (!entries[i].isDir && dotPos > 0)
+                    extensionKeys[i] = name.mid(dotPos + 1).toCaseFolded();
+            }
+        });
+    }
+}
+
+void DirectoryModel::clearSortKeys()
+{
+    nameKeys.clear();
+    naturalKeys.clear();
+    extensionKeys.clear();
+}
+
+void DirectoryModel::updateRowIndex()
+{
+    rowByEntry.resize(entries.size(), noRow);
+    for (size_t i = 0; i < rows.size(); ++i)
+        rowByEntry[rows[i]] = static_cast<quint32>(i);
+}
+
+const DirectoryModel::Entry& DirectoryModel::getEntry(int row) const
+{
+    return entries[rows[static_cast<size_t>(row)]];
+}
+
+DirectoryModel::Entry& DirectoryModel::getEntry(int row)
+{
+    return entries[rows[static_cast<size_t>(row)]];
+}
+
+DirectoryModel::Entries DirectoryModel::toEntries(std::vector<VfsStat> stats)
+{
+    Entries result;
+    result.reserve(stats.size());
+    for (VfsStat& stat : stats)
+        result.push_back({std::move(stat.name), stat.size, stat.lastModified, stat.isDir});
+    return result;
+}
+
+DirectoryModel::Changes DirectoryModel::statEntries(const QString& dirPath, const QStringList& names)
+{
+    Changes result{{}, {}, false};
+    std::vector<std::optional<VfsStat>> stats = Vfs::get().statBatch(dirPath, names);
+    for (int i = 0; i < names.size(); ++i) {
+        std::optional<VfsStat>& stat = stats[static_cast<size_t>(i)];
+        if (!stat) {
+            result.missing.push_back(names[i]);
+            continue;
+        }
+        result.present.push_back({names[i], stat->size, stat->lastModified, stat->isDir});
+    }
+    return result;
+}
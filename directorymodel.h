@@ -0,0 +1,169 @@
+#pragma once
+#include <QAbstractTableModel>
+#include <QCollator>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QHash>
+#include <QTimer>
+#include <functional>
+#include <vector>
+#include "sortmode.h"
+#include "taskrunner.h"
+#include "directorysizecalculator.h"
+#include "directorywatcher.h"
+#include "listingpipeline.h"
+
+
+// Flat listing of a single directory. The listing is read on a worker
+// thread through a ListingPipeline and merged in once per frame as stat
+// batches complete, each batch sorted on its own and merged into the rows;
+// directory sizes are filled in afterwards as they are calculated.
+// Entries stay in load order and rows map onto them through a permutation;
+// sort keys are computed once per entry and kept until the listing changes,
+// so switching sort modes only re-sorts the permutation. Removed entries
+// are only marked dead until enough of them pile up to be compacted away.
+// Changes reported by the watcher are applied as a diff that keeps
+// persistent indexes (and so the view's cursor) on their entries.
+// Listings of recently left directories stay in a memory-bounded cache:
+// revisiting one shows it at once and then rescans it, while the least
+// recently visited ones are dropped once the budget, which the listing on
+// screen counts against as well, is exceeded.
+class DirectoryModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString name;
+        qint64 size;
+        qint64 lastModified;
+        bool isDir;
+    };
+    using Entries = std::vector<Entry>;
+    using DecorationProvider = std::function<QVariant(const Entry&)>;
+
+    struct Listing {
+        QString path;
+        Entries entries;
+    };
+
+    struct Changes {
+        Entries present;
+        QStringList missing;
+        bool complete;
+    };
+
+    explicit DirectoryModel(QObject* parent = nullptr);
+
+    void setPath(const QString&);
+    void reload();
+    const QString& getPath() const;
+    // False while the listing of the path is still streaming in.
+    bool isListingComplete() const;
+    QString filePath(int row) const;
+    bool isDir(int row) const;
+    const Entry& rowEntry(int row) const;
+    int findRow(const QString& name) const;
+
+    void setSortMode(ESortMode);
+    ESortMode getSortMode() const;
+    void setMemoryBudget(qint64 bytes);
+    void setListingConcurrency(int inFlight);
+    // Batches of entries and directory sizes are merged in at most once
+    // per interval; the owner passes the display's frame interval.
+    void setFrameInterval(int msec);
+    void setWatchingEnabled(bool);
+    void setDecorationProvider(DecorationProvider);
+    void updateDecorations();
+    std::vector<Listing> getListings() const;
+    bool hasListing(const QString& dirPath) const;
+    // Visits the entries of the shown listing or of a cached one.
+    void visitListing(const QString& dirPath, const std::function<void(const Entry&)>&) const;
+    // Changes whenever the names of any listing in memory change, so
+    // anything derived from them knows when to be rebuilt.
+    quint64 getContentGeneration() const;
+    QStringList getRowNames() const;
+    void addListings(std::vector<Listing>);
+
+    int rowCount(const QModelIndex& parent = {}) const override;
+    int columnCount(const QModelIndex& parent = {}) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+
+signals:
+    void directoryLoaded(const QString& path);
+    void listingFailed(const QString& error);
+
+private:
+    struct PendingSize {
+        QString dirPath;
+        QString name;
+        qint64 size;
+    };
+
+    struct PendingEntries {
+        quint64 generation;
+        Entries entries;
+    };
+
+    void streamDirectory();
+    void mergePendingEntries();
+    void setEntries(Entries);
+    void storeListing();
+    void updateCacheBudget();
+    void refreshEntries(const QStringList& names);
+    void applyChanges(Changes);
+    void removeEntryRows(std::vector<int>);
+    void insertEntries(Entries);
+    void compactEntries();
+    void calculateDirectorySizes(const QStringList& names);
+    void applyDirectorySizes();
+    void sortEntries();
+    template<typename Reorder>
+    void changeLayout(Reorder);
+    void applySort();
+    void mergeRows(size_t sortedCount);
+    template<typename Function>
+    void withRowOrder(Function);
+    void updateRowIndex();
+    void ensureSortKeys(ESortMode);
+    void clearSortKeys();
+    template<typename Compare>
+    void sortRows(Compare);
+    const Entry& getEntry(int row) const;
+    Entry& getEntry(int row);
+    static Entries toEntries(std::vector<VfsStat>);
+    static Changes statEntries(const QString& path, const QStringList& names);
+
+private:
+    QString path;
+    Entries entries;
+    std::vector<quint32> rows;
+    std::vector<QCollatorSortKey> nameKeys;
+    std::vector<QCollatorSortKey> naturalKeys;
+    std::vector<QString> extensionKeys;
+    std::vector<quint32> rowByEntry;
+    QHash<QString, quint32> entryByName;
+    QCache<QString, Entries> listingCache;
+    DecorationProvider decorationProvider;
+    ESortMode sortMode;
+    bool watchingEnabled;
+    bool listingComplete;
+    qint64 listingBudget;
+    qint64 shownBytes;
+    size_t deadEntryCount;
+    DirectoryWatcher watcher;
+    QTimer resortTimer;
+    QElapsedTimer loadTimer;
+    QTimer sizeUpdateTimer;
+    QMutex pendingSizesMutex;
+    std::vector<PendingSize> pendingSizes;
+    QTimer entryMergeTimer;
+    QMutex pendingEntriesMutex;
+    std::vector<PendingEntries> pendingEntries;
+    quint64 listingGeneration;
+    quint64 contentGeneration;
+    ListingPipeline listingPipeline;
+    DirectorySizeCalculator sizeCalculator;
+    TaskRunner listingRunner;
+    TaskRunner sizeRunner;
+};
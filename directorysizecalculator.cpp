@@ -0,0 +1,290 @@
+#include "directorysizecalculator.h"
+#include "parallel.h"
+#include "util.h"
+#include "vfs.h"
+#include <QFile>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// A file growing in place leaves its directory's mtime alone, so a cached
+// total of the files in a directory is only trusted for a short while.
+constexpr std::chrono::seconds maxCacheAge(10);
+
+
+static qint64 getMonotonicTime()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+struct DirectorySizeCalculator::Walk {
+    struct Task {
+        QString path;
+        qint64 lastModified; // only used for paths that are not local
+        size_t root;
+    };
+
+    Walk(DirectorySizeCalculator& owner, const QString& parentPath, const QStringList& names,
+         const std::atomic_bool& cancelled, const ResultCallback& onResult);
+
+    void work();
+    void process(const Task&);
+    void add(Task);
+    void finish(size_t root);
+#ifdef Q_OS_UNIX
+    void measureLocal(const Task&);
+    bool isFirstLink(const struct stat&);
+#endif
+    void measure(const Task&);
+
+    DirectorySizeCalculator& owner;
+    const QStringList& names;
+    const std::atomic_bool& cancelled;
+    const ResultCallback& onResult;
+    const bool local;
+    const size_t workerCount;
+    std::vector<std::atomic<qint64>> totals;
+    std::vector<std::atomic_int> pendingCounts;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::vector<Task> queue;
+    int busyCount = 0;
+    QMutex linksMutex;
+    std::set<std::pair<quint64, quint64>> seenLinks;
+};
+
+
+DirectorySizeCalculator::Walk::Walk(DirectorySizeCalculator& owner, const QString& parentPath, const QStringList& names,
+                                    const std::atomic_bool& cancelled, const ResultCallback& onResult)
+    : owner(owner)
+    , names(names)
+    , cancelled(cancelled)
+    , onResult(onResult)
+#ifdef Q_OS_UNIX
+    , local(Vfs::get().isLocal(parentPath))
+#else
+    , local(false)
+#endif
+    , workerCount(getWorkerCount())
+    , totals(static_cast<size_t>(names.size()))
+    , pendingCounts(static_cast<size_t>(names.size()))
+{
+    std::vector<std::optional<qint64>> lastModified(static_cast<size_t>(names.size()), qint64(0));
+    if (!local) {
+        const std::vector<std::optional<VfsStat>> stats = Vfs::get().statBatch(parentPath, names);
+        for (size_t i = 0; i < stats.size(); ++i)
+            lastModified[i] = stats[i] ? std::optional<qint64>(stats[i]->lastModified) : std::nullopt;
+    }
+    // Tasks are taken from the back, so the first names come first.
+    for (size_t i = static_cast<size_t>(names.size()); i-- > 0;) {
+        totals[i] = 0;
+        pendingCounts[i] = 1;
+        if (lastModified[i])
+            queue.push_back({parentPath / names[static_cast<int>(i)], *lastModified[i], i});
+        else
+            finish(i);
+    }
+}
+
+void DirectorySizeCalculator::Walk::work()
+{
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return !queue.empty() || busyCount == 0; });
+            if (queue.empty())
+                return;
+            task = std::move(queue.back());
+            queue.pop_back();
+            ++busyCount;
+        }
+        process(task);
+        {
+            const std::lock_guard<std::mutex> lock(queueMutex);
+            --busyCount;
+        }
+        queueChanged.notify_all();
+    }
+}
+
+void DirectorySizeCalculator::Walk::process(const Task& task)
+{
+    if (!cancelled) {
+#ifdef Q_OS_UNIX
+        if (local)
+            measureLocal(task);
+        else
+#endif
+            measure(task);
+    }
+    finish(task.root);
+}
+
+void DirectorySizeCalculator::Walk::add(Task task)
+{
+    // Subdirectories go to idle workers while there are any, so one huge
+    // subtree is split all the way down; otherwise the current worker
+    // measures them itself, depth first.
+    ++pendingCounts[task.root];
+    {
+        const std::lock_guard<std::mutex> lock(queueMutex);
+        if (queue.size() < workerCount) {
+            queue.push_back(std::move(task));
+            queueChanged.notify_one();
+            return;
+        }
+    }
+    process(task);
+}
+
+void DirectorySizeCalculator::Walk::finish(size_t root)
+{
+    if (--pendingCounts[root] == 0 && !cancelled)
+        onResult(names[static_cast<int>(root)], totals[root]);
+}
+
+
+void DirectorySizeCalculator::calculate(const QString& parentPath, const QStringList& names,
+                                        const std::atomic_bool& cancelled, const ResultCallback& onResult)
+{
+    Walk walk(*this, parentPath, names, cancelled, onResult);
+    parallelFor(walk.workerCount, [&walk](size_t) {
+        walk.work();
+    });
+}
+
+void DirectorySizeCalculator::setCacheLimit(qint64 bytes)
+{
+    QMutexLocker locker(&cacheMutex);
+    cache.setMaxCost(static_cast<int>(bytes / 1024));
+}
+
+bool DirectorySizeCalculator::findCached(const QString& path, qint64 lastModified, CacheEntry& result)
+{
+    QMutexLocker locker(&cacheMutex);
+    const CacheEntry* entry = cache.object(path);
+    if (entry == nullptr || entry->lastModified != lastModified)
+        return false;
+    if (getMonotonicTime() - entry->measuredAt > std::chrono::milliseconds(maxCacheAge).count())
+        return false;
+    result = *entry;
+    return true;
+}
+
+void DirectorySizeCalculator::store(const QString& path, CacheEntry entry)
+{
+    entry.measuredAt = getMonotonicTime();
+    qint64 bytes = static_cast<qint64>(sizeof(CacheEntry)) + path.size() * 2;
+    for (const QString& subdirectory : entry.subdirectories)
+        bytes += static_cast<qint64>(sizeof(QString)) + subdirectory.size() * 2;
+    QMutexLocker locker(&cacheMutex);
+    cache.insert(path, new CacheEntry(std::move(entry)), static_cast<int>(bytes / 1024) + 1);
+}
+
+#ifdef Q_OS_UNIX
+
+void DirectorySizeCalculator::Walk::measureLocal(const Task& task)
+{
+    const int fd = open(QFile::encodeName(task.path).constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat dirStat;
+    if (fstat(fd, &dirStat) != 0) {
+        close(fd);
+        return;
+    }
+#ifdef Q_OS_DARWIN
+    const timespec& mtime = dirStat.st_mtimespec;
+#else
+    const timespec& mtime = dirStat.st_mtim;
+#endif
+    const qint64 lastModified = static_cast<qint64>(mtime.tv_sec) * 1000 + mtime.tv_nsec / 1000000;
+    qint64 total = static_cast<qint64>(dirStat.st_blocks) * 512;
+
+    CacheEntry entry;
+    if (!owner.findCached(task.path, lastModified, entry)) {
+        entry = {lastModified, 0, 0, {}};
+        DIR* dir = fdopendir(fd);
+        if (dir == nullptr) {
+            close(fd);
+            totals[task.root] += total;
+            return;
+        }
+        while (const dirent* child = readdir(dir)) {
+            const char* childName = child->d_name;
+            if (childName[0] == '.' && (childName[1] == '\0' || (childName[1] == '.' && childName[2] == '\0')))
+                continue;
+            if (child->d_type == DT_DIR) {
+                entry.subdirectories.push_back(QFile::decodeName(childName));
+                continue;
+            }
+            struct stat childStat;
+            if (fstatat(dirfd(dir), childName, &childStat, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            if (S_ISDIR(childStat.st_mode))
+                entry.subdirectories.push_back(QFile::decodeName(childName));
+            else if (childStat.st_nlink < 2 || isFirstLink(childStat))
+                entry.ownSize += static_cast<qint64>(childStat.st_blocks) * 512;
+        }
+        closedir(dir);
+        if (!cancelled)
+            owner.store(task.path, entry);
+    } else {
+        close(fd);
+    }
+
+    totals[task.root] += total + entry.ownSize;
+    for (const QString& subdirectory : entry.subdirectories)
+        add({task.path / subdirectory, 0, task.root});
+}
+
+bool DirectorySizeCalculator::Walk::isFirstLink(const struct stat& fileStat)
+{
+    QMutexLocker locker(&linksMutex);
+    return seenLinks.emplace(static_cast<quint64>(fileStat.st_dev), static_cast<quint64>(fileStat.st_ino)).second;
+}
+
+#endif
+
+void DirectorySizeCalculator::Walk::measure(const Task& task)
+{
+    IVfs& vfs = Vfs::get();
+    CacheEntry entry;
+    // Subdirectories gone since they were cached are skipped.
+    std::vector<std::optional<qint64>> subdirectoryModified;
+    if (owner.findCached(task.path, task.lastModified, entry)) {
+        for (const std::optional<VfsStat>& stat : vfs.statBatch(task.path, entry.subdirectories))
+            subdirectoryModified.push_back(stat ? std::optional<qint64>(stat->lastModified) : std::nullopt);
+    } else {
+        entry = {task.lastModified, 0, 0, {}};
+        QString error;
+        for (const VfsStat& child : vfs.list(task.path, cancelled, error)) {
+            if (child.isDir) {
+                entry.subdirectories.push_back(child.name);
+                subdirectoryModified.push_back(child.lastModified);
+            } else {
+                entry.ownSize += child.size;
+            }
+        }
+        // An unreadable directory counts as empty but is not cached.
+        if (cancelled || !error.isEmpty())
+            return;
+        owner.store(task.path, entry);
+    }
+
+    totals[task.root] += entry.ownSize;
+    for (int i = 0; i < entry.subdirectories.size(); ++i) {
+        if (const std::optional<qint64>& modified = subdirectoryModified[static_cast<size_t>(i)])
+            add({task.path / entry.subdirectories[i], *modified, task.root});
+    }
+}
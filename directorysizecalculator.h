@@ -0,0 +1,51 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QCache>
+#include <QMutex>
+#include <atomic>
+#include <functional>
+#include <set>
+
+
+// Computes the disk usage of directories, like `du`.
+// Every visited directory is cached with its modification time, the bytes
+// taken by its direct files and the names of its subdirectories. A directory
+// whose mtime did not change is not listed again for a few seconds; only its
+// subdirectories are revisited, so repeated calculations and parent totals
+// right after each other reuse earlier work. Past that the files are stated
+// again, as a file growing in place does not touch the directory's mtime.
+// The cache is bounded; least recently used directories are dropped first.
+// Directories at any depth are handed to idle workers, so a single huge
+// subtree is measured on every core.
+// Local directories are walked with the OS directly, counting allocated
+// blocks and each hard-linked file once; anything else (archives, remote
+// or throttled backends) goes through the Vfs and counts apparent sizes.
+class DirectorySizeCalculator {
+public:
+    using ResultCallback = std::function<void(const QString& name, qint64 size)>;
+
+    // Measures each of `names` inside `parentPath` and reports every result
+    // as soon as it is known, from any of the workers. Called from a worker
+    // thread.
+    void calculate(const QString& parentPath, const QStringList& names,
+                   const std::atomic_bool& cancelled, const ResultCallback&);
+    void setCacheLimit(qint64 bytes);
+
+private:
+    struct CacheEntry {
+        qint64 lastModified;
+        qint64 measuredAt;
+        qint64 ownSize;
+        QStringList subdirectories;
+    };
+
+    struct Walk;
+
+    bool findCached(const QString& path, qint64 lastModified, CacheEntry&);
+    void store(const QString& path, CacheEntry);
+
+private:
+    QMutex cacheMutex;
+    QCache<QString, CacheEntry> cache;
+};
@@ -0,0 +1,116 @@
+#include "directorywatcher.h"
+#include <QFile>
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+constexpr int coalescingWindow = 50;
+constexpr int maxPendingNames = 4096;
+
+
+DirectoryWatcher::DirectoryWatcher(QObject* parent)
+    : QObject(parent)
+#ifdef Q_OS_LINUX
+    , inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    , watchDescriptor(-1)
+    , notifier(nullptr)
+#endif
+    , rescanPending(false)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(coalescingWindow);
+    QObject::connect(&flushTimer, &QTimer::timeout, this, &DirectoryWatcher::flush);
+#ifdef Q_OS_LINUX
+    if (inotifyFd >= 0) {
+        notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+        QObject::connect(notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readEvents);
+    }
+#else
+    QObject::connect(&fallbackWatcher, &QFileSystemWatcher::directoryChanged, this, [this] {
+        rescanPending = true;
+        schedule();
+    });
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+void DirectoryWatcher::setPath(const QString& newPath)
+{
+    flushTimer.stop();
+    pendingNames.clear();
+    rescanPending = false;
+#ifdef Q_OS_LINUX
+    if (inotifyFd < 0)
+        return;
+    if (watchDescriptor >= 0)
+        inotify_rm_watch(inotifyFd, watchDescriptor);
+    watchDescriptor = -1;
+    if (newPath.isEmpty())
+        return;
+    constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE |
+                              IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    watchDescriptor = inotify_add_watch(inotifyFd, QFile::encodeName(newPath).constData(), mask);
+#else
+    if (!path.isEmpty())
+        fallbackWatcher.removePath(path);
+    path = newPath;
+    if (!path.isEmpty())
+        fallbackWatcher.addPath(path);
+#endif
+}
+
+void DirectoryWatcher::schedule()
+{
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void DirectoryWatcher::flush()
+{
+    if (rescanPending || pendingNames.size() > maxPendingNames) {
+        rescanPending = false;
+        pendingNames.clear();
+        emit rescanRequired();
+        return;
+    }
+    if (pendingNames.isEmpty())
+        return;
+    const QStringList names = pendingNames.values();
+    pendingNames.clear();
+    emit changed(names);
+}
+
+#ifdef Q_OS_LINUX
+
+void DirectoryWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        const ssize_t readSize = read(inotifyFd, buffer, sizeof buffer);
+        if (readSize <= 0)
+            break;
+        for (const char* pos = buffer; pos < buffer + readSize;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(pos);
+            if (event->wd == watchDescriptor || (event->mask & IN_Q_OVERFLOW)) {
+                if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF))
+                    rescanPending = true;
+                else if (event->len > 0)
+                    pendingNames.insert(QFile::decodeName(event->name));
+            }
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    schedule();
+}
+
+#endif
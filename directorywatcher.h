@@ -0,0 +1,49 @@
+#pragma once
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#ifdef Q_OS_LINUX
+class QSocketNotifier;
+#else
+#include <QFileSystemWatcher>
+#endif
+
+
+// Watches a single directory and reports changed entry names in batches.
+// Events are collected for a short window and deduplicated, so a burst of
+// thousands of writes turns into one changed() signal. When the kernel
+// queue overflows (or the backend cannot name the changed entries) the
+// owner is asked to rescan instead.
+class DirectoryWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject* parent = nullptr);
+    ~DirectoryWatcher();
+
+    void setPath(const QString&);
+
+signals:
+    void changed(const QStringList& names);
+    void rescanRequired();
+
+private:
+    void schedule();
+    void flush();
+#ifdef Q_OS_LINUX
+    void readEvents();
+#endif
+
+private:
+#ifdef Q_OS_LINUX
+    int inotifyFd;
+    int watchDescriptor;
+    QSocketNotifier* notifier;
+#else
+    QFileSystemWatcher fallbackWatcher;
+    QString path;
+#endif
+    QSet<QString> pendingNames;
+    bool rescanPending;
+    QTimer flushTimer;
+};
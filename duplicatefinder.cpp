@@ -0,0 +1,226 @@
+#include "duplicatefinder.h"
+#include "parallel.h"
+#include "util.h"
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QFile>
+#include <algorithm>
+#include <limits>
+
+
+namespace {
+
+constexpr qint64 sampleSize = 64 * 1024;
+constexpr qint64 mapWindowSize = 64 * 1024 * 1024;
+constexpr quint32 rootDirectory = 0;
+constexpr quint32 noParent = std::numeric_limits<quint32>::max();
+
+bool addRange(QCryptographicHash& hash, QFile& file, qint64 offset, qint64 size)
+{
+    while (size > 0) {
+        const qint64 windowSize = std::min(size, mapWindowSize);
+        if (uchar* data = file.map(offset, windowSize)) {
+            hash.addData(reinterpret_cast<const char*>(data), static_cast<int>(windowSize));
+            file.unmap(data);
+        } else {
+            if (!file.seek(offset))
+                return false;
+            const QByteArray buffer = file.read(windowSize);
+            if (buffer.size() != windowSize)
+                return false;
+            hash.addData(buffer);
+        }
+        offset += windowSize;
+        size -= windowSize;
+    }
+    return true;
+}
+
+}
+
+
+DuplicateFinder::DuplicateFinder(QString rootPath)
+    : rootPath(std::move(rootPath))
+{}
+
+DuplicateFinder::Groups DuplicateFinder::find(const std::atomic_bool& cancelled)
+{
+    collect(cancelled);
+    std::sort(files.begin(), files.end(), [](const File& lhs, const File& rhs) {
+        return lhs.size < rhs.size;
+    });
+
+    Candidates candidates;
+    for (size_t begin = 0; begin < files.size();) {
+        size_t end = begin + 1;
+        while (end < files.size() && files[end].size == files[begin].size)
+            ++end;
+        if (end - begin > 1) {
+            for (size_t i = begin; i < end; ++i)
+                candidates.push_back(static_cast<quint32>(i));
+        }
+        begin = end;
+    }
+    if (cancelled)
+        return {};
+
+    std::vector<Candidates> matches;
+    Candidates unresolved;
+    for (Candidates& group : groupByDigest(candidates, hashCandidates(candidates, true, cancelled))) {
+        if (files[group.front()].size <= 2 * sampleSize)
+            matches.push_back(std::move(group));
+        else
+            unresolved.insert(unresolved.end(), group.begin(), group.end());
+    }
+    if (cancelled)
+        return {};
+
+    for (Candidates& group : groupByDigest(unresolved, hashCandidates(unresolved, false, cancelled)))
+        matches.push_back(std::move(group));
+    if (cancelled)
+        return {};
+
+    const auto getWastedSize = [this](const Candidates& group) {
+        return files[group.front()].size * static_cast<qint64>(group.size() - 1);
+    };
+    std::sort(matches.begin(), matches.end(), [&](const Candidates& lhs, const Candidates& rhs) {
+        return getWastedSize(lhs) > getWastedSize(rhs);
+    });
+
+    Groups result;
+    result.reserve(matches.size());
+    for (const Candidates& group : matches) {
+        QStringList paths;
+        paths.reserve(static_cast<int>(group.size()));
+        for (quint32 i : group)
+            paths.push_back(getFilePath(files[i]));
+        result.push_back({files[group.front()].size, std::move(paths)});
+    }
+    return result;
+}
+
+size_t DuplicateFinder::getScannedFileCount() const
+{
+    return files.size();
+}
+
+void DuplicateFinder::collect(const std::atomic_bool& cancelled)
+{
+    directories.push_back({noParent, 0, 0});
+    std::vector<quint32> pending{rootDirectory};
+    const auto filters = QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks;
+
+    while (!pending.empty() && !cancelled) {
+        const quint32 directory = pending.back();
+        pending.pop_back();
+
+        QDirIterator iter(getDirectoryPath(directory), filters);
+        while (iter.hasNext()) {
+            iter.next();
+            const QFileInfo& info = iter.fileInfo();
+            if (info.isDir()) {
+                const auto [offset, length] = addName(iter.fileName());
+                pending.push_back(static_cast<quint32>(directories.size()));
+                directories.push_back({directory, offset, length});
+            } else if (info.isFile() && info.size() > 0) {
+                const auto [offset, length] = addName(iter.fileName());
+                files.push_back({info.size(), directory, offset, length});
+            }
+        }
+    }
+}
+
+DuplicateFinder::Digests DuplicateFinder::hashCandidates(const Candidates& candidates, bool sampleOnly,
+                                                         const std::atomic_bool& cancelled) const
+{
+    Digests result(candidates.size());
+    parallelFor(candidates.size(), [&](size_t i) {
+        if (!cancelled)
+            result[i] = hashFile(files[candidates[i]], sampleOnly);
+    });
+    return result;
+}
+
+std::vector<DuplicateFinder::Candidates> DuplicateFinder::groupByDigest(const Candidates& candidates,
+                                                                        const Digests& digests) const
+{
+    std::vector<size_t> order;
+    order.reserve(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (!digests[i].isEmpty())
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        const qint64 lhsSize = files[candidates[lhs]].size;
+        const qint64 rhsSize = files[candidates[rhs]].size;
+        if (lhsSize != rhsSize)
+            return lhsSize < rhsSize;
+        return digests[lhs] < digests[rhs];
+    });
+
+    std::vector<Candidates> result;
+    for (size_t begin = 0; begin < order.size();) {
+        const size_t first = order[begin];
+        size_t end = begin + 1;
+        while (end < order.size() &&
+               files[candidates[order[end]]].size == files[candidates[first]].size &&
+               digests[order[end]] == digests[first])
+            ++end;
+        if (end - begin > 1) {
+            Candidates group;
+            group.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i)
+                group.push_back(candidates[order[i]]);
+            result.push_back(std::move(group));
+        }
+        begin = end;
+    }
+    return result;
+}
+
+QByteArray DuplicateFinder::hashFile(const File& entry, bool sampleOnly) const
+{
+    QFile file(getFilePath(entry));
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const bool succeeded = sampleOnly && entry.size > 2 * sampleSize
+        ? addRange(hash, file, 0, sampleSize) && addRange(hash, file, entry.size - sampleSize, sampleSize)
+        : addRange(hash, file, 0, entry.size);
+    if (!succeeded)
+        return {};
+    return hash.result();
+}
+
+std::pair<quint32, quint32> DuplicateFinder::addName(const QString& name)
+{
+    const QByteArray utf8 = name.toUtf8();
+    const auto offset = static_cast<quint32>(names.size());
+    names.append(utf8);
+    return {offset, static_cast<quint32>(utf8.size())};
+}
+
+QString DuplicateFinder::getName(quint32 offset, quint32 length) const
+{
+    return QString::fromUtf8(names.constData() + offset, static_cast<int>(length));
+}
+
+QString DuplicateFinder::getDirectoryPath(quint32 directory) const
+{
+    std::vector<quint32> chain;
+    for (; directory != rootDirectory; directory = directories[directory].parent)
+        chain.push_back(directory);
+
+    QString result = rootPath;
+    for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter) {
+        const Directory& entry = directories[*iter];
+        result = result / getName(entry.nameOffset, entry.nameLength);
+    }
+    return result;
+}
+
+QString DuplicateFinder::getFilePath(const File& entry) const
+{
+    return getDirectoryPath(entry.directory) / getName(entry.nameOffset, entry.nameLength);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <atomic>
+#include <vector>
+
+
+// Finds files with identical contents under a directory.
+// Files are grouped by size first, then by a hash of their first and last
+// sample blocks, and only files still colliding after that get a full
+// content hash. Names are kept in a single UTF-8 arena with parent links,
+// so full paths are only materialized for the reported duplicates.
+class DuplicateFinder {
+public:
+    struct Group {
+        qint64 fileSize;
+        QStringList paths;
+    };
+    using Groups = std::vector<Group>;
+
+    explicit DuplicateFinder(QString rootPath);
+    Groups find(const std::atomic_bool& cancelled);
+    size_t getScannedFileCount() const;
+
+private:
+    struct Directory {
+        quint32 parent;
+        quint32 nameOffset;
+        quint32 nameLength;
+    };
+
+    struct File {
+        qint64 size;
+        quint32 directory;
+        quint32 nameOffset;
+        quint32 nameLength;
+    };
+
+    using Candidates = std::vector<quint32>;
+    using Digests = std::vector<QByteArray>;
+
+    void collect(const std::atomic_bool& cancelled);
+    Digests hashCandidates(const Candidates&, bool sampleOnly, const std::atomic_bool& cancelled) const;
+    std::vector<Candidates> groupByDigest(const Candidates&, const Digests&) const;
+    QByteArray hashFile(const File&, bool sampleOnly) const;
+
+    std::pair<quint32, quint32> addName(const QString&);
+    QString getName(quint32 offset, quint32 length) const;
+    QString getDirectoryPath(quint32 directory) const;
+    QString getFilePath(const File&) const;
+
+private:
+    QString rootPath;
+    QByteArray names;
+    std::vector<Directory> directories;
+    std::vector<File> files;
+};
@@ -0,0 +1,170 @@
+#include "eventtracer.h"
+#include <QMutex>
+#include <QSaveFile>
+#include <vector>
+
+
+namespace {
+
+constexpr size_t maxEventCount = 1 << 22;
+
+enum class EPhase : char {
+    COMPLETE = 'X',
+    ASYNC_BEGIN = 'b',
+    ASYNC_END = 'e',
+};
+
+struct Event {
+    const char* name;
+    qint64 timestamp;
+    qint64 duration;
+    quint64 id;
+    int key;
+    int thread;
+    EPhase phase;
+};
+
+QMutex mutex;
+QElapsedTimer clock;
+QString outputPath;
+std::vector<Event> events;
+std::vector<quint64> openInputs;
+quint64 nextInputId = 1;
+size_t droppedCount = 0;
+std::atomic_int nextThread{1};
+
+
+int getThread()
+{
+    thread_local const int thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+    return thread;
+}
+
+void append(const Event& event)
+{
+    if (events.size() >= maxEventCount) {
+        ++droppedCount;
+        return;
+    }
+    events.push_back(event);
+}
+
+QByteArray formatTime(qint64 nanoseconds)
+{
+    return QByteArray::number(nanoseconds / 1e3, 'f', 3);
+}
+
+}
+
+
+std::atomic_bool EventTracer::enabled{false};
+
+
+bool EventTracer::start(const QString& path)
+{
+    QMutexLocker locker(&mutex);
+    if (enabled)
+        return false;
+    outputPath = path;
+    events.clear();
+    openInputs.clear();
+    droppedCount = 0;
+    if (!clock.isValid())
+        clock.start();
+    enabled = true;
+    return true;
+}
+
+bool EventTracer::stop(QString& error)
+{
+    QMutexLocker locker(&mutex);
+    if (!enabled) {
+        error = "Tracing is not running";
+        return false;
+    }
+    enabled = false;
+
+    QSaveFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const Event& event : events) {
+        QByteArray line = first ? "{" : ",\n{";
+        first = false;
+        line += "\"name\":\"";
+        line += event.name;
+        line += "\",\"ph\":\"";
+        line += static_cast<char>(event.phase);
+        line += "\",\"ts\":" + formatTime(event.timestamp);
+        line += ",\"pid\":1,\"tid\":" + QByteArray::number(event.thread);
+        if (event.phase == EPhase::COMPLETE)
+            line += ",\"dur\":" + formatTime(event.duration);
+        else
+            line += ",\"cat\":\"input\",\"id\":" + QByteArray::number(event.id);
+        if (event.phase == EPhase::ASYNC_BEGIN)
+            line += ",\"args\":{\"key\":" + QByteArray::number(event.key) + "}";
+        line += "}";
+        file.write(line);
+    }
+    file.write("\n]}\n");
+    if (!file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    if (droppedCount > 0)
+        qWarning("Trace buffer was full, %zu events dropped", droppedCount);
+    events.clear();
+    events.shrink_to_fit();
+    return true;
+}
+
+void EventTracer::beginInput(int key)
+{
+    if (!isEnabled())
+        return;
+    const qint64 timestamp = now();
+    QMutexLocker locker(&mutex);
+    const quint64 id = nextInputId++;
+    openInputs.push_back(id);
+    append({"input", timestamp, 0, id, key, getThread(), EPhase::ASYNC_BEGIN});
+}
+
+void EventTracer::endInputs()
+{
+    if (!isEnabled())
+        return;
+    const qint64 timestamp = now();
+    QMutexLocker locker(&mutex);
+    for (quint64 id : openInputs)
+        append({"input", timestamp, 0, id, 0, getThread(), EPhase::ASYNC_END});
+    openInputs.clear();
+}
+
+void EventTracer::complete(const char* name, qint64 startTime, qint64 duration)
+{
+    if (!isEnabled())
+        return;
+    QMutexLocker locker(&mutex);
+    append({name, startTime, duration, 0, 0, getThread(), EPhase::COMPLETE});
+}
+
+qint64 EventTracer::now()
+{
+    return clock.isValid() ? clock.nsecsElapsed() : 0;
+}
+
+
+ScopedTrace::ScopedTrace(const char* newName)
+    : name(newName)
+    , startTime(EventTracer::isEnabled() ? EventTracer::now() : -1)
+{
+}
+
+ScopedTrace::~ScopedTrace()
+{
+    if (startTime >= 0)
+        EventTracer::complete(name, startTime, EventTracer::now() - startTime);
+}
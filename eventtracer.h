@@ -0,0 +1,36 @@
+#pragma once
+#include <QString>
+#include <QElapsedTimer>
+#include <atomic>
+
+
+// Opt-in recorder of Chrome trace-event JSON (load it in chrome://tracing
+// or Perfetto). Key presses open an "input" span that stays open through
+// dispatch, model updates and selection changes, and is closed by the next
+// completed paint of the file viewer, so every hitch shows up as one span
+// with the work that caused it nested underneath.
+class EventTracer {
+public:
+    static bool start(const QString& path);
+    static bool stop(QString& error);
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void beginInput(int key);
+    static void endInputs();
+    static void complete(const char* name, qint64 startTime, qint64 duration);
+    static qint64 now();
+
+private:
+    static std::atomic_bool enabled;
+};
+
+
+// Records a complete event covering its own lifetime when tracing is on.
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char* name);
+    ~ScopedTrace();
+
+private:
+    const char* name;
+    qint64 startTime;
+};
@@ -0,0 +1,88 @@
+#include "fileitemdelegate.h"
+#include <QIcon>
+#include <QDateTime>
+#include <QLocale>
+#include <QPainter>
+#include <QStyle>
+
+
+constexpr int horizontalPadding = 4;
+constexpr int iconSpacing = 4;
+constexpr int maxLayoutCount = 8192;
+
+
+FileItemDelegate::FileItemDelegate(QObject* parent)
+    : QAbstractItemDelegate(parent)
+{
+}
+
+void FileItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    const bool selected = option.state & QStyle::State_Selected;
+    const QPalette::ColorGroup colorGroup = option.state & QStyle::State_Active ? QPalette::Active : QPalette::Inactive;
+    if (selected)
+        painter->fillRect(option.rect, option.palette.brush(colorGroup, QPalette::Highlight));
+
+    QRect contentRect = option.rect.adjusted(horizontalPadding, 0, -horizontalPadding, 0);
+    const QVariant decoration = index.data(Qt::DecorationRole);
+    if (decoration.canConvert<QIcon>()) {
+        const int iconSize = option.decorationSize.height();
+        const QRect iconRect(contentRect.left(), contentRect.top() + (contentRect.height() - iconSize) / 2,
+                             iconSize, iconSize);
+        qvariant_cast<QIcon>(decoration).paint(painter, iconRect, Qt::AlignCenter,
+                                               selected ? QIcon::Selected : QIcon::Normal);
+        contentRect.setLeft(iconRect.right() + 1 + iconSpacing);
+    }
+
+    const QString text = getDisplayText(index.data(Qt::DisplayRole));
+    if (text.isEmpty() || contentRect.width() <= 0)
+        return;
+    const QStaticText& layout = getLayout(text, contentRect.width(), option);
+    const QSizeF layoutSize = layout.size();
+    const QVariant alignmentValue = index.data(Qt::TextAlignmentRole);
+    const Qt::Alignment alignment = alignmentValue.isValid()
+        ? Qt::Alignment(alignmentValue.toInt())
+        : Qt::Alignment(Qt::AlignLeft | Qt::AlignVCenter);
+    const qreal x = alignment & Qt::AlignRight
+        ? contentRect.right() + 1 - layoutSize.width()
+        : contentRect.left();
+    const qreal y = contentRect.top() + (contentRect.height() - layoutSize.height()) / 2;
+
+    painter->setFont(option.font);
+    painter->setPen(option.palette.color(colorGroup, selected ? QPalette::HighlightedText : QPalette::Text));
+    painter->drawStaticText(QPointF(x, y), layout);
+}
+
+QSize FileItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    const QString text = getDisplayText(index.data(Qt::DisplayRole));
+    int width = option.fontMetrics.horizontalAdvance(text) + 2 * horizontalPadding;
+    if (index.data(Qt::DecorationRole).isValid())
+        width += option.decorationSize.width() + iconSpacing;
+    const int height = std::max(option.fontMetrics.height(), option.decorationSize.height());
+    return {width, height};
+}
+
+const QStaticText& FileItemDelegate::getLayout(const QString& text, int width, const QStyleOptionViewItem& option) const
+{
+    if (option.font != layoutFont || layouts.size() > maxLayoutCount) {
+        layouts.clear();
+        layoutFont = option.font;
+    }
+    const LayoutKey key{text, width};
+    auto layout = layouts.find(key);
+    if (layout == layouts.end()) {
+        QStaticText staticText(option.fontMetrics.elidedText(text, Qt::ElideRight, width));
+        staticText.setTextFormat(Qt::PlainText);
+        staticText.prepare(QTransform(), option.font);
+        layout = layouts.insert(key, std::move(staticText));
+    }
+    return *layout;
+}
+
+QString FileItemDelegate::getDisplayText(const QVariant& value)
+{
+    if (value.type() == QVariant::DateTime)
+        return QLocale().toString(value.toDateTime(), QLocale::ShortFormat);
+    return value.toString();
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <QAbstractItemDelegate>
+#include <QFont>
+#include <QHash>
+#include <QStaticText>
+
+
+// Paints the file table without the style engine: backgrounds, icons and
+// text are drawn straight from the palette, and elided text is laid out
+// once per (text, width) and then redrawn from the cached QStaticText.
+// No focus rectangle is drawn; the selected row is the cursor.
+class FileItemDelegate : public QAbstractItemDelegate {
+    Q_OBJECT
+
+public:
+    explicit FileItemDelegate(QObject* parent = nullptr);
+
+    void paint(QPainter*, const QStyleOptionViewItem&, const QModelIndex&) const override;
+    QSize sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const override;
+
+private:
+    struct LayoutKey {
+        QString text;
+        int width;
+
+        bool operator==(const LayoutKey& rhs) const { return width == rhs.width && text == rhs.text; }
+    };
+    friend uint qHash(const LayoutKey& key, uint seed) { return qHash(key.text, seed) ^ static_cast<uint>(key.width); }
+
+    const QStaticText& getLayout(const QString& text, int width, const QStyleOptionViewItem&) const;
+    static QString getDisplayText(const QVariant&);
+
+private:
+    mutable QHash<LayoutKey, QStaticText> layouts;
+    mutable QFont layoutFont;
+};
@@ -0,0 +1,83 @@
+#include "filelistmodel.h"
+#include <QDir>
+#include <QLocale>
+#include <algorithm>
+
+
+enum EFileListColumn {
+    NAME,
+    SIZE,
+    GROUP,
+
+    COLUMN_COUNT,
+};
+
+
+FileListModel::FileListModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{}
+
+void FileListModel::setEntries(QString newRootPath, Entries newEntries)
+{
+    beginResetModel();
+    rootPath = std::move(newRootPath);
+    entries = std::move(newEntries);
+    endResetModel();
+}
+
+void FileListModel::removePaths(const QStringList& paths)
+{
+    for (const QString& path : paths) {
+        const auto iter = std::find_if(entries.begin(), entries.end(), [&](const FileListEntry& entry) {
+            return entry.path == path;
+        });
+        if (iter == entries.end())
+            continue;
+        const int row = static_cast<int>(iter - entries.begin());
+        beginRemoveRows({}, row, row);
+        entries.erase(iter);
+        endRemoveRows();
+    }
+}
+
+const QString& FileListModel::getRootPath() const
+{
+    return rootPath;
+}
+
+QString FileListModel::filePath(int row) const
+{
+    if (row < 0 || row >= rowCount())
+        return {};
+    return entries[static_cast<size_t>(row)].path;
+}
+
+int FileListModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return static_cast<int>(entries.size());
+}
+
+int FileListModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return COLUMN_COUNT;
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || !index.isValid())
+        return {};
+    const FileListEntry& entry = entries[static_cast<size_t>(index.row())];
+    switch (index.column()) {
+    case NAME:
+        return QDir(rootPath).relativeFilePath(entry.path);
+    case SIZE:
+        return QLocale().formattedDataSize(entry.size);
+    case GROUP:
+        return entry.group;
+    }
+    return {};
+}
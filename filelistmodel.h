@@ -0,0 +1,36 @@
+#pragma once
+#include <QAbstractTableModel>
+#include <QStringList>
+#include <vector>
+
+
+struct FileListEntry {
+    QString path;
+    qint64 size;
+    int group;
+};
+
+
+// Flat listing of arbitrary files (search results, duplicates) that can be
+// shown in the file viewer in place of a directory.
+class FileListModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    using Entries = std::vector<FileListEntry>;
+
+    explicit FileListModel(QObject* parent = nullptr);
+
+    void setEntries(QString rootPath, Entries);
+    void removePaths(const QStringList&);
+    const QString& getRootPath() const;
+    QString filePath(int row) const;
+
+    int rowCount(const QModelIndex& parent = {}) const override;
+    int columnCount(const QModelIndex& parent = {}) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+
+private:
+    QString rootPath;
+    Entries entries;
+};
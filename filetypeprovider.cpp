@@ -0,0 +1,172 @@
+#include "filetypeprovider.h"
+#include <QApplication>
+#include <QFileIconProvider>
+#include <QMimeDatabase>
+#include <QStyle>
+#include <algorithm>
+#include "util.h"
+
+
+constexpr int maxSniffedTypeCount = 100000;
+
+
+namespace {
+
+struct ExtensionType {
+    const char* extension;
+    EFileType type;
+};
+
+// Sorted by extension. FILE marks extensions used for all kinds of content,
+// which are sniffed like names without one.
+const ExtensionType extensionTypes[] = {
+    {"7z", EFileType::ARCHIVE}, {"appimage", EFileType::EXECUTABLE}, {"avi", EFileType::VIDEO},
+    {"bat", EFileType::EXECUTABLE}, {"bin", EFileType::FILE}, {"bmp", EFileType::IMAGE},
+    {"bz2", EFileType::ARCHIVE}, {"c", EFileType::SOURCE}, {"cc", EFileType::SOURCE}, {"cfg", EFileType::TEXT},
+    {"cmake", EFileType::SOURCE}, {"cpp", EFileType::SOURCE}, {"cs", EFileType::SOURCE},
+    {"css", EFileType::SOURCE}, {"csv", EFileType::TEXT}, {"cxx", EFileType::SOURCE}, {"dat", EFileType::FILE},
+    {"dll", EFileType::EXECUTABLE}, {"doc", EFileType::DOCUMENT}, {"docx", EFileType::DOCUMENT},
+    {"exe", EFileType::EXECUTABLE}, {"flac", EFileType::AUDIO}, {"gif", EFileType::IMAGE},
+    {"go", EFileType::SOURCE}, {"gz", EFileType::ARCHIVE}, {"h", EFileType::SOURCE}, {"hh", EFileType::SOURCE},
+    {"hpp", EFileType::SOURCE}, {"html", EFileType::SOURCE}, {"ico", EFileType::IMAGE},
+    {"ini", EFileType::TEXT}, {"java", EFileType::SOURCE}, {"jpeg", EFileType::IMAGE},
+    {"jpg", EFileType::IMAGE}, {"js", EFileType::SOURCE}, {"json", EFileType::TEXT}, {"log", EFileType::TEXT},
+    {"m4a", EFileType::AUDIO}, {"md", EFileType::TEXT}, {"mkv", EFileType::VIDEO}, {"mov", EFileType::VIDEO},
+    {"mp3", EFileType::AUDIO}, {"mp4", EFileType::VIDEO}, {"msi", EFileType::EXECUTABLE},
+    {"ods", EFileType::DOCUMENT}, {"odt", EFileType::DOCUMENT}, {"ogg", EFileType::AUDIO},
+    {"opus", EFileType::AUDIO}, {"out", EFileType::FILE}, {"pdf", EFileType::DOCUMENT},
+    {"png", EFileType::IMAGE}, {"ppt", EFileType::DOCUMENT}, {"pptx", EFileType::DOCUMENT},
+    {"py", EFileType::SOURCE}, {"rar", EFileType::ARCHIVE}, {"rs", EFileType::SOURCE},
+    {"sh", EFileType::SOURCE}, {"so", EFileType::EXECUTABLE}, {"svg", EFileType::IMAGE},
+    {"tar", EFileType::ARCHIVE}, {"tgz", EFileType::ARCHIVE}, {"tif", EFileType::IMAGE},
+    {"tiff", EFileType::IMAGE}, {"tmp", EFileType::FILE}, {"toml", EFileType::TEXT}, {"ts", EFileType::SOURCE},
+    {"txt", EFileType::TEXT}, {"ui", EFileType::SOURCE}, {"wav", EFileType::AUDIO}, {"webm", EFileType::VIDEO},
+    {"webp", EFileType::IMAGE}, {"wmv", EFileType::VIDEO}, {"xls", EFileType::DOCUMENT},
+    {"xlsx", EFileType::DOCUMENT}, {"xml", EFileType::TEXT}, {"xz", EFileType::ARCHIVE},
+    {"yaml", EFileType::TEXT}, {"yml", EFileType::TEXT}, {"zip", EFileType::ARCHIVE},
+    {"zst", EFileType::ARCHIVE},
+};
+
+const char* const themeIconNames[] = {
+    "folder",
+    "text-x-generic",
+    "text-x-generic",
+    "text-x-script",
+    "image-x-generic",
+    "audio-x-generic",
+    "video-x-generic",
+    "package-x-generic",
+    "x-office-document",
+    "application-x-executable",
+};
+static_assert(std::size(themeIconNames) == static_cast<size_t>(EFileType::COUNT));
+
+}
+
+
+FileTypeProvider::FileTypeProvider(QObject* parent)
+    : QObject(parent)
+    , sniffedTypes(maxSniffedTypeCount)
+    , sniffing(false)
+{
+    sniffRunner.setMaxThreadCount(1);
+}
+
+EFileType FileTypeProvider::getType(const QString& dirPath, const QString& name, bool isDir)
+{
+    if (isDir)
+        return EFileType::DIRECTORY;
+    if (const std::optional<EFileType> type = findTypeByExtension(name))
+        return *type;
+
+    const NameKey key(dirPath, name);
+    if (const EFileType* sniffed = sniffedTypes.object(key))
+        return *sniffed;
+    sniffedTypes.insert(key, new EFileType(EFileType::FILE));
+    pendingNames.push_back(key);
+    if (!sniffing)
+        sniffPending();
+    return EFileType::FILE;
+}
+
+const QIcon& FileTypeProvider::getIcon(EFileType type)
+{
+    QIcon& icon = icons[static_cast<size_t>(type)];
+    if (icon.isNull()) {
+        static const QFileIconProvider iconProvider;
+        const QIcon fallback = iconProvider.icon(type == EFileType::DIRECTORY ? QFileIconProvider::Folder
+                                                                               : QFileIconProvider::File);
+        const QIcon themed = QIcon::fromTheme(themeIconNames[static_cast<size_t>(type)], fallback);
+        const int size = QApplication::style()->pixelMetric(QStyle::PM_SmallIconSize);
+        icon = QIcon(themed.pixmap(size, size));
+    }
+    return icon;
+}
+
+void FileTypeProvider::sniffPending()
+{
+    if (pendingNames.empty())
+        return;
+    sniffing = true;
+    sniffRunner.run([names = std::move(pendingNames)](const std::atomic_bool& cancelled) {
+        std::vector<std::pair<NameKey, EFileType>> types;
+        for (const NameKey& name : names) {
+            if (cancelled)
+                break;
+            types.emplace_back(name, sniffType(name.first / name.second));
+        }
+        return types;
+    }, [this](std::vector<std::pair<NameKey, EFileType>> types) {
+        sniffing = false;
+        bool changed = false;
+        for (const auto& [name, type] : types) {
+            sniffedTypes.insert(name, new EFileType(type));
+            changed = changed || type != EFileType::FILE;
+        }
+        if (changed)
+            emit typesResolved();
+        sniffPending();
+    });
+    pendingNames.clear();
+}
+
+std::optional<EFileType> FileTypeProvider::findTypeByExtension(QStringView name)
+{
+    const qsizetype dot = name.lastIndexOf('.');
+    if (dot <= 0 || dot == name.size() - 1)
+        return std::nullopt;
+    const QStringView extension = name.mid(dot + 1);
+    const auto compare = [](const ExtensionType& extensionType, QStringView extension) {
+        return QLatin1String(extensionType.extension).compare(extension, Qt::CaseInsensitive) < 0;
+    };
+    const auto found = std::lower_bound(std::begin(extensionTypes), std::end(extensionTypes), extension, compare);
+    if (found == std::end(extensionTypes) || QLatin1String(found->extension).compare(extension, Qt::CaseInsensitive) != 0)
+        return EFileType::FILE;
+    if (found->type == EFileType::FILE)
+        return std::nullopt;
+    return found->type;
+}
+
+EFileType FileTypeProvider::sniffType(const QString& path)
+{
+    static const QMimeDatabase mimeDatabase;
+    const QMimeType mimeType = mimeDatabase.mimeTypeForFile(path, QMimeDatabase::MatchContent);
+    const QString mimeName = mimeType.name();
+    if (mimeName.startsWith("image/"))
+        return EFileType::IMAGE;
+    if (mimeName.startsWith("audio/"))
+        return EFileType::AUDIO;
+    if (mimeName.startsWith("video/"))
+        return EFileType::VIDEO;
+    if (mimeType.inherits("application/x-executable") || mimeType.inherits("application/x-sharedlib"))
+        return EFileType::EXECUTABLE;
+    if (mimeType.inherits("application/x-shellscript"))
+        return EFileType::SOURCE;
+    if (mimeType.inherits("text/plain"))
+        return EFileType::TEXT;
+    if (mimeName == "application/zip" || mimeName == "application/x-tar" || mimeName.contains("compressed"))
+        return EFileType::ARCHIVE;
+    if (mimeName == "application/pdf")
+        return EFileType::DOCUMENT;
+    return EFileType::FILE;
+}
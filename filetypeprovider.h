@@ -0,0 +1,64 @@
+#pragma once
+#include <QObject>
+#include <QCache>
+#include <QIcon>
+#include <QPair>
+#include <QString>
+#include <array>
+#include <optional>
+#include <vector>
+#include "taskrunner.h"
+
+
+enum class EFileType {
+    DIRECTORY,
+    FILE,
+    TEXT,
+    SOURCE,
+    IMAGE,
+    AUDIO,
+    VIDEO,
+    ARCHIVE,
+    DOCUMENT,
+    EXECUTABLE,
+
+    COUNT,
+};
+
+
+// Classifies entries by extension through a static table and hands out one
+// icon per type, rendered to a pixmap once and shared by every row. The
+// lookup allocates nothing, as it runs for every painted row. Only files
+// without an extension or with an ambiguous one (.bin, .dat) have their
+// content sniffed, on a worker thread; until the result arrives they show
+// the generic file icon, and typesResolved() tells the view to repaint.
+// Sniffed types are kept for the most recently used names, keyed by the
+// shared directory and name strings. Nothing here touches the disk on the
+// GUI thread.
+class FileTypeProvider : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileTypeProvider(QObject* parent = nullptr);
+
+    EFileType getType(const QString& dirPath, const QString& name, bool isDir);
+    const QIcon& getIcon(EFileType);
+
+signals:
+    void typesResolved();
+
+private:
+    using NameKey = QPair<QString, QString>;
+
+    void sniffPending();
+    // Empty when the name says too little and the content has to be sniffed.
+    static std::optional<EFileType> findTypeByExtension(QStringView name);
+    static EFileType sniffType(const QString& path);
+
+private:
+    std::array<QIcon, static_cast<size_t>(EFileType::COUNT)> icons;
+    QCache<NameKey, EFileType> sniffedTypes;
+    std::vector<NameKey> pendingNames;
+    bool sniffing;
+    TaskRunner sniffRunner;
+};
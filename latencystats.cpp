@@ -0,0 +1,235 @@
+#include "latencystats.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QtAlgorithms>
+#include <cmath>
+#include <deque>
+#include <limits>
+
+
+namespace {
+
+struct NamedHistogram {
+    QString name;
+    LatencyHistogram histogram;
+};
+
+struct NamedCounter {
+    QString name;
+    std::atomic<quint64> value{0};
+};
+
+QMutex registryMutex;
+std::deque<NamedHistogram> histograms;
+std::deque<NamedCounter> counters;
+
+
+QString formatDuration(qint64 nanoseconds)
+{
+    if (nanoseconds < 1000)
+        return QString("%1 ns").arg(nanoseconds);
+    if (nanoseconds < 1000 * 1000)
+        return QString("%1 us").arg(nanoseconds / 1e3, 0, 'f', 1);
+    if (nanoseconds < 1000 * 1000 * 1000)
+        return QString("%1 ms").arg(nanoseconds / 1e6, 0, 'f', 1);
+    return QString("%1 s").arg(nanoseconds / 1e9, 0, 'f', 2);
+}
+
+}
+
+
+LatencyHistogram::LatencyHistogram()
+    : count(0)
+    , max(0)
+{
+    for (std::atomic<quint64>& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(qint64 nanoseconds)
+{
+    const quint64 value = static_cast<quint64>(std::max<qint64>(0, nanoseconds));
+    buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    qint64 currentMax = max.load(std::memory_order_relaxed);
+    while (nanoseconds > currentMax && !max.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::atomic<quint64>& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::getCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::getMax() const
+{
+    return max.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::getPercentile(double percentile) const
+{
+    // The buckets are read one by one while other threads may still record,
+    // so the total is taken from them rather than from count.
+    quint64 total = 0;
+    for (const std::atomic<quint64>& bucket : buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    const quint64 target = std::max<quint64>(1, static_cast<quint64>(std::ceil(percentile / 100 * total)));
+    quint64 seen = 0;
+    for (int i = 0; i < bucketCount; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+            return std::min(getBucketUpperBound(i), getMax());
+    }
+    return getMax();
+}
+
+std::vector<std::pair<qint64, quint64>> LatencyHistogram::getBuckets() const
+{
+    std::vector<std::pair<qint64, quint64>> result;
+    for (int i = 0; i < bucketCount; ++i) {
+        if (const quint64 samples = buckets[i].load(std::memory_order_relaxed))
+            result.emplace_back(getBucketUpperBound(i), samples);
+    }
+    return result;
+}
+
+int LatencyHistogram::getBucketIndex(quint64 value)
+{
+    if (value < subBucketCount)
+        return static_cast<int>(value);
+    const int highestBit = 63 - qCountLeadingZeroBits(value);
+    const int shift = highestBit - subBucketBits;
+    const int subBucket = static_cast<int>(value >> shift) - subBucketCount;
+    return (shift + 1) * subBucketCount + subBucket;
+}
+
+qint64 LatencyHistogram::getBucketUpperBound(int index)
+{
+    if (index < subBucketCount)
+        return index;
+    const int shift = index / subBucketCount - 1;
+    const quint64 top = subBucketCount + index % subBucketCount + 1;
+    if (shift + subBucketBits + 1 >= 63)
+        return std::numeric_limits<qint64>::max();
+    return static_cast<qint64>((top << shift) - 1);
+}
+
+
+LatencyHistogram& LatencyStats::getHistogram(const QString& name)
+{
+    QMutexLocker locker(&registryMutex);
+    for (NamedHistogram& named : histograms) {
+        if (named.name == name)
+            return named.histogram;
+    }
+    histograms.emplace_back();
+    histograms.back().name = name;
+    return histograms.back().histogram;
+}
+
+std::atomic<quint64>& LatencyStats::getCounter(const QString& name)
+{
+    QMutexLocker locker(&registryMutex);
+    for (NamedCounter& named : counters) {
+        if (named.name == name)
+            return named.value;
+    }
+    counters.emplace_back();
+    counters.back().name = name;
+    return counters.back().value;
+}
+
+QStringList LatencyStats::report()
+{
+    QMutexLocker locker(&registryMutex);
+    QStringList lines;
+    for (const NamedHistogram& named : histograms) {
+        const LatencyHistogram& histogram = named.histogram;
+        if (histogram.getCount() == 0)
+            continue;
+        lines.push_back(QString("%1: %2 calls, p50 %3, p99 %4, max %5")
+            .arg(named.name)
+            .arg(histogram.getCount())
+            .arg(formatDuration(histogram.getPercentile(50)))
+            .arg(formatDuration(histogram.getPercentile(99)))
+            .arg(formatDuration(histogram.getMax())));
+    }
+    for (const NamedCounter& named : counters)
+        lines.push_back(QString("%1: %2").arg(named.name).arg(named.value.load(std::memory_order_relaxed)));
+    return lines;
+}
+
+bool LatencyStats::dump(const QString& path, QString& error)
+{
+    QJsonArray histogramArray;
+    QJsonObject counterObject;
+    {
+        QMutexLocker locker(&registryMutex);
+        for (const NamedHistogram& named : histograms) {
+            const LatencyHistogram& histogram = named.histogram;
+            QJsonArray bucketArray;
+            for (const auto& [upperBound, samples] : histogram.getBuckets())
+                bucketArray.push_back(QJsonArray{upperBound, static_cast<qint64>(samples)});
+            histogramArray.push_back(QJsonObject{
+                {"name", named.name},
+                {"count", static_cast<qint64>(histogram.getCount())},
+                {"p50", histogram.getPercentile(50)},
+                {"p90", histogram.getPercentile(90)},
+                {"p99", histogram.getPercentile(99)},
+                {"p999", histogram.getPercentile(99.9)},
+                {"max", histogram.getMax()},
+                {"buckets", bucketArray},
+            });
+        }
+        for (const NamedCounter& named : counters)
+            counterObject.insert(named.name, static_cast<qint64>(named.value.load(std::memory_order_relaxed)));
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    const QJsonObject root{{"unit", "ns"}, {"histograms", histogramArray}, {"counters", counterObject}};
+    file.write(QJsonDocument(root).toJson());
+    if (!file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void LatencyStats::reset()
+{
+    QMutexLocker locker(&registryMutex);
+    for (NamedHistogram& named : histograms)
+        named.histogram.reset();
+    for (NamedCounter& named : counters)
+        named.value.store(0, std::memory_order_relaxed);
+}
+
+
+ScopedLatency::ScopedLatency(LatencyHistogram& newHistogram)
+    : histogram(&newHistogram)
+{
+    timer.start();
+}
+
+ScopedLatency::~ScopedLatency()
+{
+    histogram->record(timer.nsecsElapsed());
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QStringList>
+#include <array>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+
+// Log-linear latency histogram in the HDR style: every power of two is split
+// into 8 sub-buckets, so a reported value is within 12.5% of the recorded
+// one. Recording is a few relaxed atomic operations and never blocks.
+class LatencyHistogram {
+public:
+    static constexpr int subBucketBits = 3;
+    static constexpr int subBucketCount = 1 << subBucketBits;
+    static constexpr int bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+    LatencyHistogram();
+
+    void record(qint64 nanoseconds);
+    void reset();
+    quint64 getCount() const;
+    qint64 getMax() const;
+    qint64 getPercentile(double percentile) const;
+    std::vector<std::pair<qint64, quint64>> getBuckets() const;
+
+    static int getBucketIndex(quint64 value);
+    static qint64 getBucketUpperBound(int index);
+
+private:
+    std::array<std::atomic<quint64>, bucketCount> buckets;
+    std::atomic<quint64> count;
+    std::atomic<qint64> max;
+};
+
+
+// Process-wide registry of named histograms and counters. Lookups by name
+// take a lock, so call sites look them up once and keep the reference;
+// recording into them afterwards is lock-free.
+class LatencyStats {
+public:
+    static LatencyHistogram& getHistogram(const QString& name);
+    static std::atomic<quint64>& getCounter(const QString& name);
+    static QStringList report();
+    static bool dump(const QString& path, QString& error);
+    static void reset();
+};
+
+
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram&);
+    ~ScopedLatency();
+
+private:
+    LatencyHistogram* histogram;
+    QElapsedTimer timer;
+};
@@ -0,0 +1,177 @@
+#include "lineindex.h"
+#include <QFileDevice>
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <iterator>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+constexpr qint64 scanChunkSize = 16 * 1024 * 1024;
+
+
+namespace {
+
+#ifdef __SSE2__
+// Bit i is set when data[i] is a newline.
+quint64 findNewlines64(const char* data)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    quint64 mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i));
+        mask |= static_cast<quint64>(static_cast<quint16>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << (16 * i);
+    }
+    return mask;
+}
+#endif
+
+
+// Counts newlines and records the start of every checkpointInterval-th
+// line, and the count at every offsetCheckpointInterval-th byte. 64-byte
+// blocks are classified with SSE2 and only the rare block holding a
+// checkpoint is walked byte by byte; memchr (itself vectorized in common C
+// libraries) covers the rest.
+struct NewlineScanner {
+    qint64 newlineCount = 0;
+    std::vector<qint64> checkpoints;
+    std::vector<std::pair<qint64, qint64>> offsetCheckpoints;
+
+    void scan(const char* data, qint64 size, qint64 baseOffset)
+    {
+        // Scanned in pieces ending on offset checkpoints, so the count is
+        // exact there.
+        constexpr qint64 interval = LineIndex::offsetCheckpointInterval;
+        for (qint64 begin = 0; begin < size;) {
+            const qint64 end = std::min(size, ((baseOffset + begin) / interval + 1) * interval - baseOffset);
+            scanPiece(data + begin, end - begin, baseOffset + begin);
+            begin = end;
+            if ((baseOffset + begin) % interval == 0)
+                offsetCheckpoints.emplace_back(newlineCount, baseOffset + begin);
+        }
+    }
+
+    void scanPiece(const char* data, qint64 size, qint64 baseOffset)
+    {
+        qint64 i = 0;
+#ifdef __SSE2__
+        for (; i + 64 <= size; i += 64) {
+            const quint64 mask = findNewlines64(data + i);
+            if (mask == 0)
+                continue;
+            const auto count = static_cast<qint64>(std::bitset<64>(mask).count());
+            if (count < LineIndex::checkpointInterval - newlineCount % LineIndex::checkpointInterval)
+                newlineCount += count;
+            else
+                scanBytes(data + i, 64, baseOffset + i);
+        }
+#endif
+        scanBytes(data + i, size - i, baseOffset + i);
+    }
+
+    void scanBytes(const char* data, qint64 size, qint64 baseOffset)
+    {
+        const char* end = data + size;
+        for (const char* p = data; p < end; ++p) {
+            p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!p)
+                break;
+            if (++newlineCount % LineIndex::checkpointInterval == 0)
+                checkpoints.push_back(baseOffset + (p - data) + 1);
+        }
+    }
+};
+
+}
+
+
+bool LineIndex::build(QIODevice& device, const std::atomic_bool& cancelled)
+{
+    auto* fileDevice = qobject_cast<QFileDevice*>(&device);
+    const qint64 size = device.size();
+    QByteArray buffer;
+    NewlineScanner scanner;
+    char lastByte = '\n';
+    for (qint64 offset = 0; offset < size; offset += scanChunkSize) {
+        if (cancelled)
+            return false;
+        const qint64 chunkSize = std::min(scanChunkSize, size - offset);
+        // Chunks are mapped one at a time and dropped right after, so the
+        // scan holds no more than one chunk however big the file.
+        if (uchar* mapped = fileDevice ? fileDevice->map(offset, chunkSize) : nullptr) {
+            scanner.scan(reinterpret_cast<const char*>(mapped), chunkSize, offset);
+            lastByte = static_cast<char>(mapped[chunkSize - 1]);
+            fileDevice->unmap(mapped);
+        } else {
+            buffer.resize(static_cast<int>(chunkSize));
+            if (!device.seek(offset) || device.read(buffer.data(), chunkSize) != chunkSize)
+                return false;
+            scanner.scan(buffer.constData(), chunkSize, offset);
+            lastByte = buffer.back();
+        }
+
+        std::lock_guard lock(mutex);
+        checkpoints.insert(checkpoints.end(), scanner.checkpoints.begin(), scanner.checkpoints.end());
+        scanner.checkpoints.clear();
+        offsetCheckpoints.insert(offsetCheckpoints.end(), scanner.offsetCheckpoints.begin(), scanner.offsetCheckpoints.end());
+        scanner.offsetCheckpoints.clear();
+        newlineCount = scanner.newlineCount;
+        indexedSize = offset + chunkSize;
+    }
+    std::lock_guard lock(mutex);
+    // A last line without a newline still counts.
+    lineCount = newlineCount + (lastByte == '\n' ? 0 : 1);
+    return true;
+}
+
+qint64 LineIndex::getIndexedSize() const
+{
+    std::lock_guard lock(mutex);
+    return indexedSize;
+}
+
+std::optional<qint64> LineIndex::getLineCount() const
+{
+    std::lock_guard lock(mutex);
+    return lineCount;
+}
+
+std::optional<std::pair<qint64, qint64>> LineIndex::findLine(qint64 line) const
+{
+    std::lock_guard lock(mutex);
+    if (line < 0 || line > newlineCount || (lineCount && line >= std::max<qint64>(*lineCount, 1)))
+        return std::nullopt;
+    const qint64 checkpoint = line / checkpointInterval;
+    return std::make_pair(checkpoint * checkpointInterval, checkpoints[static_cast<size_t>(checkpoint)]);
+}
+
+std::optional<std::pair<qint64, qint64>> LineIndex::findOffset(qint64 offset) const
+{
+    std::lock_guard lock(mutex);
+    if (offset < 0 || offset > indexedSize)
+        return std::nullopt;
+    const auto after = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset);
+    const auto checkpoint = static_cast<qint64>(after - checkpoints.begin()) - 1;
+    std::pair<qint64, qint64> result(checkpoint * checkpointInterval, checkpoints[static_cast<size_t>(checkpoint)]);
+    // Where lines are long, an offset checkpoint is closer.
+    const auto offsetAfter = std::upper_bound(offsetCheckpoints.begin(), offsetCheckpoints.end(), offset,
+                                              [](qint64 value, const std::pair<qint64, qint64>& checkpoint) {
+        return value < checkpoint.second;
+    });
+    if (offsetAfter != offsetCheckpoints.begin() && std::prev(offsetAfter)->second > result.second)
+        result = *std::prev(offsetAfter);
+    return result;
+}
+
+qint64 LineIndex::countNewlines(const char* data, qint64 size)
+{
+    qint64 count = 0;
+    qint64 i = 0;
+#ifdef __SSE2__
+    for (; i + 64 <= size; i += 64)
+        count += static_cast<qint64>(std::bitset<64>(findNewlines64(data + i)).count());
+#endif
+    return count + std::count(data + i, data + size, '\n');
+}
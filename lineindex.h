@@ -0,0 +1,47 @@
+#pragma once
+#include <QIODevice>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+// Offsets of every checkpointInterval-th line of a file, so finding line N
+// is a lookup plus a scan over fewer than checkpointInterval lines, and a
+// 20 GB log of 200 million lines takes under 2 MB. The line count at every
+// offsetCheckpointInterval-th byte is kept as well, so finding the line at
+// an offset never scans more than that, however long the lines are. One
+// thread builds the index with a vectorized newline scan while others look
+// lines up in the part indexed so far.
+class LineIndex {
+public:
+    static constexpr qint64 checkpointInterval = 1024;
+    static constexpr qint64 offsetCheckpointInterval = 1024 * 1024;
+
+    // Scans the whole device, publishing checkpoints as it goes. Fails
+    // when cancelled or on a read error.
+    bool build(QIODevice&, const std::atomic_bool& cancelled);
+
+    qint64 getIndexedSize() const;
+    // Known once the scan has finished.
+    std::optional<qint64> getLineCount() const;
+    // The last checkpoint at or before a line, as {line, offset}; nullopt
+    // while the scan has not reached that line.
+    std::optional<std::pair<qint64, qint64>> findLine(qint64 line) const;
+    // The last checkpoint at or before an offset, as {line, offset}, where
+    // the offset may be inside the line; nullopt while the scan has not
+    // reached that offset.
+    std::optional<std::pair<qint64, qint64>> findOffset(qint64 offset) const;
+
+    static qint64 countNewlines(const char* data, qint64 size);
+
+private:
+    mutable std::mutex mutex;
+    std::vector<qint64> checkpoints{0};
+    // {line, offset} at every offsetCheckpointInterval bytes.
+    std::vector<std::pair<qint64, qint64>> offsetCheckpoints;
+    qint64 indexedSize = 0;
+    qint64 newlineCount = 0;
+    std::optional<qint64> lineCount;
+};
@@ -0,0 +1,121 @@
+#include "listingpipeline.h"
+#include <QThreadPool>
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+
+namespace {
+
+// Requests mostly wait on the backend, so they get threads of their own
+// rather than the CPU-sized pools, and those threads are kept between
+// listings instead of being started for every directory.
+QThreadPool& getRequestPool()
+{
+    static QThreadPool pool;
+    return pool;
+}
+
+// Helpers that only get a thread once all batches are taken leave without
+// touching the caller's state, so the caller never waits for a queued one.
+struct HelperState {
+    std::mutex mutex;
+    std::condition_variable idle;
+    int runningCount = 0;
+    bool closed = false;
+};
+
+}
+
+
+ListingPipeline::ListingPipeline()
+    : inFlight(defaultInFlight)
+    , batchSize(defaultBatchSize)
+{}
+
+void ListingPipeline::setInFlight(int newInFlight)
+{
+    inFlight = std::max(1, newInFlight);
+}
+
+int ListingPipeline::getInFlight() const
+{
+    return inFlight;
+}
+
+void ListingPipeline::setBatchSize(int newBatchSize)
+{
+    batchSize = std::max(1, newBatchSize);
+}
+
+void ListingPipeline::run(IVfs& vfs, const QString& dirPath, const std::atomic_bool& cancelled, const BatchHandler& onBatch,
+                          QString& error) const
+{
+    if (vfs.listsInOnePass(dirPath)) {
+        std::vector<VfsStat> stats = vfs.list(dirPath, cancelled, error);
+        if (!stats.empty() && !cancelled)
+            onBatch(std::move(stats));
+        return;
+    }
+
+    const QStringList names = vfs.listNames(dirPath, cancelled, error);
+    const auto batchCount = static_cast<size_t>((names.size() + batchSize - 1) / batchSize);
+    std::atomic_size_t nextBatch{0};
+    const std::function<void()> statBatches = [&] {
+        for (size_t batch; (batch = nextBatch.fetch_add(1, std::memory_order_relaxed)) < batchCount;) {
+            if (cancelled)
+                continue;
+            const QStringList batchNames = names.mid(static_cast<int>(batch) * batchSize, batchSize);
+            std::vector<std::optional<VfsStat>> stats = vfs.statBatch(dirPath, batchNames);
+            std::vector<VfsStat> present;
+            present.reserve(stats.size());
+            for (std::optional<VfsStat>& stat : stats) {
+                if (stat)
+                    present.push_back(std::move(*stat));
+            }
+            if (!present.empty() && !cancelled)
+                onBatch(std::move(present));
+        }
+    };
+
+    // Each thread keeps one request outstanding, so the thread count is
+    // the pipeline depth rather than the core count. The calling thread
+    // is one of them.
+    const int helperCount = static_cast<int>(std::min<size_t>(batchCount, static_cast<size_t>(inFlight))) - 1;
+    QThreadPool& pool = getRequestPool();
+    if (pool.maxThreadCount() < helperCount)
+        pool.setMaxThreadCount(helperCount);
+    const auto state = std::make_shared<HelperState>();
+    for (int i = 0; i < helperCount; ++i) {
+        pool.start([state, statBatches = &statBatches] {
+            {
+                std::lock_guard lock(state->mutex);
+                if (state->closed)
+                    return;
+                ++state->runningCount;
+            }
+            (*statBatches)();
+            std::lock_guard lock(state->mutex);
+            --state->runningCount;
+            state->idle.notify_all();
+        });
+    }
+    statBatches();
+    std::unique_lock lock(state->mutex);
+    state->closed = true;
+    state->idle.wait(lock, [&] { return state->runningCount == 0; });
+}
+
+std::vector<VfsStat> ListingPipeline::list(IVfs& vfs, const QString& dirPath, const std::atomic_bool& cancelled,
+                                           QString& error) const
+{
+    std::vector<VfsStat> result;
+    std::mutex resultMutex;
+    run(vfs, dirPath, cancelled, [&](std::vector<VfsStat> batch) {
+        std::lock_guard lock(resultMutex);
+        std::move(batch.begin(), batch.end(), std::back_inserter(result));
+    }, error);
+    return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "vfs.h"
+
+
+// Lists a directory the way a mount with a round trip per call needs it:
+// one listNames() request, then statBatch() requests of batchSize names
+// with up to inFlight of them outstanding, on threads shared by all
+// listings. Every batch is handed over as soon as its request completes,
+// so batches arrive out of order and from several threads at once. With
+// 16 requests in flight the round trips overlap and a slow mount lists
+// about 16 times faster than with one stat after another. Backends that
+// get the stats with the names are listed in one list() call instead.
+class ListingPipeline {
+public:
+    using BatchHandler = std::function<void(std::vector<VfsStat>)>;
+
+    static constexpr int defaultInFlight = 16;
+    static constexpr int defaultBatchSize = 64;
+
+    ListingPipeline();
+
+    void setInFlight(int);
+    int getInFlight() const;
+    void setBatchSize(int);
+
+    // Sets error when the directory cannot be listed.
+    void run(IVfs&, const QString& dirPath, const std::atomic_bool& cancelled, const BatchHandler&, QString& error) const;
+    // Runs the pipeline and collects all batches.
+    std::vector<VfsStat> list(IVfs&, const QString& dirPath, const std::atomic_bool& cancelled, QString& error) const;
+
+private:
+    int inFlight;
+    int batchSize;
+};
@@ -0,0 +1,75 @@
+#include "listingsnapshot.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "datafilereader.h"
+#include "util.h"
+
+
+constexpr quint32 snapshotMagic = 0x464d534e;
+constexpr quint32 snapshotVersion = 2;
+
+
+QString ListingSnapshot::getDefaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) / QString("listings.snapshot");
+}
+
+bool ListingSnapshot::save(const QString& filePath, const Directories& directories)
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << snapshotMagic << snapshotVersion << static_cast<quint32>(directories.size());
+    for (const Directory& directory : directories) {
+        QByteArray entries;
+        QDataStream entryStream(&entries, QIODevice::WriteOnly);
+        entryStream.setVersion(QDataStream::Qt_5_0);
+        entryStream << static_cast<quint32>(directory.entries.size());
+        for (const DirectoryModel::Entry& entry : directory.entries)
+            entryStream << entry.name << entry.size << entry.lastModified << entry.isDir;
+        stream << directory.path << directory.currentName << entries;
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+ListingSnapshot::Directories ListingSnapshot::load(const QString& filePath, const Filter& filter)
+{
+    DataFileReader reader(filePath, snapshotMagic, snapshotVersion);
+    if (!reader.isValid())
+        return {};
+    QDataStream& stream = reader.getStream();
+    quint32 directoryCount = 0;
+    stream >> directoryCount;
+
+    Directories result;
+    for (quint32 i = 0; i < directoryCount && stream.status() == QDataStream::Ok; ++i) {
+        Directory directory;
+        quint32 byteCount = 0;
+        stream >> directory.path >> directory.currentName >> byteCount;
+        if (!filter(directory.path)) {
+            if (stream.skipRawData(static_cast<int>(byteCount)) != static_cast<int>(byteCount))
+                return {};
+            continue;
+        }
+        quint32 entryCount = 0;
+        stream >> entryCount;
+        directory.entries.reserve(std::min<qint64>(entryCount, reader.getSize()));
+        for (quint32 j = 0; j < entryCount && stream.status() == QDataStream::Ok; ++j) {
+            DirectoryModel::Entry entry;
+            stream >> entry.name >> entry.size >> entry.lastModified >> entry.isDir;
+            directory.entries.push_back(std::move(entry));
+        }
+        result.push_back(std::move(directory));
+    }
+    if (stream.status() != QDataStream::Ok)
+        return {};
+    return result;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <QString>
+#include <functional>
+#include <vector>
+#include "directorymodel.h"
+
+
+// Last-session listings saved on exit so the next start can paint the
+// first frame before the directory has been read from disk. The file is
+// memory-mapped on load and parsed in place. Every listing is stored with
+// its length, so the current directory can be decoded for the first frame
+// and the rest skipped until later. The cursor is kept as the name of its
+// entry, which stays right whatever sort the listing is shown in.
+class ListingSnapshot {
+public:
+    struct Directory {
+        QString path;
+        QString currentName;
+        DirectoryModel::Entries entries;
+    };
+    using Directories = std::vector<Directory>;
+
+    using Filter = std::function<bool(const QString& dirPath)>;
+
+    static QString getDefaultPath();
+    static bool save(const QString& filePath, const Directories&);
+    // Decodes the listings the filter accepts and skips the others.
+    static Directories load(const QString& filePath, const Filter&);
+};
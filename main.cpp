@@ -1,11 +1,42 @@
 #include "mainwindow.h"
 
 #include <QApplication>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "startupprofiler.h"
+#include "eventtracer.h"
+#include "archivevfs.h"
 
 int main(int argc, char *argv[])
 {
+    StartupProfiler::start(std::any_of(argv + 1, argv + argc, [](const char* arg) {
+        return std::strcmp(arg, "--profile-startup") == 0;
+    }));
     QApplication a(argc, argv);
+    StartupProfiler::mark("QApplication");
+    // --vfs-latency MS and --vfs-throughput KIB_PER_S simulate a slow mount.
+    long vfsLatency = 0;
+    long vfsThroughput = 0;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--trace") == 0)
+            EventTracer::start(QString::fromLocal8Bit(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--vfs-latency") == 0)
+            vfsLatency = std::strtol(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--vfs-throughput") == 0)
+            vfsThroughput = std::strtol(argv[i + 1], nullptr, 10);
+    }
+    if (vfsLatency > 0 || vfsThroughput > 0)
+        Vfs::install(std::make_unique<ArchiveVfs>(std::make_unique<ThrottledVfs>(
+            std::make_unique<LocalVfs>(), std::chrono::milliseconds(vfsLatency), vfsThroughput * 1024)));
     MainWindow w;
+    StartupProfiler::mark("MainWindow");
     w.show();
-    return a.exec();
+    StartupProfiler::mark("show");
+    const int result = a.exec();
+    if (EventTracer::isEnabled()) {
+        if (QString error; !EventTracer::stop(error))
+            qWarning("Failed to write trace: %s", qPrintable(error));
+    }
+    return result;
 }
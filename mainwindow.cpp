@@ -1,15 +1,36 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
-#include <QFileSystemModel>
 #include <QShortcut>
 #include <QDir>
 #include <QMessageBox>
 #include <QLabel>
 #include <QKeyEvent>
 #include <QLineEdit>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFontDatabase>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QSplitter>
+#include <QVBoxLayout>
 #include "platform.h"
+#include <algorithm>
+#include <cstdlib>
 #include <vector>
 #include "util.h"
+#include "directorymodel.h"
+#include "listingsnapshot.h"
+#include "colorscheme.h"
+#include "startupprofiler.h"
+#include "eventtracer.h"
+#include "statusaggregator.h"
+#include "filetypeprovider.h"
+#include "fileitemdelegate.h"
+#include "previewpane.h"
+#include "thumbnailcache.h"
+#include "tarindex.h"
+#include "vfs.h"
+#include <QTimer>
 
 
 #define GET_CSTR(qStr) (qStr.toLocal8Bit().data())
@@ -20,33 +41,18 @@ MainWindow::MainWindow(QWidget *parent)
     , ui(new Ui::MainWindow)
     , multiRowSelector(*this)
     , viModel(*this)
-    , commandSuggestor(viModel)
 {
-    setStyleSheet("background-color: rgb(0, 0, 0); color: rgb(255, 255, 255);");
+    setColorSchemeName("dark");
+    StartupProfiler::mark("color scheme");
 
     ui->setupUi(this);
-    QObject::connect(ui->statusbar, &QStatusBar::messageChanged, this, &MainWindow::onMessageChange);
+    statusAggregator = new StatusAggregator(*ui->statusbar, this);
+    StartupProfiler::mark("setupUi");
 
     fileViewer = ui->centralwidget->findChild<QTableView*>("fileViewer");
     Q_ASSERT(fileViewer != nullptr);
     fileViewer->setFocus();
 
-    qApp->setStyleSheet(
-        "QTableView {"
-        "    outline: 0;"
-        "    selection-color: black;"
-        "    selection-background-color: yellow;"
-        "}"
-        "QTablView::item {"
-        "    background-color: yellow;"
-        "}"
-        "QTableView::item:focus {"
-        "    color: black;"
-        "    background-color: yellow;"
-        "    border: 0px;"
-        "}"
-    );
-
     pathViewer = ui->centralwidget->findChild<QLabel*>("pathViewer");
     Q_ASSERT(pathViewer != nullptr);
 
@@ -56,37 +62,114 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(commandLine, &QLineEdit::returnPressed, this, &MainWindow::onCommandLineEnter);
     QObject::connect(commandLine, &QLineEdit::textEdited, this, &MainWindow::onCommandEdit);
 
-    model = new QFileSystemModel;
-    model->setRootPath(QDir::currentPath());
-    QObject::connect(model, &QFileSystemModel::rowsInserted, this, &MainWindow::onRowsInserted);
+    model = new DirectoryModel(this);
+    model->setFrameInterval(StatusAggregator::getFrameInterval());
+    fileTypeProvider = new FileTypeProvider(this);
+    model->setDecorationProvider([this](const DirectoryModel::Entry& entry) -> QVariant {
+        return fileTypeProvider->getIcon(fileTypeProvider->getType(model->getPath(), entry.name, entry.isDir));
+    });
+    QObject::connect(fileTypeProvider, &FileTypeProvider::typesResolved, model, &DirectoryModel::updateDecorations);
+    fileListModel = new FileListModel(this);
+    QObject::connect(model, &DirectoryModel::directoryLoaded, this, &MainWindow::onDirectoryLoaded);
+    QObject::connect(model, &DirectoryModel::listingFailed, this, [this](const QString& error) {
+        showStatus(error, 4);
+    });
     fileViewer->setModel(model);
     fileViewer->installEventFilter(this);
+    fileViewer->viewport()->installEventFilter(this);
+    fileViewer->setItemDelegate(new FileItemDelegate(fileViewer));
     fileViewer->setColumnWidth(0, 400);
+
+    previewPane = new PreviewPane(this);
+    previewPane->hide();
+    auto* splitter = new QSplitter(ui->centralwidget);
+    ui->verticalLayout->replaceWidget(fileViewer, splitter);
+    splitter->addWidget(fileViewer);
+    splitter->addWidget(previewPane);
+    QObject::connect(fileViewer->selectionModel(), &QItemSelectionModel::currentChanged,
+                     this, &MainWindow::onCurrentRowChanged);
+    thumbnailCache = new ThumbnailCache(this);
+    QObject::connect(thumbnailCache, &ThumbnailCache::thumbnailReady, this, &MainWindow::onThumbnailReady);
+    QObject::connect(fileViewer->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::requestThumbnails);
+    StartupProfiler::mark("model");
+    restoreSnapshot();
+    StartupProfiler::mark("snapshot");
 }
 
 MainWindow::~MainWindow()
 {
+    saveSnapshot();
     delete ui;
 }
 
+void MainWindow::finishStartup()
+{
+    model->setWatchingEnabled(true);
+    StartupProfiler::mark("deferred init");
+    StartupProfiler::report();
+}
+
+void MainWindow::restoreSnapshot()
+{
+    // Only the start directory is decoded before the first frame; the other
+    // listings are decoded on a worker and join the cache when ready.
+    const QString startPath = QFileInfo(QDir::currentPath()).absoluteFilePath();
+    const QString snapshotPath = ListingSnapshot::getDefaultPath();
+    QString restoredName;
+    std::vector<DirectoryModel::Listing> listings;
+    const auto isStartPath = [startPath](const QString& dirPath) { return dirPath == startPath; };
+    for (ListingSnapshot::Directory& directory : ListingSnapshot::load(snapshotPath, isStartPath)) {
+        restoredName = std::move(directory.currentName);
+        listings.push_back({std::move(directory.path), std::move(directory.entries)});
+    }
+    model->addListings(std::move(listings));
+
+    changeDirectoryIfCan(startPath);
+    if (const int row = model->findRow(restoredName); row > 0)
+        fileViewer->selectRow(row);
+
+    snapshotRunner.run([snapshotPath, startPath](const std::atomic_bool&) {
+        std::vector<DirectoryModel::Listing> listings;
+        const auto isOtherPath = [&startPath](const QString& dirPath) { return dirPath != startPath; };
+        for (ListingSnapshot::Directory& directory : ListingSnapshot::load(snapshotPath, isOtherPath))
+            listings.push_back({std::move(directory.path), std::move(directory.entries)});
+        return listings;
+    }, [this](std::vector<DirectoryModel::Listing> listings) {
+        model->addListings(std::move(listings));
+    });
+}
+
+void MainWindow::saveSnapshot()
+{
+    snapshotRunner.cancel();
+    ListingSnapshot::Directories directories;
+    for (DirectoryModel::Listing& listing : model->getListings()) {
+        const bool isCurrent = listing.path == model->getPath() && !isFileListShown();
+        const int row = isCurrent ? getCurrentRow() : -1;
+        QString currentName = row >= 0 ? model->rowEntry(row).name : QString();
+        directories.push_back({std::move(listing.path), std::move(currentName), std::move(listing.entries)});
+    }
+    ListingSnapshot::save(ListingSnapshot::getDefaultPath(), directories);
+}
+
 QString MainWindow::getCurrentFile() const
 {
-    return model->filePath(getCurrentIndex());
+    return getFilePath(getCurrentIndex());
 }
 
 QString MainWindow::getCurrentDir() const
 {
-    return model->filePath(fileViewer->rootIndex());
+    return model->getPath();
 }
 
 QFileInfo MainWindow::getCurrentFileInfo() const
 {
-    return model->fileInfo(getCurrentIndex());
+    return QFileInfo(getCurrentFile());
 }
 
 QString MainWindow::getCurrentDirectory() const
 {
-    return model->filePath(fileViewer->rootIndex());
+    return model->getPath();
 }
 
 int MainWindow::getCurrentRow() const
@@ -165,10 +248,14 @@ bool MainWindow::eventFilter(QObject* object, QEvent* event)
         switch (event->type()) {
         case QEvent::KeyPress:
             if (static_cast<QKeyEvent*>(event)->key() == Qt::Key_Tab) {
-                if (commandSuggestor.isEmpty())
-                    commandSuggestor.setInitialString(commandLine->text());
-                if (commandSuggestor.isValid())
-                    commandLine->setText(commandSuggestor.getNext());
+                if (!commandSuggestor)
+                    commandSuggestor.emplace(viModel, [this] {
+                        commandLine->setText(commandSuggestor->getNext());
+                    });
+                if (commandSuggestor->isEmpty())
+                    commandSuggestor->setInitialString(commandLine->text());
+                if (commandSuggestor->isValid())
+                    commandLine->setText(commandSuggestor->getNext());
                 return true;
             }
             break;
@@ -179,38 +266,70 @@ bool MainWindow::eventFilter(QObject* object, QEvent* event)
         }
     } else if (object == fileViewer) {
         if (event->type() == QEvent::KeyPress) {
+            EventTracer::beginInput(static_cast<QKeyEvent*>(event)->key());
             if (handleKeyPress(static_cast<QKeyEvent*>(event)))
                 return true;
         }
+    } else if (object == fileViewer->viewport()) {
+        if (event->type() == QEvent::Paint && !startupFinished) {
+            // The first frame ends when the file list has been painted,
+            // which on a slow display can be well after the window is
+            // shown.
+            startupFinished = true;
+            QCoreApplication::sendEvent(object, event);
+            StartupProfiler::mark("first frame");
+            QTimer::singleShot(0, this, &MainWindow::finishStartup);
+            return true;
+        }
+        if (event->type() == QEvent::Paint && EventTracer::isEnabled() && !tracingPaint) {
+            // Deliver the paint event from here so its full duration can be
+            // measured; the nested delivery passes through this filter
+            // untouched.
+            tracingPaint = true;
+            {
+                const ScopedTrace trace("paint");
+                QCoreApplication::sendEvent(object, event);
+            }
+            tracingPaint = false;
+            EventTracer::endInputs();
+            return true;
+        }
     }
     return QObject::eventFilter(object, event);
 }
 
 void MainWindow::openCurrentDirectory()
 {
-    const QModelIndex& newIndex = getCurrentIndex();
-    if (!model->isDir(newIndex))
+    if (isFileListShown()) {
+        const QFileInfo fileInfo(getCurrentFile());
+        closeFileList();
+        if (!fileInfo.filePath().isEmpty())
+            changeDirectoryIfCan(fileInfo.path());
         return;
-    fileViewer->setRootIndex(newIndex);
-    const QString& newPath = model->filePath(newIndex);
-    fileViewer->selectRow(0);
-    pathViewer->setText(newPath);
-
-    showStatus(tr("rc: %1").arg(model->rowCount(newIndex)));
+    }
+    const int currRow = getCurrentIndex().row();
+    if (!model->isDir(currRow) && !TarIndex::isArchiveName(model->filePath(currRow)))
+        return;
+    changeDirectoryIfCan(model->filePath(currRow));
 }
 
 void MainWindow::openParentDirectory()
 {
-    const QModelIndex& newRoot = fileViewer->rootIndex().parent();
-    fileViewer->setRootIndex(newRoot);
-    fileViewer->selectRow(0);
-    pathViewer->setText(model->filePath(newRoot));
-
-    showStatus(tr("rc: %1").arg(model->rowCount(newRoot)));
+    if (isFileListShown()) {
+        closeFileList();
+        return;
+    }
+    // The parent can be a directory inside an archive, which QDir does
+    // not know about.
+    const QString parentPath = QFileInfo(model->getPath()).path();
+    if (parentPath == model->getPath())
+        return;
+    changeDirectoryIfCan(parentPath);
 }
 
 void MainWindow::selectRow(int row)
 {
+    const ScopedTrace trace("MainWindow::selectRow");
     if (rowSelectionStrategy)
         rowSelectionStrategy->selectRow(row);
     else
@@ -219,7 +338,7 @@ void MainWindow::selectRow(int row)
 
 int MainWindow::getRowCount() const
 {
-    return model->rowCount(fileViewer->rootIndex());
+    return fileViewer->model()->rowCount(fileViewer->rootIndex());
 }
 
 void MainWindow::onCommandLineEnter()
@@ -229,21 +348,60 @@ void MainWindow::onCommandLineEnter()
 
 void MainWindow::onCommandEdit()
 {
-    if (!commandSuggestor.isEmpty())
-        commandSuggestor.reset();
+    if (commandSuggestor && !commandSuggestor->isEmpty())
+        commandSuggestor->reset();
 }
 
-void MainWindow::onRowsInserted(const QModelIndex& parent, int first, int last)
+void MainWindow::onDirectoryLoaded(const QString&)
 {
+    if (isFileListShown() || !openingDirectory)
+        return;
+    if (model->isListingComplete())
+        openingDirectory = false;
     qDebug("View updated");
-    fileViewer->selectRow(0);
-    showStatus(tr("rc: %1").arg(model->rowCount(parent)));
-}
-
-void MainWindow::onMessageChange(const QString& message)
-{
-//    if (message.isEmpty())
-//        showStatus(tr("rc: %1, ks: %2").arg(model->rowCount(fileViewer->rootIndex())).arg(normalMode.seq()));
+    // Streamed listings report twice, at the first rows and when complete;
+    // by then the cursor may have moved.
+    if (!getCurrentIndex().isValid())
+        fileViewer->selectRow(0);
+    requestThumbnails();
+    showStatus(tr("rc: %1").arg(model->rowCount()));
+}
+
+void MainWindow::onCurrentRowChanged()
+{
+    updatePreview();
+    requestThumbnails();
+}
+
+void MainWindow::onThumbnailReady(const QString& path)
+{
+    if (path == getCurrentFile())
+        updatePreview();
+}
+
+void MainWindow::requestThumbnails()
+{
+    // Visible image rows, nearest to the cursor first; everything else
+    // queued before is dropped.
+    std::vector<ThumbnailKey> keys;
+    if (previewMode == EPreviewMode::AUTO && !isFileListShown()) {
+        const int firstRow = std::max(0, fileViewer->rowAt(0));
+        int lastRow = fileViewer->rowAt(fileViewer->viewport()->height() - 1);
+        if (lastRow < 0)
+            lastRow = getRowCount() - 1;
+        const int currentRow = std::clamp(getCurrentRow(), firstRow, std::max(firstRow, lastRow));
+        std::vector<int> rows;
+        for (int row = firstRow; row <= lastRow; ++row)
+            rows.push_back(row);
+        std::stable_sort(rows.begin(), rows.end(), [currentRow](int lhs, int rhs) {
+            return std::abs(lhs - currentRow) < std::abs(rhs - currentRow);
+        });
+        for (int row : rows) {
+            if (std::optional<ThumbnailKey> key = getThumbnailKey(row))
+                keys.push_back(std::move(*key));
+        }
+    }
+    thumbnailCache->request(std::move(keys));
 }
 
 QModelIndex MainWindow::getCurrentIndex() const
@@ -251,59 +409,56 @@ QModelIndex MainWindow::getCurrentIndex() const
     const QModelIndex& currIndex = fileViewer->currentIndex();
     if (currIndex.column() == 0)
         return currIndex;
-    return model->index(currIndex.row(), 0, currIndex.parent());
+    return currIndex.sibling(currIndex.row(), 0);
 }
 
 void MainWindow::showStatus(const QString& message, int secTimeout)
 {
-    Q_ASSERT(secTimeout >= 0);
-    ui->statusbar->showMessage(message, secTimeout * 1000);
-}
-
-void MainWindow::mkdir(const QString& dirName)
-{
-    model->mkdir(fileViewer->rootIndex(), dirName);
+    // The color scheme is applied before the widgets exist; a failure
+    // there goes to the log instead.
+    if (!statusAggregator) {
+        qWarning("%s", GET_CSTR(message));
+        return;
+    }
+    statusAggregator->post(message, secTimeout);
 }
 
 void MainWindow::setColorSchemeName(const QString& name)
 {
-    if (name == "light") {
-        setStyleSheet("");
-        qApp->setStyleSheet("");
-    } else if (name == "dark") {
-        setStyleSheet("background-color: rgb(0, 0, 0); color: rgb(255, 255, 255);");
-        qApp->setStyleSheet(
-            "QTableView {"
-            "    outline: 0;"
-            "    selection-color: black;"
-            "    selection-background-color: yellow;"
-            "}"
-            "QTablView::item {"
-            "    background-color: yellow;"
-            "}"
-            "QTableView::item:focus {"
-            "    color: black;"
-            "    background-color: yellow;"
-            "    border: 0px;"
-            "}"
-        );
-    }
+    if (const QPalette* palette = findColorScheme(name))
+        qApp->setPalette(*palette);
+    else
+        showStatus("Unknown color scheme", 4);
 }
 
 bool MainWindow::changeDirectoryIfCan(const QString &dirPath)
 {
-    const QModelIndex& rootIndex = model->index(dirPath);
-    if (!rootIndex.isValid())
+    const QFileInfo dirInfo(dirPath);
+    const std::optional<VfsStat> stat = Vfs::get().statQuick(dirPath);
+    if (!stat || !(stat->isDir || TarIndex::isArchiveName(dirPath)))
         return false;
-    setRootIndex(rootIndex);
+    if (isFileListShown())
+        setViewerModel(model);
+    openingDirectory = true;
+    model->setPath(dirInfo.absoluteFilePath());
+    pathViewer->setText(model->getPath());
+    viModel.recordDirectoryVisit(model->getPath());
     return true;
 }
 
-void MainWindow::setRootIndex(const QModelIndex& newRootIndex)
+void MainWindow::setSortMode(ESortMode sortMode)
 {
-    fileViewer->setRootIndex(newRootIndex);
-    pathViewer->setText(model->filePath(newRootIndex));
-    fileViewer->selectRow(0);
+    model->setSortMode(sortMode);
+}
+
+void MainWindow::setMemoryBudget(qint64 bytes)
+{
+    model->setMemoryBudget(bytes);
+}
+
+void MainWindow::setListingConcurrency(int inFlight)
+{
+    model->setListingConcurrency(inFlight);
 }
 
 void MainWindow::searchForward(const QString& line)
@@ -342,6 +497,106 @@ bool MainWindow::showQuestion(const QString& question)
     return QMessageBox::question(this, "Question", question) == QMessageBox::Yes;
 }
 
+std::optional<quint64> MainWindow::getListingGeneration(const QString& dirPath) const
+{
+    if (!model->hasListing(dirPath))
+        return std::nullopt;
+    return model->getContentGeneration();
+}
+
+void MainWindow::visitCachedListing(const QString& dirPath, const std::function<void(const QString&)>& visit) const
+{
+    model->visitListing(dirPath, [&visit](const DirectoryModel::Entry& entry) {
+        visit(entry.isDir ? entry.name + '/' : entry.name);
+    });
+}
+
+std::optional<QStringList> MainWindow::editLines(const QString& title, const QStringList& lines)
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(title);
+    auto* editor = new QPlainTextEdit(&dialog);
+    editor->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    editor->setLineWrapMode(QPlainTextEdit::NoWrap);
+    editor->setPlainText(lines.join('\n'));
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    QObject::connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    QObject::connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    auto* layout = new QVBoxLayout(&dialog);
+    layout->addWidget(editor);
+    layout->addWidget(buttons);
+    dialog.resize(width(), height());
+    if (dialog.exec() != QDialog::Accepted)
+        return std::nullopt;
+
+    QStringList result = editor->toPlainText().split('\n');
+    if (result.size() > lines.size() && result.back().isEmpty())
+        result.removeLast();
+    return result;
+}
+
+void MainWindow::setListingUpdatesEnabled(bool enabled)
+{
+    model->setWatchingEnabled(enabled);
+}
+
+QStringList MainWindow::getRowNames() const
+{
+    if (!isFileListShown())
+        return model->getRowNames();
+    QStringList names;
+    for (int row = 0; row < fileListModel->rowCount(); ++row)
+        names.push_back(fileListModel->index(row, 0).data().toString());
+    return names;
+}
+
+void MainWindow::setRowsSelected(const std::vector<int>& rows, bool selected)
+{
+    // Consecutive rows are merged into ranges and applied in one call, so
+    // the view gets a single selectionChanged.
+    QAbstractItemModel* viewerModel = fileViewer->model();
+    QItemSelection selection;
+    for (size_t i = 0; i < rows.size();) {
+        size_t last = i;
+        while (last + 1 < rows.size() && rows[last + 1] == rows[last] + 1)
+            ++last;
+        selection.select(viewerModel->index(rows[i], 0), viewerModel->index(rows[last], 0));
+        i = last + 1;
+    }
+    const auto command = (selected ? QItemSelectionModel::Select : QItemSelectionModel::Deselect)
+        | QItemSelectionModel::Rows;
+    fileViewer->selectionModel()->select(selection, command);
+}
+
+void MainWindow::setPreviewMode(EPreviewMode mode)
+{
+    previewMode = mode;
+    if (mode == EPreviewMode::OFF) {
+        previewPane->hide();
+        requestThumbnails();
+        return;
+    }
+    previewPane->setMode(mode);
+    updatePreview();
+    previewPane->show();
+    requestThumbnails();
+}
+
+EPreviewMode MainWindow::getPreviewMode() const
+{
+    return previewMode;
+}
+
+bool MainWindow::scrollPreviewToLine(qint64 line)
+{
+    return previewPane->scrollToLine(line);
+}
+
+void MainWindow::showReport(const QString& title, const QStringList& lines)
+{
+    QMessageBox::information(this, title, lines.join('\n'));
+}
+
 QItemSelectionModel* MainWindow::getSelectionModel()
 {
     return fileViewer->selectionModel();
@@ -349,7 +604,7 @@ QItemSelectionModel* MainWindow::getSelectionModel()
 
 QModelIndex MainWindow::getIndexForRow(int row) const
 {
-    return model->index(row, 0, fileViewer->rootIndex());
+    return fileViewer->model()->index(row, 0, fileViewer->rootIndex());
 }
 
 bool MainWindow::isRowVisible(int row) const
@@ -360,6 +615,79 @@ bool MainWindow::isRowVisible(int row) const
     return viewportRect.contains(rowRect);
 }
 
+QStringList MainWindow::getSelectedFiles() const
+{
+    QStringList result;
+    for (const QModelIndex& index : fileViewer->selectionModel()->selectedRows())
+        result.push_back(getFilePath(index));
+    return result;
+}
+
+void MainWindow::showFileList(const QString& rootPath, std::vector<FileListEntry> entries)
+{
+    if (!isFileListShown())
+        setViewerModel(fileListModel);
+    fileListModel->setEntries(rootPath, std::move(entries));
+    pathViewer->setText(rootPath);
+    fileViewer->selectRow(0);
+}
+
+void MainWindow::onFilesRemoved(const QStringList& paths)
+{
+    if (isFileListShown())
+        fileListModel->removePaths(paths);
+}
+
+bool MainWindow::isFileListShown() const
+{
+    return fileViewer->model() == fileListModel;
+}
+
+void MainWindow::closeFileList()
+{
+    setViewerModel(model);
+    pathViewer->setText(model->getPath());
+    fileViewer->selectRow(0);
+    showStatus(tr("rc: %1").arg(model->rowCount()));
+}
+
+void MainWindow::setViewerModel(QAbstractItemModel* newModel)
+{
+    if (isMultiSelectionEnabled())
+        setMultiSelectionEnabled(false);
+    QItemSelectionModel* oldSelectionModel = fileViewer->selectionModel();
+    fileViewer->setModel(newModel);
+    delete oldSelectionModel;
+    QObject::connect(fileViewer->selectionModel(), &QItemSelectionModel::currentChanged,
+                     this, &MainWindow::onCurrentRowChanged);
+}
+
+void MainWindow::updatePreview()
+{
+    // Cheap while the pane is hidden: it only remembers the path.
+    if (const std::optional<ThumbnailKey> key = getThumbnailKey(getCurrentRow()))
+        previewPane->showImage(key->path, thumbnailCache->find(*key));
+    else
+        previewPane->setPath(getCurrentFile());
+}
+
+std::optional<ThumbnailKey> MainWindow::getThumbnailKey(int row) const
+{
+    if (previewMode != EPreviewMode::AUTO || isFileListShown() || row < 0 || row >= model->rowCount())
+        return std::nullopt;
+    const DirectoryModel::Entry& entry = model->rowEntry(row);
+    if (entry.isDir || !ThumbnailCache::isImageName(entry.name))
+        return std::nullopt;
+    return ThumbnailKey{model->filePath(row), entry.size, entry.lastModified};
+}
+
+QString MainWindow::getFilePath(const QModelIndex& index) const
+{
+    if (isFileListShown())
+        return fileListModel->filePath(index.row());
+    return model->filePath(index.row());
+}
+
 
 
 MultiRowSelector::MultiRowSelector(IFileViewer& newOwner)
@@ -6,9 +6,12 @@
 #include <functional>
 #include <array>
 #include <map>
+#include <optional>
 #include "vimodel.h"
 #include "commandcompletion.h"
 #include "searchcontroller.h"
+#include "filelistmodel.h"
+#include "taskrunner.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -17,9 +20,15 @@ QT_END_NAMESPACE
 
 class QTableView;
 class QShortcut;
-class QFileSystemModel;
+class DirectoryModel;
+class QAbstractItemModel;
 class QLabel;
 class QLineEdit;
+class StatusAggregator;
+class FileTypeProvider;
+class PreviewPane;
+class ThumbnailCache;
+struct ThumbnailKey;
 
 
 class IFileViewer : public IRowInfo {
@@ -73,18 +82,24 @@ private slots:
     int getCurrentRow() const override;
     void onCommandLineEnter();
     void onCommandEdit();
-    void onRowsInserted(const QModelIndex& parent, int first, int last);
-    void onMessageChange(const QString&);
+    void onDirectoryLoaded(const QString&);
+    void onCurrentRowChanged();
+    void onThumbnailReady(const QString& path);
+    void requestThumbnails();
 
 private:
     void completeCommand();
     bool resetCompletionIfEndReached();
     QModelIndex getCurrentIndex() const override;
     void showStatus(const QString&, int secTimeout = 0) override;
-    void mkdir(const QString& dirName) override;
     void setColorSchemeName(const QString&) override;
     bool changeDirectoryIfCan(const QString& dirPath) override;
-    void setRootIndex(const QModelIndex&);
+    void setSortMode(ESortMode) override;
+    void setMemoryBudget(qint64 bytes) override;
+    void setListingConcurrency(int inFlight) override;
+    void finishStartup();
+    void restoreSnapshot();
+    void saveSnapshot();
     void searchForward(const QString&) override;
 
     void focusToCommandLine(const QString& line = {}) override;
@@ -92,21 +107,54 @@ private:
     void setMultiSelectionEnabled(bool) override;
     bool isMultiSelectionEnabled() const override;
     bool showQuestion(const QString&) override;
+    std::optional<quint64> getListingGeneration(const QString& dirPath) const override;
+    void visitCachedListing(const QString& dirPath, const std::function<void(const QString&)>& visit) const override;
+    std::optional<QStringList> editLines(const QString& title, const QStringList& lines) override;
+    void setListingUpdatesEnabled(bool) override;
+    QStringList getRowNames() const override;
+    void setRowsSelected(const std::vector<int>& rows, bool selected) override;
+    void setPreviewMode(EPreviewMode) override;
+    EPreviewMode getPreviewMode() const override;
+    bool scrollPreviewToLine(qint64 line) override;
+    void showReport(const QString& title, const QStringList& lines) override;
 
     QItemSelectionModel* getSelectionModel() override;
     QModelIndex getIndexForRow(int) const override;
 
     bool isRowVisible(int) const override;
 
+    QStringList getSelectedFiles() const override;
+    void showFileList(const QString& rootPath, std::vector<FileListEntry>) override;
+    void onFilesRemoved(const QStringList&) override;
+    bool isFileListShown() const;
+    void closeFileList();
+    void setViewerModel(QAbstractItemModel*);
+    void updatePreview();
+    std::optional<ThumbnailKey> getThumbnailKey(int row) const;
+    QString getFilePath(const QModelIndex&) const;
+
 private:
     Ui::MainWindow *ui;
     QTableView* fileViewer;
     QLabel* pathViewer;
     QLineEdit* commandLine;
-    QFileSystemModel* model;
+    DirectoryModel* model;
+    FileListModel* fileListModel;
+    // Null until setupUi has created the status bar.
+    StatusAggregator* statusAggregator = nullptr;
+    FileTypeProvider* fileTypeProvider;
+    PreviewPane* previewPane;
+    ThumbnailCache* thumbnailCache;
+    EPreviewMode previewMode = EPreviewMode::OFF;
     MultiRowSelector multiRowSelector;
     IRowSelectionStrategy* rowSelectionStrategy = nullptr;
 
     ViModel viModel;
-    CommandCompletion commandSuggestor;
+    std::optional<CommandCompletion> commandSuggestor;
+    TaskRunner snapshotRunner;
+    bool startupFinished = false;
+    // Set from changing directory until the model reports the listing
+    // complete; reports outside that window leave cursor and status alone.
+    bool openingDirectory = false;
+    bool tracingPaint = false;
 };
@@ -0,0 +1,101 @@
+#include "mappedfile.h"
+#include <QFileDevice>
+#include <algorithm>
+#include "vfs.h"
+
+
+constexpr qint64 windowSize = 4 * 1024 * 1024;
+constexpr size_t maxWindows = 4;
+constexpr qint64 readWindowSize = 1024 * 1024;
+
+
+std::unique_ptr<MappedFile> MappedFile::open(const QString& path, QString& error)
+{
+    std::unique_ptr<QIODevice> device = Vfs::get().open(path, QIODevice::ReadOnly, error);
+    if (!device)
+        return nullptr;
+    return std::unique_ptr<MappedFile>(new MappedFile(std::move(device)));
+}
+
+MappedFile::MappedFile(std::unique_ptr<QIODevice> newDevice)
+    : device(std::move(newDevice))
+    , size(device->size())
+    , mappable(qobject_cast<QFileDevice*>(device.get()) != nullptr)
+{}
+
+MappedFile::~MappedFile()
+{
+    if (auto* fileDevice = qobject_cast<QFileDevice*>(device.get())) {
+        for (const Window& window : windows)
+            fileDevice->unmap(window.data);
+    }
+}
+
+qint64 MappedFile::getSize() const
+{
+    return size;
+}
+
+QString MappedFile::getFileName() const
+{
+    const auto* fileDevice = qobject_cast<const QFileDevice*>(device.get());
+    return fileDevice ? fileDevice->fileName() : QString();
+}
+
+QByteArray MappedFile::peek(qint64 offset, qint64 peekSize)
+{
+    offset = std::clamp<qint64>(offset, 0, size);
+    peekSize = std::min({peekSize, maxPeekSize, size - offset});
+    if (peekSize <= 0)
+        return {};
+    if (const Window* window = mappable ? findWindow(offset) : nullptr) {
+        const auto* data = reinterpret_cast<const char*>(window->data + (offset - window->begin));
+        return QByteArray::fromRawData(data, static_cast<int>(peekSize));
+    }
+    if (bufferBegin < 0 || offset < bufferBegin || offset + peekSize > bufferBegin + buffer.size()) {
+        // Read windows overlap by maxPeekSize too, so the peek fits.
+        const qint64 begin = offset / readWindowSize * readWindowSize;
+        const qint64 readSize = std::min(readWindowSize + maxPeekSize, size - begin);
+        bufferBegin = -1;
+        buffer.resize(static_cast<int>(readSize));
+        if (!device->seek(begin))
+            return {};
+        const qint64 bytesRead = device->read(buffer.data(), readSize);
+        if (bytesRead <= offset - begin)
+            return {};
+        buffer.resize(static_cast<int>(bytesRead));
+        bufferBegin = begin;
+    }
+    const qint64 available = std::min(peekSize, bufferBegin + buffer.size() - offset);
+    return QByteArray::fromRawData(buffer.constData() + (offset - bufferBegin), static_cast<int>(available));
+}
+
+const MappedFile::Window* MappedFile::findWindow(qint64 offset)
+{
+    const qint64 begin = offset / windowSize * windowSize;
+    const auto found = std::find_if(windows.begin(), windows.end(), [begin](const Window& window) {
+        return window.begin == begin;
+    });
+    if (found != windows.end()) {
+        found->lastUse = ++useCounter;
+        return &*found;
+    }
+
+    auto* fileDevice = static_cast<QFileDevice*>(device.get());
+    if (windows.size() >= maxWindows) {
+        const auto oldest = std::min_element(windows.begin(), windows.end(), [](const Window& lhs, const Window& rhs) {
+            return lhs.lastUse < rhs.lastUse;
+        });
+        fileDevice->unmap(oldest->data);
+        windows.erase(oldest);
+    }
+    const qint64 mapSize = std::min(windowSize + maxPeekSize, size - begin);
+    uchar* data = fileDevice->map(begin, mapSize);
+    if (!data) {
+        // Pipes and special files: fall back to reads for good.
+        mappable = false;
+        return nullptr;
+    }
+    windows.push_back({begin, data, mapSize, ++useCounter});
+    return &windows.back();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <memory>
+#include <vector>
+
+
+// Read-only random access to a file of any size through a few mapped
+// windows, the least recently used one unmapped first, so at most
+// maxWindows * (windowSize + maxPeekSize) bytes are mapped however large
+// the file is. Windows overlap by maxPeekSize, so every peek() fits in one
+// and comes back without a copy. Devices that cannot be mapped (a throttled
+// backend, an archive member) are read one bounded window at a time, kept
+// until a peek falls outside it, so painting a screen of rows costs one
+// read and never inflates a compressed member from its start again.
+// Not thread-safe.
+class MappedFile {
+public:
+    static constexpr qint64 maxPeekSize = 256 * 1024;
+
+    static std::unique_ptr<MappedFile> open(const QString& path, QString& error);
+    ~MappedFile();
+
+    qint64 getSize() const;
+    // Local path of the file the device reads, or empty when it is not a
+    // plain file (archive members, throttled backends).
+    QString getFileName() const;
+    // Up to size (at most maxPeekSize) bytes at offset, fewer at the end of
+    // the file. The result points into the mapping or the read window and
+    // is only valid until the next call.
+    QByteArray peek(qint64 offset, qint64 size);
+
+private:
+    struct Window {
+        qint64 begin;
+        uchar* data;
+        qint64 size;
+        quint64 lastUse;
+    };
+
+    explicit MappedFile(std::unique_ptr<QIODevice>);
+    const Window* findWindow(qint64 offset);
+
+private:
+    std::unique_ptr<QIODevice> device;
+    std::vector<Window> windows;
+    QByteArray buffer;
+    qint64 bufferBegin = -1;
+    qint64 size;
+    quint64 useCounter = 0;
+    bool mappable;
+};
@@ -0,0 +1,70 @@
+#include "namematcher.h"
+
+
+#ifdef Q_OS_WIN
+constexpr Qt::CaseSensitivity nameCaseSensitivity = Qt::CaseInsensitive;
+#else
+constexpr Qt::CaseSensitivity nameCaseSensitivity = Qt::CaseSensitive;
+#endif
+
+
+static bool hasWildcards(const QString& text)
+{
+    for (QChar character : text) {
+        if (character == '*' || character == '?' || character == '[' || character == '\\')
+            return true;
+    }
+    return false;
+}
+
+
+bool NameMatcher::compile(const QString& pattern, EPatternSyntax syntax, QString& error)
+{
+    caseSensitivity = nameCaseSensitivity;
+    QRegularExpression::PatternOptions options = QRegularExpression::NoPatternOption;
+    if (caseSensitivity == Qt::CaseInsensitive)
+        options |= QRegularExpression::CaseInsensitiveOption;
+
+    if (syntax == EPatternSyntax::GLOB) {
+        const bool leadingStar = pattern.startsWith('*');
+        const bool trailingStar = pattern.size() > 1 && pattern.endsWith('*');
+        const QString middle = pattern.mid(leadingStar ? 1 : 0, pattern.size() - leadingStar - trailingStar);
+        if (!hasWildcards(middle)) {
+            literal = middle;
+            kind = leadingStar ? (trailingStar ? EKind::CONTAINS : EKind::SUFFIX)
+                               : (trailingStar ? EKind::PREFIX : EKind::EXACT);
+            return true;
+        }
+        regex.setPattern(QRegularExpression::wildcardToRegularExpression(pattern));
+    } else {
+        regex.setPattern(pattern);
+    }
+
+    kind = EKind::REGEX;
+    regex.setPatternOptions(options);
+    if (!regex.isValid()) {
+        error = regex.errorString();
+        return false;
+    }
+    regex.optimize();
+    return true;
+}
+
+bool NameMatcher::matches(const QString& name) const
+{
+    switch (kind) {
+    case EKind::EXACT:
+        return name.compare(literal, caseSensitivity) == 0;
+    case EKind::PREFIX:
+        return name.startsWith(literal, caseSensitivity);
+    case EKind::SUFFIX:
+        return name.endsWith(literal, caseSensitivity);
+    case EKind::CONTAINS:
+        return name.contains(literal, caseSensitivity);
+    case EKind::REGEX:
+        // Regex syntax searches anywhere in the name; the glob translation
+        // is already anchored.
+        return regex.match(name).hasMatch();
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <QRegularExpression>
+#include <QString>
+
+
+enum class EPatternSyntax {
+    GLOB,
+    REGEX,
+};
+
+
+// A file name pattern compiled once and then matched against many names.
+// Globs that are a plain name, a prefix (foo*), a suffix (*.log) or an
+// infix (*foo*) are matched by direct comparison; everything else goes
+// through a compiled regular expression. Matching is safe to run from
+// several threads at once.
+class NameMatcher {
+public:
+    bool compile(const QString& pattern, EPatternSyntax, QString& error);
+    bool matches(const QString& name) const;
+
+private:
+    enum class EKind {
+        EXACT,
+        PREFIX,
+        SUFFIX,
+        CONTAINS,
+        REGEX,
+    };
+
+    EKind kind = EKind::EXACT;
+    QString literal;
+    QRegularExpression regex;
+    Qt::CaseSensitivity caseSensitivity = Qt::CaseSensitive;
+};
@@ -0,0 +1,200 @@
+#include "operationjournal.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "datafilereader.h"
+#include "util.h"
+#include "vfs.h"
+
+
+constexpr quint32 journalMagic = 0x464d4a4e;
+constexpr quint32 journalVersion = 1;
+constexpr quint8 undoMarker = 0xff;
+constexpr size_t maxBatchCount = 100;
+constexpr int minCompactionRecordCount = 10000;
+
+
+// On freedesktop systems the trash keeps <trash>/files/<name> next to
+// <trash>/info/<name>.trashinfo, which would list a file restored by a
+// rename as still being in the trash.
+static void removeTrashInfo(const QString& pathInTrash)
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
+    const QFileInfo trashed(pathInTrash);
+    const QFileInfo filesDir(trashed.path());
+    const QFileInfo trashDir(filesDir.path());
+    // ~/.local/share/Trash, $topdir/.Trash-$uid or $topdir/.Trash/$uid.
+    const bool isTrash = trashDir.fileName() == QLatin1String("Trash")
+        || trashDir.fileName().startsWith(QLatin1String(".Trash-"))
+        || QFileInfo(trashDir.path()).fileName() == QLatin1String(".Trash");
+    if (filesDir.fileName() == QLatin1String("files") && isTrash)
+        QFile::remove(trashDir.filePath() / QString("info") / (trashed.fileName() + ".trashinfo"));
+#else
+    Q_UNUSED(pathInTrash);
+#endif
+}
+
+
+OperationJournal::OperationJournal(QString newFilePath)
+    : filePath(std::move(newFilePath))
+    , lastBatchId(0)
+    , recordCount(0)
+    , loaded(false)
+{
+}
+
+QString OperationJournal::getDefaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) / QString("operations.journal");
+}
+
+void OperationJournal::record(Batch batch)
+{
+    if (batch.empty())
+        return;
+    // Batch ids are timestamps, so new batches order after the ones in
+    // the file without reading it first.
+    const quint64 batchId = std::max<quint64>(lastBatchId + 1, QDateTime::currentMSecsSinceEpoch());
+    lastBatchId = batchId;
+    append(batchId, batch);
+    if (!loaded)
+        return;
+    batches.emplace_back(batchId, std::move(batch));
+    if (batches.size() > maxBatchCount)
+        batches.pop_front();
+    if (needsCompaction())
+        compact();
+}
+
+std::optional<OperationJournal::Batch> OperationJournal::takeLastBatch()
+{
+    ensureLoaded();
+    if (batches.empty())
+        return std::nullopt;
+    auto [batchId, batch] = std::move(batches.back());
+    batches.pop_back();
+    appendUndoMarker(batchId);
+    return std::move(batch);
+}
+
+OperationJournal::Batch OperationJournal::undo(const Batch& batch, QString& error)
+{
+    for (size_t i = batch.size(); i > 0; --i) {
+        const Step& step = batch[i - 1];
+        bool undone = false;
+        switch (step.kind) {
+        case EJournalStep::MOVE:
+            undone = Vfs::get().rename(step.path, step.originalPath, error);
+            if (undone)
+                removeTrashInfo(step.path);
+            break;
+        case EJournalStep::CREATE:
+            undone = !Vfs::get().stat(step.path) || QFile::moveToTrash(step.path);
+            if (!undone)
+                error = QString("Cannot move %1 to the trash").arg(step.path);
+            break;
+        case EJournalStep::REMOVE:
+            undone = true;
+            error = QString("%1 was deleted permanently and cannot be restored").arg(step.path);
+            break;
+        }
+        if (!undone)
+            return Batch(batch.begin(), batch.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+    return {};
+}
+
+void OperationJournal::ensureLoaded()
+{
+    if (loaded)
+        return;
+    loaded = true;
+
+    DataFileReader reader(filePath, journalMagic, journalVersion);
+    if (!reader.isValid())
+        return;
+    QDataStream& stream = reader.getStream();
+
+    // Records of one batch are contiguous. A record cut short by a crash
+    // ends the journal.
+    while (!stream.atEnd()) {
+        quint64 batchId = 0;
+        quint8 kind = 0;
+        QString path;
+        QString originalPath;
+        stream >> batchId >> kind >> path >> originalPath;
+        if (stream.status() != QDataStream::Ok)
+            break;
+        ++recordCount;
+        lastBatchId = std::max(lastBatchId, batchId);
+        if (kind == undoMarker) {
+            if (!batches.empty() && batches.back().first == batchId)
+                batches.pop_back();
+            continue;
+        }
+        if (batches.empty() || batches.back().first != batchId)
+            batches.emplace_back(batchId, Batch());
+        batches.back().second.push_back({static_cast<EJournalStep>(kind), std::move(path), std::move(originalPath)});
+    }
+
+    while (batches.size() > maxBatchCount)
+        batches.pop_front();
+    if (needsCompaction())
+        compact();
+}
+
+void OperationJournal::append(quint64 batchId, const Batch& batch)
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QFile file(filePath);
+    if (!file.open(QIODevice::Append))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    if (file.size() == 0)
+        stream << journalMagic << journalVersion;
+    for (const Step& step : batch)
+        stream << batchId << static_cast<quint8>(step.kind) << step.path << step.originalPath;
+    recordCount += static_cast<int>(batch.size());
+}
+
+void OperationJournal::appendUndoMarker(quint64 batchId)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::Append))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << batchId << undoMarker << QString() << QString();
+    ++recordCount;
+}
+
+bool OperationJournal::needsCompaction() const
+{
+    int liveRecordCount = 0;
+    for (const auto& [batchId, batch] : batches)
+        liveRecordCount += static_cast<int>(batch.size());
+    return recordCount > minCompactionRecordCount && recordCount > 2 * liveRecordCount;
+}
+
+void OperationJournal::compact()
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << journalMagic << journalVersion;
+    int newRecordCount = 0;
+    for (const auto& [batchId, batch] : batches) {
+        for (const Step& step : batch)
+            stream << batchId << static_cast<quint8>(step.kind) << step.path << step.originalPath;
+        newRecordCount += static_cast<int>(batch.size());
+    }
+    if (stream.status() == QDataStream::Ok && file.commit())
+        recordCount = newRecordCount;
+}
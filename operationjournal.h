@@ -0,0 +1,57 @@
+#pragma once
+#include <QString>
+#include <deque>
+#include <optional>
+#include <vector>
+
+
+enum class EJournalStep : quint8 {
+    // path was moved away from originalPath; undone by moving it back.
+    // Covers renames and files moved to the trash.
+    MOVE,
+    // path was created; undone by moving it to the trash.
+    CREATE,
+    // path was deleted for good; undoing it only reports that.
+    REMOVE,
+};
+
+
+// Append-only journal of reversible file operations, grouped into batches
+// (one per user command). Records are appended as operations complete, so
+// the journal survives crashes; it is read back on the first undo and
+// rewritten to the most recent batches once it grows too long. Undoing a
+// batch only renames or trashes, newest step first; permanent deletions
+// are kept in order too, so undoing past one says it cannot be restored.
+class OperationJournal {
+public:
+    struct Step {
+        EJournalStep kind;
+        QString path;
+        QString originalPath;
+    };
+    using Batch = std::vector<Step>;
+
+    explicit OperationJournal(QString filePath = getDefaultPath());
+
+    void record(Batch);
+    std::optional<Batch> takeLastBatch();
+
+    // Returns the steps that could not be undone, in their original order.
+    // error may be set even when all were, to report permanent deletions.
+    static Batch undo(const Batch&, QString& error);
+    static QString getDefaultPath();
+
+private:
+    void ensureLoaded();
+    void append(quint64 batchId, const Batch&);
+    void appendUndoMarker(quint64 batchId);
+    bool needsCompaction() const;
+    void compact();
+
+private:
+    QString filePath;
+    std::deque<std::pair<quint64, Batch>> batches;
+    quint64 lastBatchId;
+    int recordCount;
+    bool loaded;
+};
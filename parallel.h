@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+inline size_t getWorkerCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+// Calls function(i) for every i in [0, count) on up to maxThreadCount
+// threads. Indices are handed out one at a time, so uneven work items
+// (small and huge files) still balance well.
+template<typename Function>
+void parallelFor(size_t count, size_t maxThreadCount, Function function)
+{
+    const size_t threadCount = std::min(count, maxThreadCount);
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    std::atomic_size_t next{0};
+    const auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+            function(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+
+// Spreads the indices over all cores.
+template<typename Function>
+void parallelFor(size_t count, Function function)
+{
+    parallelFor(count, getWorkerCount(), std::move(function));
+}
+
+
+// Calls function(begin, end) for consecutive ranges covering [0, count),
+// one range per core unless that would make ranges shorter than minChunkSize.
+template<typename Function>
+void parallelForChunks(size_t count, size_t minChunkSize, Function function)
+{
+    const size_t chunkCount = std::max<size_t>(1, std::min(getWorkerCount(), count / std::max<size_t>(1, minChunkSize)));
+    parallelFor(chunkCount, [&](size_t chunk) {
+        function(count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+    });
+}
+
+
+// Sorts one range per core and merges neighbouring ranges pairwise,
+// with all merges of a round running in parallel.
+template<typename Iterator, typename Compare>
+void parallelSort(Iterator first, Iterator last, Compare compare)
+{
+    constexpr size_t minChunkSize = 4096;
+    const size_t count = static_cast<size_t>(last - first);
+    const size_t chunkCount = std::min(getWorkerCount(), count / minChunkSize);
+    if (chunkCount <= 1) {
+        std::sort(first, last, compare);
+        return;
+    }
+
+    std::vector<size_t> bounds(chunkCount + 1);
+    for (size_t i = 0; i <= chunkCount; ++i)
+        bounds[i] = count * i / chunkCount;
+
+    parallelFor(chunkCount, [&](size_t chunk) {
+        std::sort(first + bounds[chunk], first + bounds[chunk + 1], compare);
+    });
+    for (size_t width = 1; width < chunkCount; width *= 2) {
+        const size_t mergeCount = (chunkCount + 2 * width - 1) / (2 * width);
+        parallelFor(mergeCount, [&](size_t merge) {
+            const size_t low = merge * 2 * width;
+            const size_t middle = std::min(low + width, chunkCount);
+            const size_t high = std::min(low + 2 * width, chunkCount);
+            if (middle < high)
+                std::inplace_merge(first + bounds[low], first + bounds[middle], first + bounds[high], compare);
+        });
+    }
+}
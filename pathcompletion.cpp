@@ -0,0 +1,106 @@
+#include "pathcompletion.h"
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include "util.h"
+#include "vfs.h"
+
+
+// Tries are charged in KiB.
+constexpr int maxCachedTrieKib = 16 * 1024;
+
+#ifdef Q_OS_WIN
+constexpr Qt::CaseSensitivity pathCaseSensitivity = Qt::CaseInsensitive;
+#else
+constexpr Qt::CaseSensitivity pathCaseSensitivity = Qt::CaseSensitive;
+#endif
+
+
+PathCompletion::PathCompletion(const IListingCache& newListingCache)
+    : listingCache(&newListingCache)
+    , tries(maxCachedTrieKib)
+{
+    listingRunner.setMaxThreadCount(1);
+}
+
+void PathCompletion::complete(const QString& baseDir, const QString& partialPath, Done done)
+{
+    const int separator = partialPath.lastIndexOf('/');
+    const QString dirPart = partialPath.left(separator + 1);
+    const QString namePrefix = partialPath.mid(separator + 1);
+    const QString dirPath = QDir::cleanPath(QFileInfo(dirPart).isRelative() ? baseDir / dirPart : dirPart);
+
+    const auto finish = [dirPart, namePrefix](const PathTrie& trie, const Done& done) {
+        QStringList result = trie.complete(namePrefix);
+        for (QString& name : result)
+            name.prepend(dirPart);
+        done(std::move(result));
+    };
+
+    listingRunner.cancel();
+    if (const PathTrie* trie = findTrie(dirPath)) {
+        finish(*trie, done);
+        return;
+    }
+    listingRunner.run([dirPath](const std::atomic_bool& cancelled) {
+        return readListing(dirPath, cancelled);
+    }, [this, dirPath, finish, done = std::move(done)](DiskListing listing) {
+        auto* cached = new CachedTrie{PathTrie(pathCaseSensitivity), std::nullopt, listing.lastModified};
+        for (const QString& name : listing.names)
+            cached->trie.insert(name);
+        finish(*addTrie(dirPath, cached), done);
+    });
+}
+
+void PathCompletion::cancel()
+{
+    listingRunner.cancel();
+}
+
+const PathTrie* PathCompletion::findTrie(const QString& dirPath)
+{
+    // A trie built from an in-memory listing is rebuilt when that listing
+    // has changed since, or is read from disk once it has left memory; one
+    // read from disk is rebuilt when the directory has been modified since.
+    const std::optional<quint64> generation = listingCache->getListingGeneration(dirPath);
+    if (const CachedTrie* cached = tries.object(dirPath)) {
+        if (generation ? generation == cached->sourceGeneration
+                       : cached->sourceModified && cached->sourceModified == getLastModified(dirPath, true))
+            return &cached->trie;
+    }
+    if (!generation)
+        return nullptr;
+
+    auto* cached = new CachedTrie{PathTrie(pathCaseSensitivity), generation, std::nullopt};
+    listingCache->visitCachedListing(dirPath, [cached](const QString& name) {
+        cached->trie.insert(name);
+    });
+    return addTrie(dirPath, cached);
+}
+
+const PathTrie* PathCompletion::addTrie(const QString& dirPath, CachedTrie* cached)
+{
+    const PathTrie* trie = &cached->trie;
+    const auto cost = static_cast<int>(std::min<qint64>(trie->getByteCount() / 1024 + 1, maxCachedTrieKib));
+    tries.insert(dirPath, cached, cost);
+    return trie;
+}
+
+std::optional<qint64> PathCompletion::getLastModified(const QString& dirPath, bool quick)
+{
+    IVfs& vfs = Vfs::get();
+    const std::optional<VfsStat> stat = quick ? vfs.statQuick(dirPath) : vfs.stat(dirPath);
+    return stat ? std::optional<qint64>(stat->lastModified) : std::nullopt;
+}
+
+PathCompletion::DiskListing PathCompletion::readListing(const QString& dirPath, const std::atomic_bool& cancelled)
+{
+    // Taken before listing, so changes made meanwhile count as newer.
+    DiskListing result{{}, getLastModified(dirPath, false)};
+    QString error;
+    for (const VfsStat& stat : Vfs::get().list(dirPath, cancelled, error))
+        result.names.push_back(stat.isDir ? stat.name + '/' : stat.name);
+    if (!error.isEmpty())
+        result.lastModified.reset();
+    return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <QCache>
+#include <QStringList>
+#include <functional>
+#include <optional>
+#include "pathtrie.h"
+#include "taskrunner.h"
+
+
+struct IListingCache {
+    // Changes whenever a listing in memory changes; empty when dirPath is
+    // not in memory.
+    virtual std::optional<quint64> getListingGeneration(const QString& dirPath) const = 0;
+    // Passes each name in dirPath, with a trailing '/' on directories.
+    virtual void visitCachedListing(const QString& dirPath, const std::function<void(const QString&)>& visit) const = 0;
+};
+
+
+// Completes path arguments. Each directory's names go into a PathTrie that
+// is kept across completions, within a memory budget, so cycling and typing
+// deeper components only builds tries for directories not seen before.
+// Listings come from the view's in-memory caches when available, and a trie
+// built from one is rebuilt only when the cache reports a new generation;
+// other directories are listed on a worker thread and completed once the
+// listing arrives, and their tries are rebuilt once the directory's
+// modification time changes.
+class PathCompletion {
+public:
+    using Done = std::function<void(QStringList)>;
+
+    explicit PathCompletion(const IListingCache&);
+
+    // Calls done right away when the directory is known, and later, on
+    // the GUI thread, when it has to be listed first.
+    void complete(const QString& baseDir, const QString& partialPath, Done done);
+    // Drops a completion still waiting for its listing.
+    void cancel();
+
+private:
+    struct CachedTrie {
+        PathTrie trie;
+        std::optional<quint64> sourceGeneration;
+        std::optional<qint64> sourceModified;
+    };
+
+    struct DiskListing {
+        QStringList names;
+        std::optional<qint64> lastModified;
+    };
+
+    const PathTrie* findTrie(const QString& dirPath);
+    const PathTrie* addTrie(const QString& dirPath, CachedTrie*);
+    static std::optional<qint64> getLastModified(const QString& dirPath, bool quick);
+    static DiskListing readListing(const QString& dirPath, const std::atomic_bool& cancelled);
+
+private:
+    const IListingCache* listingCache;
+    QCache<QString, CachedTrie> tries;
+    TaskRunner listingRunner;
+};
@@ -0,0 +1,94 @@
+#include "pathtrie.h"
+
+
+constexpr quint32 noNode = 0;
+
+
+PathTrie::PathTrie(Qt::CaseSensitivity newCaseSensitivity)
+    : nodes{{noNode, noNode, -1, QChar()}}
+    , caseSensitivity(newCaseSensitivity)
+{
+}
+
+void PathTrie::insert(const QString& name)
+{
+    quint32 node = 0;
+    for (QChar character : toKey(name)) {
+        const quint32 child = findChild(node, character);
+        node = child != noNode ? child : addChild(node, character);
+    }
+    if (nodes[node].nameIndex < 0) {
+        nodes[node].nameIndex = names.size();
+        names.push_back(name);
+    }
+}
+
+QStringList PathTrie::complete(const QString& prefix) const
+{
+    quint32 node = 0;
+    for (QChar character : toKey(prefix)) {
+        node = findChild(node, character);
+        if (node == noNode)
+            return {};
+    }
+
+    QStringList result;
+    if (nodes[node].nameIndex >= 0)
+        result.push_back(names[nodes[node].nameIndex]);
+    std::vector<quint32> stack;
+    if (nodes[node].firstChild != noNode)
+        stack.push_back(nodes[node].firstChild);
+    while (!stack.empty()) {
+        const Node& current = nodes[stack.back()];
+        stack.pop_back();
+        if (current.nextSibling != noNode)
+            stack.push_back(current.nextSibling);
+        if (current.firstChild != noNode)
+            stack.push_back(current.firstChild);
+        if (current.nameIndex >= 0)
+            result.push_back(names[current.nameIndex]);
+    }
+    return result;
+}
+
+int PathTrie::getNameCount() const
+{
+    return names.size();
+}
+
+qint64 PathTrie::getByteCount() const
+{
+    qint64 bytes = static_cast<qint64>(nodes.capacity() * sizeof(Node));
+    for (const QString& name : names)
+        bytes += static_cast<qint64>(sizeof(QString)) + name.size() * 2;
+    return bytes;
+}
+
+QString PathTrie::toKey(const QString& name) const
+{
+    return caseSensitivity == Qt::CaseSensitive ? name : name.toCaseFolded();
+}
+
+quint32 PathTrie::findChild(quint32 node, QChar character) const
+{
+    for (quint32 child = nodes[node].firstChild; child != noNode; child = nodes[child].nextSibling) {
+        if (nodes[child].character == character)
+            return child;
+        if (nodes[child].character > character)
+            break;
+    }
+    return noNode;
+}
+
+quint32 PathTrie::addChild(quint32 node, QChar character)
+{
+    const quint32 child = static_cast<quint32>(nodes.size());
+    nodes.push_back({noNode, noNode, -1, character});
+
+    quint32* link = &nodes[node].firstChild;
+    while (*link != noNode && nodes[*link].character < character)
+        link = &nodes[*link].nextSibling;
+    nodes[child].nextSibling = *link;
+    *link = child;
+    return child;
+}
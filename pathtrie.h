@@ -0,0 +1,35 @@
+#pragma once
+#include <QStringList>
+#include <vector>
+
+
+// Prefix trie over the names of one directory. Nodes are kept in a single
+// vector and linked through first-child/next-sibling indexes, with siblings
+// ordered by character, so completions come out sorted without a sort.
+class PathTrie {
+public:
+    explicit PathTrie(Qt::CaseSensitivity);
+
+    void insert(const QString& name);
+    QStringList complete(const QString& prefix) const;
+    int getNameCount() const;
+    // Approximate memory held by the nodes and names.
+    qint64 getByteCount() const;
+
+private:
+    struct Node {
+        quint32 firstChild;
+        quint32 nextSibling;
+        qint32 nameIndex;
+        QChar character;
+    };
+
+    QString toKey(const QString&) const;
+    quint32 findChild(quint32 node, QChar) const;
+    quint32 addChild(quint32 node, QChar);
+
+private:
+    std::vector<Node> nodes;
+    QStringList names;
+    Qt::CaseSensitivity caseSensitivity;
+};
@@ -14,3 +14,12 @@ void Platform::open(const wchar_t* path)
     info.nShow = SW_SHOWNORMAL;
     ShellExecuteExW(&info);
 }
+
+bool Platform::renameNoReplace(const QString& from, const QString& to, QString& error)
+{
+    // Without MOVEFILE_REPLACE_EXISTING the move fails if the target exists.
+    if (MoveFileExW(from.toStdWString().c_str(), to.toStdWString().c_str(), 0))
+        return true;
+    error = QString("Cannot rename %1 to %2 (error %3)").arg(from, to).arg(GetLastError());
+    return false;
+}
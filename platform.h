@@ -4,4 +4,6 @@
 class Platform {
 public:
     static void open(const wchar_t* path);
+    // Renames without ever replacing an existing destination.
+    static bool renameNoReplace(const QString& from, const QString& to, QString& error);
 };
@@ -0,0 +1,49 @@
+#include "platform.h"
+
+#include <QFile>
+#include <QProcess>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+void Platform::open(const wchar_t* path)
+{
+#ifdef Q_OS_MACOS
+    const QString opener = "open";
+#else
+    const QString opener = "xdg-open";
+#endif
+    QProcess::startDetached(opener, {QString::fromWCharArray(path)});
+}
+
+bool Platform::renameNoReplace(const QString& from, const QString& to, QString& error)
+{
+    const QByteArray fromPath = QFile::encodeName(from);
+    const QByteArray toPath = QFile::encodeName(to);
+#if defined(Q_OS_LINUX) && defined(SYS_renameat2)
+    // renameat2 checks and renames atomically; filesystems that do not
+    // support RENAME_NOREPLACE fall through to the racy check below.
+    constexpr unsigned renameNoReplaceFlag = 1;
+    if (syscall(SYS_renameat2, AT_FDCWD, fromPath.constData(), AT_FDCWD, toPath.constData(), renameNoReplaceFlag) == 0)
+        return true;
+    if (errno != EINVAL && errno != ENOSYS) {
+        error = QString("Cannot rename %1 to %2: %3").arg(from, to, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+#endif
+    if (QFile::exists(to)) {
+        error = QString("Cannot rename %1 to %2: target exists").arg(from, to);
+        return false;
+    }
+    if (std::rename(fromPath.constData(), toPath.constData()) != 0) {
+        error = QString("Cannot rename %1 to %2: %3").arg(from, to, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+
+enum class EPreviewMode {
+    OFF,
+    AUTO, // hex for files that look binary, text otherwise
+    TEXT,
+    HEX,
+};
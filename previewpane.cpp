@@ -0,0 +1,404 @@
+#include "previewpane.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QLocale>
+#include <QPainter>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <algorithm>
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "vfs.h"
+
+
+constexpr int debounceDelay = 120;
+constexpr int indexProgressInterval = 250;
+constexpr int scrollResolution = 100000;
+constexpr int wheelUnitsPerRow = 40;
+constexpr qint64 sniffSize = 8192;
+constexpr qint64 hexRowSize = 16;
+// Bytes of a line put on screen; the rest is past the right edge anyway.
+constexpr qint64 maxDisplayedLineSize = 4096;
+constexpr int margin = 4;
+
+
+PreviewPane::PreviewPane(QWidget* parent)
+    : QAbstractScrollArea(parent)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::NoFocus);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    verticalScrollBar()->setRange(0, scrollResolution);
+    verticalScrollBar()->setPageStep(scrollResolution / 50);
+
+    debounceTimer.setSingleShot(true);
+    debounceTimer.setInterval(debounceDelay);
+    QObject::connect(&debounceTimer, &QTimer::timeout, this, [this] { load(path); });
+    indexProgressTimer.setInterval(indexProgressInterval);
+    QObject::connect(&indexProgressTimer, &QTimer::timeout, this, [this] {
+        if (!topLine)
+            updateTopLine();
+        viewport()->update();
+    });
+    // A cancelled load can still be finishing a read while the next one
+    // starts.
+    loadRunner.setMaxThreadCount(2);
+}
+
+void PreviewPane::setPath(const QString& newPath)
+{
+    if (newPath == path && !showingImage)
+        return;
+    path = newPath;
+    // Restarted on every cursor move, so holding j loads nothing until
+    // the cursor stops.
+    if (isVisible())
+        debounceTimer.start();
+}
+
+void PreviewPane::showImage(const QString& imagePath, const ThumbnailCache::Thumbnail* thumbnail)
+{
+    if (!showingImage || imagePath != shownPath)
+        load({});
+    path = imagePath;
+    shownPath = imagePath;
+    showingImage = true;
+    image = thumbnail ? thumbnail->pixmap : QPixmap();
+    imageSize = thumbnail ? thumbnail->originalSize : QSize();
+    message = !thumbnail ? tr("Loading...") : image.isNull() ? tr("Cannot decode the image") : QString();
+    viewport()->update();
+}
+
+void PreviewPane::setMode(EPreviewMode newMode)
+{
+    mode = newMode;
+    updateHexMode();
+}
+
+bool PreviewPane::scrollToLine(qint64 line)
+{
+    if (!file || !lineIndex)
+        return false;
+    const std::optional<std::pair<qint64, qint64>> checkpoint = lineIndex->findLine(line);
+    if (!checkpoint)
+        return false;
+    auto [currentLine, offset] = *checkpoint;
+    for (; currentLine < line; ++currentLine)
+        offset = findLineEnd(offset);
+    setTopOffset(hexMode ? offset / hexRowSize * hexRowSize : offset);
+    return true;
+}
+
+void PreviewPane::paintEvent(QPaintEvent*)
+{
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+    const int rowHeight = getRowHeight();
+    const int ascent = fontMetrics().ascent();
+    painter.setPen(palette().color(QPalette::PlaceholderText));
+    painter.drawText(margin, ascent, getHeader());
+    if (showingImage && !image.isNull()) {
+        paintImage(painter, rowHeight);
+        return;
+    }
+    if (!file) {
+        painter.drawText(margin, rowHeight + ascent, message);
+        return;
+    }
+    painter.setPen(palette().color(QPalette::Text));
+    const int rowCount = (viewport()->height() - rowHeight) / rowHeight + 1;
+    if (hexMode)
+        paintHex(painter, rowHeight, rowCount);
+    else
+        paintText(painter, rowHeight, rowCount);
+}
+
+void PreviewPane::wheelEvent(QWheelEvent* event)
+{
+    const int delta = -event->angleDelta().y();
+    scrollRows(delta / wheelUnitsPerRow != 0 ? delta / wheelUnitsPerRow : (delta > 0) - (delta < 0));
+    event->accept();
+}
+
+void PreviewPane::scrollContentsBy(int, int)
+{
+    // Only scrollbar drags get here; setTopOffset() moves the bar with
+    // its signals blocked.
+    if (!file || file->getSize() == 0)
+        return;
+    const qint64 size = file->getSize();
+    const qint64 target = std::min(verticalScrollBar()->value() * size / scrollResolution, size - 1);
+    topOffset = hexMode ? target / hexRowSize * hexRowSize : findRowStart(target);
+    updateTopLine();
+    viewport()->update();
+}
+
+void PreviewPane::showEvent(QShowEvent* event)
+{
+    QAbstractScrollArea::showEvent(event);
+    if (path != shownPath)
+        load(path);
+}
+
+void PreviewPane::hideEvent(QHideEvent* event)
+{
+    QAbstractScrollArea::hideEvent(event);
+    // A hidden pane keeps nothing mapped and scans nothing.
+    load({});
+}
+
+void PreviewPane::load(const QString& filePath)
+{
+    debounceTimer.stop();
+    indexProgressTimer.stop();
+    loadRunner.cancel();
+    const quint64 loadGeneration = ++generation;
+    shownPath = filePath;
+    showingImage = false;
+    image = QPixmap();
+    file.reset();
+    lineIndex.reset();
+    isBinary = false;
+    updateHexMode();
+    message = shownPath.isEmpty() ? QString() : tr("Loading...");
+    if (shownPath.isEmpty())
+        return;
+
+    auto index = std::make_shared<LineIndex>();
+    loadRunner.run([this, filePath, index, loadGeneration](const std::atomic_bool& cancelled) {
+        const std::optional<VfsStat> stat = Vfs::get().stat(filePath);
+        if (!stat)
+            return QString("Cannot read %1").arg(filePath);
+        if (stat->isDir)
+            return QString("Directory");
+        QString error;
+        const std::shared_ptr<MappedFile> opened = MappedFile::open(filePath, error);
+        if (!opened)
+            return error;
+        const bool looksBinary = opened->peek(0, sniffSize).contains('\0');
+        const QString localPath = opened->getFileName();
+        loadRunner.post([this, opened, index, looksBinary, loadGeneration] {
+            if (loadGeneration != generation)
+                return;
+            file = opened;
+            isBinary = looksBinary;
+            if (!looksBinary) {
+                lineIndex = index;
+                indexProgressTimer.start();
+            }
+            updateHexMode();
+        });
+        if (looksBinary || cancelled)
+            return QString();
+
+        // The scan reads through its own handle, so it never evicts the
+        // windows on screen.
+        std::unique_ptr<QIODevice> device;
+        if (!localPath.isEmpty()) {
+            auto localFile = std::make_unique<QFile>(localPath);
+            if (localFile->open(QIODevice::ReadOnly))
+                device = std::move(localFile);
+        } else {
+            device = Vfs::get().open(filePath, QIODevice::ReadOnly, error);
+        }
+        if (!device || (!index->build(*device, cancelled) && !cancelled))
+            return QString("Cannot index %1").arg(filePath);
+        return QString();
+    }, [this, loadGeneration](QString error) {
+        if (loadGeneration != generation)
+            return;
+        indexProgressTimer.stop();
+        message = error;
+        if (!topLine)
+            updateTopLine();
+        viewport()->update();
+    });
+}
+
+void PreviewPane::updateHexMode()
+{
+    hexMode = mode == EPreviewMode::HEX || (mode == EPreviewMode::AUTO && isBinary);
+    if (!file)
+        setTopOffset(0);
+    else
+        setTopOffset(hexMode ? topOffset / hexRowSize * hexRowSize : findRowStart(topOffset));
+}
+
+void PreviewPane::setTopOffset(qint64 offset)
+{
+    const qint64 size = file ? file->getSize() : 0;
+    topOffset = std::clamp<qint64>(offset, 0, std::max<qint64>(size - 1, 0));
+    {
+        const QSignalBlocker blocker(verticalScrollBar());
+        verticalScrollBar()->setValue(size > 0 ? static_cast<int>(topOffset * scrollResolution / size) : 0);
+    }
+    updateTopLine();
+    viewport()->update();
+}
+
+void PreviewPane::updateTopLine()
+{
+    topLine.reset();
+    if (!file || !lineIndex)
+        return;
+    const std::optional<std::pair<qint64, qint64>> checkpoint = lineIndex->findOffset(topOffset);
+    if (!checkpoint)
+        return;
+    // Checkpoints are at most a megabyte apart, so this scan stays short
+    // enough for the GUI thread.
+    auto [line, offset] = *checkpoint;
+    while (offset < topOffset) {
+        const QByteArray bytes = file->peek(offset, topOffset - offset);
+        if (bytes.isEmpty())
+            return;
+        line += LineIndex::countNewlines(bytes.constData(), bytes.size());
+        offset += bytes.size();
+    }
+    topLine = line;
+}
+
+void PreviewPane::scrollRows(int rowCount)
+{
+    if (!file)
+        return;
+    qint64 offset = topOffset;
+    for (; rowCount > 0; --rowCount) {
+        const qint64 next = hexMode ? offset + hexRowSize : findNextRow(offset);
+        if (next >= file->getSize())
+            break;
+        offset = next;
+    }
+    for (; rowCount < 0 && offset > 0; ++rowCount)
+        offset = hexMode ? offset - hexRowSize : findRowStart(offset - 1);
+    setTopOffset(offset);
+}
+
+qint64 PreviewPane::findNextRow(qint64 offset, bool* endsLine)
+{
+    // Lines longer than a peek are shown as several rows, so a row never
+    // costs more than one bounded read.
+    const QByteArray bytes = file->peek(offset, MappedFile::maxPeekSize);
+    const int newline = bytes.indexOf('\n');
+    if (endsLine)
+        *endsLine = newline >= 0;
+    return offset + (newline >= 0 ? newline + 1 : bytes.size());
+}
+
+qint64 PreviewPane::findRowStart(qint64 offset)
+{
+    if (offset <= 0)
+        return 0;
+    const qint64 begin = std::max<qint64>(0, offset - MappedFile::maxPeekSize);
+    const QByteArray bytes = file->peek(begin, offset - begin);
+    const int newline = bytes.lastIndexOf('\n');
+    return newline >= 0 ? begin + newline + 1 : begin;
+}
+
+qint64 PreviewPane::findLineEnd(qint64 offset)
+{
+    for (;;) {
+        const QByteArray bytes = file->peek(offset, MappedFile::maxPeekSize);
+        if (bytes.isEmpty())
+            return offset;
+        if (const int newline = bytes.indexOf('\n'); newline >= 0)
+            return offset + newline + 1;
+        offset += bytes.size();
+    }
+}
+
+int PreviewPane::getRowHeight() const
+{
+    return fontMetrics().height();
+}
+
+QString PreviewPane::getHeader() const
+{
+    if (shownPath.isEmpty())
+        return {};
+    QString header = QFileInfo(shownPath).fileName();
+    if (showingImage && imageSize.isValid())
+        return header + QString("  %1x%2").arg(imageSize.width()).arg(imageSize.height());
+    if (!file)
+        return header;
+    header += "  " + QLocale().formattedDataSize(file->getSize());
+    if (hexMode) {
+        header += "  hex";
+    } else if (lineIndex) {
+        if (const std::optional<qint64> lineCount = lineIndex->getLineCount())
+            header += tr("  %L1 lines").arg(*lineCount);
+        else if (file->getSize() > 0)
+            header += tr("  indexing %1%").arg(lineIndex->getIndexedSize() * 100 / file->getSize());
+    }
+    return header;
+}
+
+void PreviewPane::paintText(QPainter& painter, int top, int rowCount)
+{
+    const QFontMetrics& metrics = fontMetrics();
+    const int ascent = metrics.ascent();
+    const int gutterWidth = topLine
+        ? metrics.horizontalAdvance(QString::number(*topLine + rowCount)) + 2 * metrics.horizontalAdvance(' ')
+        : 0;
+    const QColor textColor = palette().color(QPalette::Text);
+    const QColor lineNumberColor = palette().color(QPalette::PlaceholderText);
+    qint64 line = topLine.value_or(0);
+    qint64 offset = topOffset;
+    bool startsLine = true;
+    for (int row = 0; row < rowCount && offset < file->getSize(); ++row) {
+        bool endsLine = false;
+        const qint64 next = findNextRow(offset, &endsLine);
+        const int y = top + row * getRowHeight() + ascent;
+        if (topLine && startsLine) {
+            painter.setPen(lineNumberColor);
+            painter.drawText(QRect(0, y - ascent, gutterWidth - metrics.horizontalAdvance(' '), getRowHeight()),
+                             Qt::AlignRight | Qt::AlignVCenter, QString::number(line + 1));
+            painter.setPen(textColor);
+        }
+        QString text = QString::fromUtf8(file->peek(offset, std::min(next - offset, maxDisplayedLineSize)));
+        while (text.endsWith('\n') || text.endsWith('\r'))
+            text.chop(1);
+        text.replace('\t', "    ");
+        painter.drawText(margin + gutterWidth, y, text);
+        startsLine = endsLine;
+        line += endsLine ? 1 : 0;
+        offset = next;
+    }
+}
+
+void PreviewPane::paintHex(QPainter& painter, int top, int rowCount)
+{
+    const int ascent = fontMetrics().ascent();
+    for (int row = 0; row < rowCount; ++row) {
+        const qint64 offset = topOffset + row * hexRowSize;
+        const QByteArray bytes = file->peek(offset, hexRowSize);
+        if (bytes.isEmpty())
+            break;
+        QString text = QString("%1 ").arg(offset, 12, 16, QChar('0'));
+        QString printable;
+        for (int i = 0; i < hexRowSize; ++i) {
+            if (i % 8 == 0)
+                text += ' ';
+            if (i < bytes.size()) {
+                const auto byte = static_cast<uchar>(bytes[i]);
+                text += QString("%1 ").arg(static_cast<uint>(byte), 2, 16, QChar('0'));
+                printable += byte >= 0x20 && byte < 0x7f ? QChar(byte) : QChar('.');
+            } else {
+                text += "   ";
+            }
+        }
+        painter.drawText(margin, top + row * getRowHeight() + ascent, text + " |" + printable + '|');
+    }
+}
+
+void PreviewPane::paintImage(QPainter& painter, int top)
+{
+    // Scaled down to fit, never up past the thumbnail's own pixels.
+    const QRect area = viewport()->rect().adjusted(margin, top, -margin, -margin);
+    const QSize size = image.size().boundedTo(area.size()) == image.size()
+        ? image.size()
+        : image.size().scaled(area.size(), Qt::KeepAspectRatio);
+    const QRect target(area.x() + (area.width() - size.width()) / 2, area.y(), size.width(), size.height());
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawPixmap(target, image);
+}
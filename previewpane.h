@@ -0,0 +1,79 @@
+#pragma once
+#include <QAbstractScrollArea>
+#include <QTimer>
+#include <memory>
+#include <optional>
+#include "previewmode.h"
+#include "taskrunner.h"
+#include "thumbnailcache.h"
+
+
+class MappedFile;
+class LineIndex;
+
+
+// Read-only view of the file under the cursor, as text or as a hex dump.
+// Nothing is read until the cursor has rested on a file for a moment, and
+// a load still running for the previous file is cancelled. Only the rows
+// on screen are read, through a windowed mapping, so memory stays bounded
+// for files of any size; text files get a line index built in the
+// background, which numbers the rows and makes jumping to a line instant
+// once the scan has passed it. Scrolling is by byte offset, so the
+// scrollbar works before the line count is known. Images are shown from
+// thumbnails the owner gets decoded.
+class PreviewPane : public QAbstractScrollArea {
+    Q_OBJECT
+
+public:
+    explicit PreviewPane(QWidget* parent = nullptr);
+
+    void setPath(const QString& path);
+    // Shows a thumbnail instead of the file's bytes; null while it is
+    // still being decoded.
+    void showImage(const QString& imagePath, const ThumbnailCache::Thumbnail*);
+    // OFF is up to the owner, which hides the pane.
+    void setMode(EPreviewMode);
+    // Lines count from 0. Fails while the index has not reached the line.
+    bool scrollToLine(qint64 line);
+
+protected:
+    void paintEvent(QPaintEvent*) override;
+    void wheelEvent(QWheelEvent*) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void showEvent(QShowEvent*) override;
+    void hideEvent(QHideEvent*) override;
+
+private:
+    void load(const QString& filePath);
+    void updateHexMode();
+    void setTopOffset(qint64);
+    void updateTopLine();
+    void scrollRows(int rowCount);
+    qint64 findNextRow(qint64 offset, bool* endsLine = nullptr);
+    qint64 findRowStart(qint64 offset);
+    qint64 findLineEnd(qint64 offset);
+    int getRowHeight() const;
+    QString getHeader() const;
+    void paintText(QPainter&, int top, int rowCount);
+    void paintHex(QPainter&, int top, int rowCount);
+    void paintImage(QPainter&, int top);
+
+private:
+    QString path;
+    QString shownPath;
+    std::shared_ptr<MappedFile> file;
+    std::shared_ptr<LineIndex> lineIndex;
+    QString message;
+    QPixmap image;
+    QSize imageSize;
+    bool showingImage = false;
+    qint64 topOffset = 0;
+    std::optional<qint64> topLine;
+    EPreviewMode mode = EPreviewMode::AUTO;
+    bool isBinary = false;
+    bool hexMode = false;
+    quint64 generation = 0;
+    QTimer debounceTimer;
+    QTimer indexProgressTimer;
+    TaskRunner loadRunner;
+};
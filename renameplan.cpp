@@ -0,0 +1,123 @@
+#include "renameplan.h"
+#include <QHash>
+#include <QSet>
+#include <algorithm>
+#include "vfs.h"
+
+
+#ifdef Q_OS_WIN
+constexpr Qt::CaseSensitivity nameCaseSensitivity = Qt::CaseInsensitive;
+#else
+constexpr Qt::CaseSensitivity nameCaseSensitivity = Qt::CaseSensitive;
+#endif
+
+
+bool RenamePlan::build(std::vector<Step> renames, QString& error)
+{
+    steps.clear();
+    renames.erase(std::remove_if(renames.begin(), renames.end(), [](const Step& rename) {
+        return rename.from == rename.to;
+    }), renames.end());
+    renameCount = renames.size();
+
+    QHash<QString, int> renameBySource;
+    QSet<QString> targets;
+    renameBySource.reserve(static_cast<int>(renames.size()));
+    for (int i = 0; i < static_cast<int>(renames.size()); ++i)
+        renameBySource.insert(renames[static_cast<size_t>(i)].from, i);
+    for (const Step& rename : renames) {
+        if (targets.contains(rename.to)) {
+            error = QString("%1 is the target of more than one rename").arg(rename.to);
+            return false;
+        }
+        targets.insert(rename.to);
+        // On a case-insensitive file system the target of a case-only
+        // rename is the source itself.
+        const bool changesCaseOnly = rename.to.compare(rename.from, nameCaseSensitivity) == 0;
+        if (!changesCaseOnly && !renameBySource.contains(rename.to) && Vfs::get().stat(rename.to)) {
+            error = QString("%1 already exists").arg(rename.to);
+            return false;
+        }
+    }
+
+    // blockers[i] is the rename whose source is the target of rename i, so
+    // it has to run first. Targets are unique, so every rename blocks at
+    // most one other and the renames form separate chains and cycles.
+    std::vector<int> blockers(renames.size());
+    for (size_t i = 0; i < renames.size(); ++i)
+        blockers[i] = renameBySource.value(renames[i].to, -1);
+
+    std::vector<bool> scheduled(renames.size(), false);
+    std::vector<int> chain;
+    for (int first = 0; first < static_cast<int>(renames.size()); ++first) {
+        if (scheduled[static_cast<size_t>(first)])
+            continue;
+        chain.assign(1, first);
+        int current = blockers[static_cast<size_t>(first)];
+        while (current >= 0 && current != first && !scheduled[static_cast<size_t>(current)]) {
+            chain.push_back(current);
+            current = blockers[static_cast<size_t>(current)];
+        }
+
+        const bool isCycle = current == first;
+        QString parkedPath;
+        if (isCycle) {
+            parkedPath = makeTemporaryPath(renames[static_cast<size_t>(first)].from);
+            steps.push_back({renames[static_cast<size_t>(first)].from, parkedPath});
+        }
+        for (auto i = chain.rbegin(); i != chain.rend(); ++i) {
+            scheduled[static_cast<size_t>(*i)] = true;
+            const Step& rename = renames[static_cast<size_t>(*i)];
+            if (isCycle && *i == first)
+                steps.push_back({parkedPath, rename.to});
+            else
+                steps.push_back(rename);
+        }
+    }
+    return true;
+}
+
+bool RenamePlan::apply(const std::atomic_bool& cancelled, QString& error)
+{
+    for (size_t i = 0; i < steps.size(); ++i) {
+        if (cancelled)
+            error = "Rename cancelled";
+        else if (Vfs::get().rename(steps[i].from, steps[i].to, error))
+            continue;
+        const QStringList stranded = rollBack(i);
+        if (!stranded.isEmpty())
+            error += QString("; could not restore %1").arg(stranded.join(", "));
+        return false;
+    }
+    return true;
+}
+
+const std::vector<RenamePlan::Step>& RenamePlan::getSteps() const
+{
+    return steps;
+}
+
+size_t RenamePlan::getRenameCount() const
+{
+    return renameCount;
+}
+
+QString RenamePlan::makeTemporaryPath(const QString& path)
+{
+    for (int i = 0;; ++i) {
+        const QString candidate = QString("%1.fm-rename-%2").arg(path).arg(i);
+        if (!Vfs::get().stat(candidate))
+            return candidate;
+    }
+}
+
+QStringList RenamePlan::rollBack(size_t stepCount)
+{
+    QStringList stranded;
+    QString ignored;
+    for (size_t i = stepCount; i > 0; --i) {
+        if (!Vfs::get().rename(steps[i - 1].to, steps[i - 1].from, ignored))
+            stranded.push_back(steps[i - 1].to);
+    }
+    return stranded;
+}
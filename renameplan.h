@@ -0,0 +1,32 @@
+#pragma once
+#include <QStringList>
+#include <atomic>
+#include <vector>
+
+
+// Orders a batch of renames so that no step ever overwrites a file. Chains
+// (a->b while b->c) run back to front and cycles (a->b, b->a) are broken by
+// parking one file under a temporary name. Applying stops at the first
+// failure and undoes the steps already taken, newest first; files that
+// cannot be moved back are named in the error.
+class RenamePlan {
+public:
+    struct Step {
+        QString from;
+        QString to;
+    };
+
+    bool build(std::vector<Step> renames, QString& error);
+    bool apply(const std::atomic_bool& cancelled, QString& error);
+    const std::vector<Step>& getSteps() const;
+    size_t getRenameCount() const;
+
+private:
+    static QString makeTemporaryPath(const QString& path);
+    // Returns the paths left under their new or temporary names.
+    QStringList rollBack(size_t stepCount);
+
+private:
+    std::vector<Step> steps;
+    size_t renameCount = 0;
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+
+enum class ESortMode {
+    NAME,
+    NATURAL,
+    EXTENSION,
+    SIZE,
+    MTIME,
+};
@@ -0,0 +1,43 @@
+#include "startupprofiler.h"
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+bool profilingEnabled = false;
+QElapsedTimer timer;
+qint64 lastMarkTime = 0;
+std::vector<std::pair<const char*, qint64>> phases;
+
+}
+
+
+void StartupProfiler::start(bool enabled)
+{
+    profilingEnabled = enabled;
+    if (enabled)
+        timer.start();
+}
+
+void StartupProfiler::mark(const char* phase)
+{
+    if (!profilingEnabled)
+        return;
+    const qint64 now = timer.nsecsElapsed();
+    phases.emplace_back(phase, now - lastMarkTime);
+    lastMarkTime = now;
+}
+
+void StartupProfiler::report()
+{
+    if (!profilingEnabled)
+        return;
+    for (const auto& [phase, duration] : phases)
+        qInfo("%-24s %9.2f ms", phase, duration / 1e6);
+    qInfo("%-24s %9.2f ms", "total", lastMarkTime / 1e6);
+    phases.clear();
+    profilingEnabled = false;
+}
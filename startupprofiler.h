@@ -0,0 +1,11 @@
+#pragma once
+
+
+// Startup timeline printed with --profile-startup.
+// Every mark() closes the phase that began at the previous mark.
+class StartupProfiler {
+public:
+    static void start(bool enabled);
+    static void mark(const char* phase);
+    static void report();
+};
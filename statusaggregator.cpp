@@ -0,0 +1,91 @@
+#include "statusaggregator.h"
+#include <QGuiApplication>
+#include <QScreen>
+#include <QStatusBar>
+#include <algorithm>
+#include <cmath>
+
+
+constexpr qreal defaultRefreshRate = 60;
+
+
+StatusAggregator::StatusAggregator(QStatusBar& newStatusBar, QObject* parent)
+    : QObject(parent)
+    , statusBar(&newStatusBar)
+    , transientPending(false)
+{
+    clock.start();
+    frameTimer.setSingleShot(true);
+    frameTimer.setInterval(getFrameInterval());
+    QObject::connect(&frameTimer, &QTimer::timeout, this, &StatusAggregator::flush);
+    noticeTimer.setSingleShot(true);
+    QObject::connect(&noticeTimer, &QTimer::timeout, this, &StatusAggregator::onNoticeExpired);
+}
+
+void StatusAggregator::post(const QString& message, int secTimeout)
+{
+    Q_ASSERT(secTimeout >= 0);
+    if (secTimeout > 0) {
+        // Posting a notice that is still up extends it instead of showing
+        // it twice.
+        const qint64 expiresAt = clock.elapsed() + qint64(secTimeout) * 1000;
+        const auto iter = std::find_if(notices.begin(), notices.end(), [&message](const Notice& notice) {
+            return notice.message == message;
+        });
+        if (iter != notices.end())
+            iter->expiresAt = std::max(iter->expiresAt, expiresAt);
+        else
+            notices.push_back({message, expiresAt});
+    } else {
+        transientMessage = message;
+        transientPending = true;
+    }
+    if (!frameTimer.isActive())
+        frameTimer.start();
+}
+
+int StatusAggregator::getFrameInterval()
+{
+    const QScreen* screen = QGuiApplication::primaryScreen();
+    const qreal refreshRate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : defaultRefreshRate;
+    return std::max(1, static_cast<int>(std::floor(1000 / refreshRate)));
+}
+
+void StatusAggregator::flush()
+{
+    if (!notices.empty()) {
+        showNotices();
+        return;
+    }
+    if (transientPending) {
+        statusBar->showMessage(transientMessage);
+        transientPending = false;
+    }
+}
+
+void StatusAggregator::onNoticeExpired()
+{
+    const qint64 now = clock.elapsed();
+    notices.erase(std::remove_if(notices.begin(), notices.end(), [now](const Notice& notice) {
+        return notice.expiresAt <= now;
+    }), notices.end());
+    if (!notices.empty()) {
+        showNotices();
+        return;
+    }
+    statusBar->clearMessage();
+    if (transientPending)
+        flush();
+}
+
+void StatusAggregator::showNotices()
+{
+    QStringList messages;
+    qint64 nextExpiry = notices.front().expiresAt;
+    for (const Notice& notice : notices) {
+        messages.push_back(notice.message);
+        nextExpiry = std::min(nextExpiry, notice.expiresAt);
+    }
+    statusBar->showMessage(messages.join(" | "));
+    noticeTimer.start(static_cast<int>(std::max<qint64>(0, nextExpiry - clock.elapsed())));
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <vector>
+
+class QStatusBar;
+
+
+// Merges status messages and writes them to the status bar at most once
+// per display frame. Messages with a timeout are notices (errors, command
+// results): they are never dropped, and notices that overlap in time are
+// shown together, each staying up until its own timeout has passed.
+// Messages without a timeout are transient state (progress, row counts):
+// only the latest one is kept, and it waits until every notice has expired.
+class StatusAggregator : public QObject {
+    Q_OBJECT
+
+public:
+    explicit StatusAggregator(QStatusBar&, QObject* parent = nullptr);
+
+    void post(const QString& message, int secTimeout);
+    // One frame of the primary screen, in milliseconds.
+    static int getFrameInterval();
+
+private:
+    struct Notice {
+        QString message;
+        qint64 expiresAt;
+    };
+
+    void flush();
+    void onNoticeExpired();
+    void showNotices();
+
+private:
+    QStatusBar* statusBar;
+    std::vector<Notice> notices;
+    QElapsedTimer clock;
+    QString transientMessage;
+    bool transientPending;
+    QTimer frameTimer;
+    QTimer noticeTimer;
+};
@@ -0,0 +1,696 @@
+#include "tarindex.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string_view>
+#include "datafilereader.h"
+#include "util.h"
+#ifdef FM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+
+constexpr quint32 indexMagic = 0x464d5449;
+constexpr quint32 indexVersion = 1;
+constexpr qint64 blockSize = 512;
+constexpr qint64 copyChunkSize = 1 << 20;
+// Long names and pax records are a few hundred bytes; anything near this
+// is a corrupt or hostile size field, not a header worth allocating for.
+constexpr qint64 maxExtendedHeaderSize = 1 << 20;
+
+
+namespace {
+
+// The uncompressed tar stream, read front to back.
+class TarStream {
+public:
+    virtual ~TarStream() = default;
+    // Reads size bytes unless the stream ends first.
+    virtual qint64 read(char* data, qint64 size) = 0;
+    virtual bool skip(qint64 size) = 0;
+};
+
+
+class FileStream : public TarStream {
+public:
+    explicit FileStream(QFile& file)
+        : file(file)
+    {}
+
+    qint64 read(char* data, qint64 size) override
+    {
+        return file.read(data, size);
+    }
+
+    // Member data is seeked over, so only the headers are ever read.
+    bool skip(qint64 size) override
+    {
+        return file.seek(file.pos() + size);
+    }
+
+private:
+    QFile& file;
+};
+
+
+#ifdef FM_HAVE_ZLIB
+class GzipStream : public TarStream {
+public:
+    explicit GzipStream(QFile& file)
+        : file(file)
+        , input(static_cast<int>(copyChunkSize), Qt::Uninitialized)
+        , stream{}
+    {
+        // 32 lets zlib detect the gzip header.
+        valid = inflateInit2(&stream, 15 + 32) == Z_OK;
+    }
+
+    ~GzipStream()
+    {
+        if (valid)
+            inflateEnd(&stream);
+    }
+
+    qint64 read(char* data, qint64 size) override
+    {
+        if (!valid)
+            return -1;
+        stream.next_out = reinterpret_cast<Bytef*>(data);
+        stream.avail_out = static_cast<uInt>(size);
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0) {
+                const qint64 readSize = file.read(input.data(), input.size());
+                if (readSize <= 0)
+                    break;
+                stream.next_in = reinterpret_cast<Bytef*>(input.data());
+                stream.avail_in = static_cast<uInt>(readSize);
+            }
+            const int result = inflate(&stream, Z_NO_FLUSH);
+            // Concatenated gzip members (as pigz writes) continue the stream.
+            if (result == Z_STREAM_END) {
+                if (inflateReset(&stream) != Z_OK)
+                    break;
+            } else if (result != Z_OK) {
+                break;
+            }
+        }
+        return size - static_cast<qint64>(stream.avail_out);
+    }
+
+    bool skip(qint64 size) override
+    {
+        QByteArray discarded(static_cast<int>(std::min(size, copyChunkSize)), Qt::Uninitialized);
+        while (size > 0) {
+            const qint64 readSize = read(discarded.data(), std::min<qint64>(size, discarded.size()));
+            if (readSize <= 0)
+                return false;
+            size -= readSize;
+        }
+        return true;
+    }
+
+private:
+    QFile& file;
+    QByteArray input;
+    z_stream stream;
+    bool valid;
+};
+#endif
+
+
+std::unique_ptr<TarStream> openStream(QFile& file, bool compressed, QString& error)
+{
+    if (!compressed)
+        return std::make_unique<FileStream>(file);
+#ifdef FM_HAVE_ZLIB
+    return std::make_unique<GzipStream>(file);
+#else
+    error = QString("%1 is compressed, which this build cannot read").arg(file.fileName());
+    return nullptr;
+#endif
+}
+
+
+// The data of one member, read straight from its offset in the archive.
+// Seeking forward in a compressed archive inflates up to the new offset,
+// seeking backward starts over from the beginning of the archive.
+class MemberDevice : public QIODevice {
+public:
+    MemberDevice(const QString& archivePath, qint64 offset, qint64 size, bool compressed)
+        : file(archivePath)
+        , offset(offset)
+        , memberSize(size)
+        , compressed(compressed)
+    {}
+
+    bool open(QString& error)
+    {
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = QString("Cannot open %1: %2").arg(file.fileName(), file.errorString());
+            return false;
+        }
+        if (!moveTo(0)) {
+            error = QString("%1 is truncated").arg(file.fileName());
+            return false;
+        }
+        // Unbuffered, so the stream is always where pos() says.
+        return QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    qint64 size() const override
+    {
+        return memberSize;
+    }
+
+    bool seek(qint64 pos) override
+    {
+        return pos >= 0 && pos <= memberSize && moveTo(pos) && QIODevice::seek(pos);
+    }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        const qint64 readSize = stream->read(data, std::min(maxSize, offset + memberSize - streamPos));
+        if (readSize > 0)
+            streamPos += readSize;
+        return readSize;
+    }
+
+    qint64 writeData(const char*, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    bool moveTo(qint64 pos)
+    {
+        QString error;
+        const qint64 target = offset + pos;
+        if (!compressed) {
+            if (!stream)
+                stream = openStream(file, false, error);
+            streamPos = target;
+            return file.seek(target);
+        }
+        if (!stream || target < streamPos) {
+            if (!file.seek(0))
+                return false;
+            stream = openStream(file, true, error);
+            streamPos = 0;
+        }
+        if (!stream || !stream->skip(target - streamPos))
+            return false;
+        streamPos = target;
+        return true;
+    }
+
+private:
+    QFile file;
+    std::unique_ptr<TarStream> stream;
+    qint64 offset;
+    qint64 memberSize;
+    qint64 streamPos = 0; // in the uncompressed stream
+    bool compressed;
+};
+
+
+// Octal, or base-256 for values that do not fit (GNU and star).
+qint64 parseNumber(const char* field, int length)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(field);
+    qint64 value = 0;
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x3f;
+        for (int i = 1; i < length; ++i)
+            value = (value << 8) | bytes[i];
+        return value;
+    }
+    int i = 0;
+    while (i < length && (field[i] == ' ' || field[i] == '\0'))
+        ++i;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+QByteArray parseString(const char* field, int length)
+{
+    return QByteArray(field, static_cast<int>(qstrnlen(field, static_cast<uint>(length))));
+}
+
+bool isZeroBlock(const char* header)
+{
+    return std::all_of(header, header + blockSize, [](char byte) { return byte == 0; });
+}
+
+bool isChecksumValid(const char* header)
+{
+    qint64 sum = 0;
+    for (int i = 0; i < blockSize; ++i)
+        sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+    return sum == parseNumber(header + 148, 8);
+}
+
+// Pax records are "<length> <key>=<value>\n".
+void parsePaxRecords(const QByteArray& data, QByteArray& path, qint64& size, qint64& lastModified)
+{
+    int pos = 0;
+    while (pos < data.size()) {
+        const int space = data.indexOf(' ', pos);
+        if (space < 0)
+            break;
+        const int length = data.mid(pos, space - pos).toInt();
+        if (length <= space - pos || pos + length > data.size())
+            break;
+        const QByteArray record = data.mid(space + 1, pos + length - space - 2);
+        const int equals = record.indexOf('=');
+        const QByteArray key = record.left(equals);
+        const QByteArray value = record.mid(equals + 1);
+        if (key == "path")
+            path = value;
+        else if (key == "size")
+            size = value.toLongLong();
+        else if (key == "mtime")
+            lastModified = static_cast<qint64>(value.toDouble());
+        pos += length;
+    }
+}
+
+QByteArray normalizePath(QByteArray path)
+{
+    while (path.startsWith("./"))
+        path.remove(0, 2);
+    while (path.startsWith('/'))
+        path.remove(0, 1);
+    while (path.endsWith('/'))
+        path.chop(1);
+    return path == "." ? QByteArray() : path;
+}
+
+std::string_view toView(const QByteArray& bytes)
+{
+    return {bytes.constData(), static_cast<size_t>(bytes.size())};
+}
+
+
+struct RawMember {
+    qint64 offset;
+    qint64 size;
+    qint64 lastModified;
+    bool isDir;
+};
+// Keyed by (parent path, name): iterating in key order visits every
+// directory's children together and sorted by name.
+using RawMembers = std::map<std::pair<QByteArray, QByteArray>, RawMember>;
+
+std::pair<QByteArray, QByteArray> splitPath(const QByteArray& path)
+{
+    const int slash = path.lastIndexOf('/');
+    if (slash < 0)
+        return {QByteArray(), path};
+    return {path.left(slash), path.mid(slash + 1)};
+}
+
+void addMember(RawMembers& rawMembers, const QByteArray& path, const RawMember& member)
+{
+    // Later headers for the same path replace earlier ones, as they would
+    // on extraction; parents without their own header are made up.
+    rawMembers[splitPath(path)] = member;
+    for (int slash = path.indexOf('/'); slash >= 0; slash = path.indexOf('/', slash + 1)) {
+        const auto [iter, inserted] = rawMembers.try_emplace(splitPath(path.left(slash)), RawMember{-1, -1, member.lastModified, true});
+        if (!iter->second.isDir)
+            iter->second = {-1, -1, member.lastModified, true};
+    }
+}
+
+}
+
+
+bool TarIndex::isArchiveName(QStringView path)
+{
+#ifdef FM_HAVE_ZLIB
+    if (path.endsWith(QLatin1String(".tar.gz"), Qt::CaseInsensitive) || path.endsWith(QLatin1String(".tgz"), Qt::CaseInsensitive))
+        return true;
+#endif
+    return path.endsWith(QLatin1String(".tar"), Qt::CaseInsensitive);
+}
+
+QString TarIndex::getCachePath(const QString& archivePath)
+{
+    const QByteArray key = QCryptographicHash::hash(archivePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) / QString("archives")
+        / QString::fromLatin1(key + ".index");
+}
+
+std::optional<TarIndex> TarIndex::open(const QString& archivePath, const std::atomic_bool& cancelled, QString& error)
+{
+    const QFileInfo info(archivePath);
+    TarIndex index;
+    index.archiveSize = info.size();
+    index.archiveModified = info.lastModified().toMSecsSinceEpoch();
+    const QString cachePath = getCachePath(archivePath);
+    if (index.load(cachePath, archivePath))
+        return index;
+    if (!index.build(archivePath, cancelled, error))
+        return std::nullopt;
+    index.save(cachePath, archivePath);
+    return index;
+}
+
+bool TarIndex::build(const QString& archivePath, const std::atomic_bool& cancelled, QString& error)
+{
+    QFile file(archivePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QString("Cannot open %1: %2").arg(archivePath, file.errorString());
+        return false;
+    }
+    compressed = file.peek(2) == QByteArray("\x1f\x8b", 2);
+    const std::unique_ptr<TarStream> stream = openStream(file, compressed, error);
+    if (!stream)
+        return false;
+
+    RawMembers rawMembers;
+    QByteArray longPath;
+    QByteArray paxPath;
+    qint64 paxSize = -1;
+    qint64 paxModified = -1;
+    qint64 position = 0;
+    char header[blockSize];
+    while (!cancelled) {
+        // A truncated archive keeps whatever was indexed before the cut.
+        if (stream->read(header, blockSize) != blockSize || isZeroBlock(header))
+            break;
+        if (!isChecksumValid(header)) {
+            if (position == 0) {
+                error = QString("%1 is not a tar archive").arg(archivePath);
+                return false;
+            }
+            break;
+        }
+        position += blockSize;
+        const char type = header[156];
+        qint64 size = parseNumber(header + 124, 12);
+
+        if (type == 'L' || type == 'x') {
+            if (size > maxExtendedHeaderSize) {
+                error = QString("%1 has an extended header of %2 bytes").arg(archivePath).arg(size);
+                return false;
+            }
+            QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+            if (stream->read(data.data(), size) != size)
+                break;
+            if (type == 'L')
+                longPath = parseString(data.constData(), data.size());
+            else
+                parsePaxRecords(data, paxPath, paxSize, paxModified);
+            const qint64 paddedSize = (size + blockSize - 1) / blockSize * blockSize;
+            if (!stream->skip(paddedSize - size))
+                break;
+            position += paddedSize;
+            continue;
+        }
+
+        QByteArray path = parseString(header, 100);
+        if (std::memcmp(header + 257, "ustar\0", 6) == 0 && header[345] != '\0')
+            path = parseString(header + 345, 155) + '/' + path;
+        if (!paxPath.isEmpty())
+            path = paxPath;
+        else if (!longPath.isEmpty())
+            path = longPath;
+        if (paxSize >= 0)
+            size = paxSize;
+        const qint64 lastModified = paxModified >= 0 ? paxModified : parseNumber(header + 136, 12);
+        longPath.clear();
+        paxPath.clear();
+        paxSize = -1;
+        paxModified = -1;
+
+        // Links, devices and fifos have nothing to browse or extract.
+        const bool isRegular = type == '0' || type == '\0' || type == '7';
+        const bool isDir = type == '5' || (isRegular && path.endsWith('/'));
+        path = normalizePath(path);
+        if ((isRegular || isDir) && !path.isEmpty())
+            addMember(rawMembers, path, {position, isDir ? -1 : size, lastModified * 1000, isDir});
+
+        const qint64 paddedSize = (size + blockSize - 1) / blockSize * blockSize;
+        if (!stream->skip(paddedSize))
+            break;
+        position += paddedSize;
+    }
+    if (cancelled) {
+        error = "Cancelled";
+        return false;
+    }
+
+    members.clear();
+    members.reserve(rawMembers.size());
+    names.clear();
+    QHash<QByteArray, quint32> memberByPath;
+    memberByPath.reserve(static_cast<int>(rawMembers.size()));
+    for (const auto& [key, raw] : rawMembers) {
+        const auto& [parent, name] = key;
+        const auto index = static_cast<quint32>(members.size());
+        members.push_back({raw.offset, raw.size, raw.lastModified, static_cast<quint32>(names.size()),
+                           static_cast<quint32>(name.size()), 0, 0, raw.isDir});
+        names += name;
+        if (raw.isDir)
+            memberByPath.insert(parent.isEmpty() ? name : parent + '/' + name, index);
+    }
+    rootCount = 0;
+    quint32 index = 0;
+    for (auto iter = rawMembers.begin(); iter != rawMembers.end(); ++iter, ++index) {
+        const QByteArray& parent = iter->first.first;
+        quint32* first = &rootFirst;
+        quint32* count = &rootCount;
+        if (!parent.isEmpty()) {
+            // A later file header can replace a directory, orphaning what
+            // was inside it.
+            const auto parentIter = memberByPath.constFind(parent);
+            if (parentIter == memberByPath.constEnd())
+                continue;
+            first = &members[*parentIter].firstChild;
+            count = &members[*parentIter].childCount;
+        }
+        if ((*count)++ == 0)
+            *first = index;
+    }
+    return true;
+}
+
+bool TarIndex::save(const QString& filePath, const QString& archivePath) const
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << indexMagic << indexVersion << archivePath << archiveSize << archiveModified << compressed
+           << rootFirst << rootCount << static_cast<quint32>(members.size());
+    for (const Member& member : members) {
+        stream << member.offset << member.size << member.lastModified << member.nameBegin << member.nameLength
+               << member.firstChild << member.childCount << member.isDir;
+    }
+    stream << names;
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool TarIndex::load(const QString& filePath, const QString& archivePath)
+{
+    DataFileReader reader(filePath, indexMagic, indexVersion);
+    if (!reader.isValid())
+        return false;
+    QDataStream& stream = reader.getStream();
+    QString indexedPath;
+    qint64 indexedSize = 0;
+    qint64 indexedModified = 0;
+    quint32 memberCount = 0;
+    stream >> indexedPath >> indexedSize >> indexedModified >> compressed >> rootFirst >> rootCount >> memberCount;
+    // A changed archive is indexed again.
+    if (indexedPath != archivePath || indexedSize != archiveSize || indexedModified != archiveModified)
+        return false;
+
+    // A corrupt count cannot ask for more records than the file holds.
+    members.resize(std::min<qint64>(memberCount, reader.getSize()));
+    for (Member& member : members) {
+        stream >> member.offset >> member.size >> member.lastModified >> member.nameBegin >> member.nameLength
+               >> member.firstChild >> member.childCount >> member.isDir;
+    }
+    stream >> names;
+    if (stream.status() != QDataStream::Ok || members.size() != memberCount || !isConsistent()) {
+        members.clear();
+        names.clear();
+        return false;
+    }
+    return true;
+}
+
+bool TarIndex::isConsistent() const
+{
+    // Lookups index straight into members and names, so a corrupt cache
+    // must not get past here.
+    const auto fits = [](quint32 first, quint32 count, qint64 size) {
+        return qint64(first) + qint64(count) <= size;
+    };
+    const auto memberCount = static_cast<qint64>(members.size());
+    if (!fits(rootFirst, rootCount, memberCount))
+        return false;
+    return std::all_of(members.begin(), members.end(), [&](const Member& member) {
+        return fits(member.firstChild, member.childCount, memberCount)
+            && fits(member.nameBegin, member.nameLength, names.size());
+    });
+}
+
+bool TarIndex::isCompressed() const
+{
+    return compressed;
+}
+
+qint64 TarIndex::getArchiveSize() const
+{
+    return archiveSize;
+}
+
+qint64 TarIndex::getArchiveModified() const
+{
+    return archiveModified;
+}
+
+QString TarIndex::getName(const Member& member) const
+{
+    return QString::fromUtf8(names.constData() + member.nameBegin, static_cast<int>(member.nameLength));
+}
+
+const TarIndex::Member* TarIndex::find(const QString& memberPath) const
+{
+    const auto getNameView = [this](const Member& member) {
+        return std::string_view(names.constData() + member.nameBegin, member.nameLength);
+    };
+    const Member* member = nullptr;
+    quint32 first = rootFirst;
+    quint32 count = rootCount;
+    for (const QByteArray& component : memberPath.toUtf8().split('/')) {
+        if (component.isEmpty())
+            continue;
+        const auto begin = members.begin() + first;
+        const auto end = begin + count;
+        const auto iter = std::lower_bound(begin, end, toView(component), [&](const Member& candidate, std::string_view name) {
+            return getNameView(candidate) < name;
+        });
+        if (iter == end || getNameView(*iter) != toView(component))
+            return nullptr;
+        member = &*iter;
+        first = member->firstChild;
+        count = member->childCount;
+    }
+    return member;
+}
+
+std::optional<VfsStat> TarIndex::stat(const QString& memberPath) const
+{
+    if (normalizePath(memberPath.toUtf8()).isEmpty())
+        return VfsStat{QString(), -1, archiveModified, true};
+    const Member* member = find(memberPath);
+    if (!member)
+        return std::nullopt;
+    return VfsStat{getName(*member), member->size, member->lastModified, member->isDir};
+}
+
+QStringList TarIndex::listNames(const QString& memberPath) const
+{
+    quint32 first = rootFirst;
+    quint32 count = rootCount;
+    if (!normalizePath(memberPath.toUtf8()).isEmpty()) {
+        const Member* member = find(memberPath);
+        if (!member || !member->isDir)
+            return {};
+        first = member->firstChild;
+        count = member->childCount;
+    }
+    QStringList result;
+    result.reserve(static_cast<int>(count));
+    for (quint32 i = first; i < first + count; ++i) {
+        // Hidden names stay hidden, as in real directories.
+        if (names[members[i].nameBegin] != '.')
+            result.push_back(getName(members[i]));
+    }
+    return result;
+}
+
+std::unique_ptr<QIODevice> TarIndex::openMember(const QString& archivePath, const Member& member, QString& error) const
+{
+    auto device = std::make_unique<MemberDevice>(archivePath, member.offset, member.size, compressed);
+    if (!device->open(error))
+        return nullptr;
+    return device;
+}
+
+bool TarIndex::extract(const QString& archivePath, const Member& member, QIODevice& target, QString& error) const
+{
+    QFile archive(archivePath);
+    if (!archive.open(QIODevice::ReadOnly)) {
+        error = QString("Cannot open %1: %2").arg(archivePath, archive.errorString());
+        return false;
+    }
+    qint64 copied = 0;
+#ifdef Q_OS_LINUX
+    // Stored members are copied by the kernel straight from their offset,
+    // which also lets file systems share extents or copy server-side.
+    auto* targetFile = qobject_cast<QFileDevice*>(&target);
+    if (!compressed && targetFile && targetFile->flush()) {
+        loff_t offset = member.offset;
+        while (copied < member.size) {
+            const ssize_t result = copy_file_range(archive.handle(), &offset, targetFile->handle(), nullptr,
+                                                   static_cast<size_t>(std::min(member.size - copied, copyChunkSize * 1024)), 0);
+            if (result <= 0)
+                break;
+            copied += result;
+        }
+        if (copied == member.size)
+            return true;
+        // Old kernels and some file systems refuse; the rest goes through
+        // the buffered copy below.
+        if (!targetFile->seek(copied)) {
+            error = QString("Cannot extract from %1: %2").arg(archivePath, QString::fromLocal8Bit(std::strerror(errno)));
+            return false;
+        }
+    }
+#endif
+    const std::unique_ptr<TarStream> stream = openStream(archive, compressed, error);
+    if (!stream)
+        return false;
+    const bool positioned = compressed ? stream->skip(member.offset + copied) : archive.seek(member.offset + copied);
+    if (!positioned) {
+        error = QString("%1 is truncated").arg(archivePath);
+        return false;
+    }
+    QByteArray buffer(static_cast<int>(copyChunkSize), Qt::Uninitialized);
+    while (copied < member.size) {
+        const qint64 readSize = stream->read(buffer.data(), std::min(member.size - copied, copyChunkSize));
+        if (readSize <= 0) {
+            error = QString("%1 is truncated").arg(archivePath);
+            return false;
+        }
+        if (target.write(buffer.constData(), readSize) != readSize) {
+            error = QString("Cannot write: %1").arg(target.errorString());
+            return false;
+        }
+        copied += readSize;
+    }
+    return true;
+}
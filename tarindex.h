@@ -0,0 +1,65 @@
+#pragma once
+#include <QByteArray>
+#include <QStringList>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "vfs.h"
+
+
+// Member headers of a .tar or .tar.gz archive, read in one streaming pass
+// that seeks (or, compressed, inflates) past the member data. Members are
+// stored as fixed-size records grouped by parent directory and sorted by
+// name within it, with base names packed into one byte array, so lookups
+// are binary searches down the path and a million members take tens of
+// megabytes. Indexes are cached on disk keyed by the archive's size and
+// mtime, so reopening a multi-GB archive skips the scan.
+class TarIndex {
+public:
+    struct Member {
+        qint64 offset; // of the data in the uncompressed stream
+        qint64 size;
+        qint64 lastModified;
+        quint32 nameBegin;
+        quint32 nameLength;
+        quint32 firstChild;
+        quint32 childCount;
+        bool isDir;
+    };
+
+    static bool isArchiveName(QStringView path);
+    static QString getCachePath(const QString& archivePath);
+    // Loads the cached index if it still matches the archive, otherwise
+    // scans the archive and caches the result.
+    static std::optional<TarIndex> open(const QString& archivePath, const std::atomic_bool& cancelled, QString& error);
+
+    bool isCompressed() const;
+    qint64 getArchiveSize() const;
+    qint64 getArchiveModified() const;
+    // Member paths are relative to the archive root, "" being the root.
+    const Member* find(const QString& memberPath) const;
+    std::optional<VfsStat> stat(const QString& memberPath) const;
+    QStringList listNames(const QString& memberPath) const;
+    // Reads the data of a file member in place, without a copy, so
+    // callers can stop after the part they need.
+    std::unique_ptr<QIODevice> openMember(const QString& archivePath, const Member&, QString& error) const;
+    // Writes the data of a file member to an open device.
+    bool extract(const QString& archivePath, const Member&, QIODevice& target, QString& error) const;
+
+private:
+    bool build(const QString& archivePath, const std::atomic_bool& cancelled, QString& error);
+    bool save(const QString& filePath, const QString& archivePath) const;
+    bool load(const QString& filePath, const QString& archivePath);
+    bool isConsistent() const;
+    QString getName(const Member&) const;
+
+private:
+    std::vector<Member> members;
+    QByteArray names;
+    quint32 rootFirst = 0;
+    quint32 rootCount = 0;
+    qint64 archiveSize = 0;
+    qint64 archiveModified = 0;
+    bool compressed = false;
+};
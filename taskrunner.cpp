@@ -0,0 +1,32 @@
+#include "taskrunner.h"
+#include <QtConcurrent/QtConcurrent>
+
+
+TaskRunner::TaskRunner(QObject* parent)
+    : QObject(parent)
+    , cancelFlag(std::make_shared<std::atomic_bool>(false))
+{}
+
+TaskRunner::~TaskRunner()
+{
+    *cancelFlag = true;
+    pool.waitForDone();
+}
+
+void TaskRunner::cancel()
+{
+    *cancelFlag = true;
+    cancelFlag = std::make_shared<std::atomic_bool>(false);
+}
+
+void TaskRunner::setMaxThreadCount(int count)
+{
+    pool.setMaxThreadCount(count);
+}
+
+void TaskRunner::start(std::function<void(const std::atomic_bool&)> job)
+{
+    QtConcurrent::run(&pool, [job = std::move(job), flag = cancelFlag] {
+        job(*flag);
+    });
+}
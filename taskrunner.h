@@ -0,0 +1,56 @@
+#pragma once
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+
+// Runs jobs on a private thread pool and delivers their results back on the
+// thread the runner lives in (the GUI thread). Every job receives a
+// cancellation flag that is raised by cancel() and on destruction.
+class TaskRunner : public QObject {
+    Q_OBJECT
+
+public:
+    using CancelFlag = std::shared_ptr<std::atomic_bool>;
+
+    explicit TaskRunner(QObject* parent = nullptr);
+    ~TaskRunner();
+
+    template<typename Job, typename Done>
+    void run(Job job, Done done);
+
+    template<typename Function>
+    void post(Function function);
+
+    void cancel();
+    void setMaxThreadCount(int);
+
+private:
+    void start(std::function<void(const std::atomic_bool&)>);
+
+private:
+    QThreadPool pool;
+    CancelFlag cancelFlag;
+};
+
+
+template<typename Job, typename Done>
+void TaskRunner::run(Job job, Done done)
+{
+    start([this, job = std::move(job), done = std::move(done)](const std::atomic_bool& cancelled) {
+        auto result = job(cancelled);
+        if (cancelled)
+            return;
+        post([done, result = std::move(result)]() mutable {
+            done(std::move(result));
+        });
+    });
+}
+
+template<typename Function>
+void TaskRunner::post(Function function)
+{
+    QMetaObject::invokeMethod(this, std::move(function), Qt::QueuedConnection);
+}
@@ -0,0 +1,201 @@
+#include "thumbnailcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include "util.h"
+#include "vfs.h"
+
+
+// Cost units are KiB of pixels, so the memory cache holds 128 MiB.
+constexpr int memoryCacheCost = 128 * 1024;
+constexpr int maxDecodeThreads = 4;
+constexpr qint64 maxDiskCacheBytes = 256 * 1024 * 1024;
+// The disk cache is trimmed to 3/4 of the limit after this much is written.
+constexpr qint64 diskTrimInterval = 16 * 1024 * 1024;
+// Hits refresh the mtime that orders eviction at most this often.
+constexpr qint64 touchIntervalSecs = 60 * 60;
+const char* const originalSizeKey = "OriginalSize";
+
+
+ThumbnailCache::ThumbnailCache(QObject* parent)
+    : QObject(parent)
+    , untrimmedBytes(diskTrimInterval)
+    , maxWorkerCount(std::clamp(QThread::idealThreadCount() / 2, 1, maxDecodeThreads))
+{
+    thumbnails.setMaxCost(memoryCacheCost);
+    decodeRunner.setMaxThreadCount(maxWorkerCount);
+}
+
+bool ThumbnailCache::isImageName(const QString& name)
+{
+    static const QSet<QString> extensions = [] {
+        QSet<QString> result;
+        for (const QByteArray& format : QImageReader::supportedImageFormats())
+            result.insert(QString::fromLatin1(format).toLower());
+        return result;
+    }();
+    const int dot = name.lastIndexOf('.');
+    return dot > 0 && extensions.contains(name.mid(dot + 1).toLower());
+}
+
+QString ThumbnailCache::getCachePath(const ThumbnailKey& key)
+{
+    const QByteArray hash = QCryptographicHash::hash(getMemoryKey(key).toUtf8(), QCryptographicHash::Sha1).toHex();
+    return getCacheDirectory() / QString::fromLatin1(hash + ".png");
+}
+
+const ThumbnailCache::Thumbnail* ThumbnailCache::find(const ThumbnailKey& key) const
+{
+    return thumbnails.object(getMemoryKey(key));
+}
+
+void ThumbnailCache::request(std::vector<ThumbnailKey> keys)
+{
+    {
+        std::lock_guard lock(queueMutex);
+        queue.clear();
+        for (ThumbnailKey& key : keys) {
+            const QString memoryKey = getMemoryKey(key);
+            if (!thumbnails.contains(memoryKey) && !decoding.contains(memoryKey))
+                queue.push_back(std::move(key));
+        }
+    }
+    startWorkers();
+}
+
+void ThumbnailCache::startWorkers()
+{
+    for (; workerCount < maxWorkerCount; ++workerCount) {
+        {
+            std::lock_guard lock(queueMutex);
+            if (queue.size() <= static_cast<size_t>(workerCount))
+                return;
+        }
+        // Workers take the front of the queue as they free up, so the
+        // order of the latest request() decides what decodes next.
+        decodeRunner.run([this](const std::atomic_bool& cancelled) {
+            while (!cancelled) {
+                ThumbnailKey key;
+                {
+                    std::lock_guard lock(queueMutex);
+                    if (queue.empty())
+                        break;
+                    key = std::move(queue.front());
+                    queue.pop_front();
+                    decoding.insert(getMemoryKey(key));
+                }
+                Decoded decoded = decode(key);
+                if (decoded.cachedBytes > 0 && untrimmedBytes.fetch_add(decoded.cachedBytes) + decoded.cachedBytes >= diskTrimInterval
+                    && !trimming.exchange(true)) {
+                    untrimmedBytes = 0;
+                    trimDiskCache();
+                    trimming = false;
+                }
+                decodeRunner.post([this, key = std::move(key), decoded = std::move(decoded)]() mutable {
+                    store(key, std::move(decoded));
+                });
+            }
+            return 0;
+        }, [this](int) {
+            --workerCount;
+            startWorkers();
+        });
+    }
+}
+
+void ThumbnailCache::store(const ThumbnailKey& key, Decoded decoded)
+{
+    const QString memoryKey = getMemoryKey(key);
+    {
+        std::lock_guard lock(queueMutex);
+        decoding.remove(memoryKey);
+    }
+    // Pixmaps can only be made on the GUI thread.
+    auto* thumbnail = new Thumbnail{QPixmap::fromImage(std::move(decoded.image)), decoded.originalSize};
+    const int cost = std::max(1, thumbnail->pixmap.width() * thumbnail->pixmap.height() * 4 / 1024);
+    thumbnails.insert(memoryKey, thumbnail, cost);
+    emit thumbnailReady(key.path);
+}
+
+QString ThumbnailCache::getMemoryKey(const ThumbnailKey& key)
+{
+    return QString("%1\n%2\n%3").arg(key.path).arg(key.size).arg(key.lastModified);
+}
+
+ThumbnailCache::Decoded ThumbnailCache::decode(const ThumbnailKey& key)
+{
+    const QString cachePath = getCachePath(key);
+    if (QImage cached; cached.load(cachePath, "PNG")) {
+        const QDateTime now = QDateTime::currentDateTime();
+        if (QFile cachedFile(cachePath);
+            QFileInfo(cachePath).lastModified().secsTo(now) > touchIntervalSecs && cachedFile.open(QIODevice::ReadWrite))
+            cachedFile.setFileTime(now, QFileDevice::FileModificationTime);
+        const QStringList size = cached.text(originalSizeKey).split('x');
+        const QSize originalSize = size.size() == 2 ? QSize(size[0].toInt(), size[1].toInt()) : cached.size();
+        return {std::move(cached), originalSize};
+    }
+
+    QString error;
+    const std::unique_ptr<QIODevice> device = Vfs::get().open(key.path, QIODevice::ReadOnly, error);
+    if (!device)
+        return {};
+    QImageReader reader(device.get());
+    reader.setAutoTransform(true);
+    const QSize originalSize = reader.size();
+    const QSize bounds(thumbnailSize, thumbnailSize);
+    const bool isLarge = originalSize.isValid()
+        && (originalSize.width() > thumbnailSize || originalSize.height() > thumbnailSize);
+    if (isLarge)
+        reader.setScaledSize(originalSize.scaled(bounds, Qt::KeepAspectRatio));
+    QImage image;
+    if (!reader.read(&image))
+        return {};
+    // Formats that cannot scale while decoding, or do not know their size
+    // up front, are scaled afterwards.
+    if (image.width() > thumbnailSize || image.height() > thumbnailSize)
+        image = image.scaled(bounds, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    const QSize sourceSize = originalSize.isValid() ? originalSize : image.size();
+    qint64 cachedBytes = 0;
+    // Small images decode as fast as the cached copy would load.
+    if (isLarge || sourceSize != image.size()) {
+        image.setText(originalSizeKey, QString("%1x%2").arg(sourceSize.width()).arg(sourceSize.height()));
+        QDir().mkpath(QFileInfo(cachePath).absolutePath());
+        QSaveFile file(cachePath);
+        if (file.open(QIODevice::WriteOnly) && image.save(&file, "PNG")) {
+            cachedBytes = file.size();
+            if (!file.commit())
+                cachedBytes = 0;
+        }
+    }
+    return {std::move(image), sourceSize, cachedBytes};
+}
+
+QString ThumbnailCache::getCacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) / QString("thumbnails");
+}
+
+void ThumbnailCache::trimDiskCache()
+{
+    // Oldest first; hits keep the mtime of the files in use fresh.
+    const QFileInfoList files = QDir(getCacheDirectory()).entryInfoList({"*.png"}, QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 totalBytes = 0;
+    for (const QFileInfo& file : files)
+        totalBytes += file.size();
+    if (totalBytes <= maxDiskCacheBytes)
+        return;
+    for (const QFileInfo& file : files) {
+        if (totalBytes <= maxDiskCacheBytes / 4 * 3)
+            break;
+        if (QFile::remove(file.filePath()))
+            totalBytes -= file.size();
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "taskrunner.h"
+
+
+struct ThumbnailKey {
+    QString path;
+    qint64 size;
+    qint64 lastModified;
+};
+
+
+// Image thumbnails for the preview pane, decoded on worker threads at
+// preview resolution only: QImageReader::setScaledSize lets JPEG skip most
+// of the IDCT work, so a 24 MP photo decodes in a few milliseconds. Results
+// stay in an LRU memory cache and, for images bigger than a thumbnail, in
+// an on-disk cache keyed by path, size and mtime. The disk cache is held
+// to a byte limit; files are touched when read and the least recently
+// used ones go first once it is exceeded. Requests form one queue
+// the owner replaces as the cursor moves, most wanted first, so decodes for
+// rows that left the viewport are dropped before they start.
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int thumbnailSize = 512;
+
+    struct Thumbnail {
+        QPixmap pixmap; // null when the image could not be decoded
+        QSize originalSize;
+    };
+
+    explicit ThumbnailCache(QObject* parent = nullptr);
+
+    static bool isImageName(const QString& name);
+    static QString getCachePath(const ThumbnailKey&);
+
+    // Null while the thumbnail is not decoded yet.
+    const Thumbnail* find(const ThumbnailKey&) const;
+    // Replaces the queue. Keys already cached or being decoded are skipped.
+    void request(std::vector<ThumbnailKey> keys);
+
+signals:
+    void thumbnailReady(const QString& path);
+
+private:
+    struct Decoded {
+        QImage image;
+        QSize originalSize;
+        qint64 cachedBytes = 0; // written to the disk cache
+    };
+
+    void startWorkers();
+    void store(const ThumbnailKey&, Decoded);
+    static QString getMemoryKey(const ThumbnailKey&);
+    static Decoded decode(const ThumbnailKey&);
+    static QString getCacheDirectory();
+    static void trimDiskCache();
+
+private:
+    QCache<QString, Thumbnail> thumbnails;
+    std::mutex queueMutex;
+    std::deque<ThumbnailKey> queue;
+    QSet<QString> decoding;
+    // Starts due, so the first write of a session trims what earlier ones
+    // left.
+    std::atomic<qint64> untrimmedBytes;
+    std::atomic_bool trimming{false};
+    int workerCount = 0;
+    int maxWorkerCount;
+    TaskRunner decodeRunner;
+};
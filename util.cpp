@@ -22,10 +22,12 @@ std::wstring operator/(std::wstring_view lhs, std::wstring_view rhs)
     return gluePath(lhs, rhs, fs::path::preferred_separator);
 }
 
+#ifdef Q_OS_WIN
 std::wstring_view toWStringView(const QString& value) {
     static_assert (sizeof *value.utf16() == sizeof(wchar_t));
     return {reinterpret_cast<const wchar_t*>(value.utf16()), static_cast<size_t>(value.size())};
 }
+#endif
 
 std::wstring_view getFileName(std::wstring_view path, wchar_t sep)
 {
@@ -13,4 +13,6 @@ std::wstring gluePath(std::wstring_view lhs, std::wstring_view rhs, wchar_t sep
 std::wstring_view getFileName(std::wstring_view, wchar_t sep = fs::path::preferred_separator);
 QString toQString(std::wstring_view);
 QString toQString(const std::string&);
+#ifdef Q_OS_WIN
 std::wstring_view toWStringView(const QString&);
+#endif
@@ -0,0 +1,445 @@
+#include "vfs.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <filesystem>
+#include <thread>
+#include "archivevfs.h"
+#include "platform.h"
+#include "util.h"
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+QString getListError(const QString& dirPath)
+{
+#ifdef Q_OS_UNIX
+    return QString("Cannot list %1: %2").arg(dirPath, QString::fromLocal8Bit(strerror(errno)));
+#else
+    return QString("Cannot list %1").arg(dirPath);
+#endif
+}
+
+VfsStat toVfsStat(QString name, const QFileInfo& info)
+{
+    const bool isDir = info.isDir();
+    return {std::move(name), isDir ? -1 : info.size(), info.lastModified().toMSecsSinceEpoch(), isDir};
+}
+
+#ifdef Q_OS_UNIX
+VfsStat toVfsStat(QString name, const struct stat& st)
+{
+#ifdef Q_OS_MACOS
+    const timespec& mtime = st.st_mtimespec;
+#else
+    const timespec& mtime = st.st_mtim;
+#endif
+    const bool isDir = S_ISDIR(st.st_mode);
+    return {std::move(name), isDir ? -1 : static_cast<qint64>(st.st_size),
+            static_cast<qint64>(mtime.tv_sec) * 1000 + mtime.tv_nsec / 1000000, isDir};
+}
+
+// QDir::AllEntries leaves out broken symlinks, sockets, fifos and devices.
+bool isListed(mode_t mode)
+{
+    return S_ISREG(mode) || S_ISDIR(mode);
+}
+
+bool mayBeListed(const dirent& entry)
+{
+    if (entry.d_name[0] == '.')
+        return false;
+#ifdef _DIRENT_HAVE_D_TYPE
+    // Symlinks and unknown types are decided by the stat.
+    switch (entry.d_type) {
+    case DT_FIFO:
+    case DT_CHR:
+    case DT_BLK:
+    case DT_SOCK:
+        return false;
+    default:
+        break;
+    }
+#endif
+    return true;
+}
+#endif
+
+#if defined(Q_OS_LINUX) && defined(STATX_BASIC_STATS)
+VfsStat toVfsStat(QString name, const struct statx& stx)
+{
+    const bool isDir = S_ISDIR(stx.stx_mode);
+    return {std::move(name), isDir ? -1 : static_cast<qint64>(stx.stx_size),
+            static_cast<qint64>(stx.stx_mtime.tv_sec) * 1000 + stx.stx_mtime.tv_nsec / 1000000, isDir};
+}
+#endif
+
+
+class ThrottledDevice : public QIODevice {
+public:
+    ThrottledDevice(std::unique_ptr<QIODevice> inner, ThrottledVfs& vfs)
+        : inner(std::move(inner))
+        , vfs(vfs)
+    {
+        QIODevice::open(this->inner->openMode() | QIODevice::Unbuffered);
+    }
+
+    bool isSequential() const override
+    {
+        return inner->isSequential();
+    }
+
+    qint64 size() const override
+    {
+        return inner->size();
+    }
+
+    bool seek(qint64 pos) override
+    {
+        return inner->seek(pos) && QIODevice::seek(pos);
+    }
+
+    void close() override
+    {
+        inner->close();
+        QIODevice::close();
+    }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        const qint64 readSize = inner->read(data, maxSize);
+        vfs.transfer(readSize);
+        return readSize;
+    }
+
+    qint64 writeData(const char* data, qint64 maxSize) override
+    {
+        vfs.transfer(maxSize);
+        return inner->write(data, maxSize);
+    }
+
+private:
+    std::unique_ptr<QIODevice> inner;
+    ThrottledVfs& vfs;
+};
+
+
+std::unique_ptr<IVfs>& getInstalledVfs()
+{
+    static std::unique_ptr<IVfs> vfs = std::make_unique<ArchiveVfs>(std::make_unique<LocalVfs>());
+    return vfs;
+}
+
+}
+
+
+std::vector<std::optional<VfsStat>> IVfs::statBatch(const QString& dirPath, const QStringList& names)
+{
+    std::vector<std::optional<VfsStat>> result;
+    result.reserve(static_cast<size_t>(names.size()));
+    for (const QString& name : names)
+        result.push_back(stat(dirPath / name));
+    return result;
+}
+
+std::optional<VfsStat> IVfs::statQuick(const QString& path)
+{
+    return stat(path);
+}
+
+bool IVfs::listsInOnePass(const QString&)
+{
+    return false;
+}
+
+bool IVfs::isLocal(const QString&)
+{
+    return false;
+}
+
+
+IVfs& Vfs::get()
+{
+    return *getInstalledVfs();
+}
+
+void Vfs::install(std::unique_ptr<IVfs> vfs)
+{
+    getInstalledVfs() = std::move(vfs);
+}
+
+
+std::vector<VfsStat> LocalVfs::list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+    std::vector<VfsStat> result;
+#ifdef Q_OS_UNIX
+    // One fstatat per entry relative to the open directory, instead of the
+    // full path resolution and the QFileInfo allocations QDirIterator does.
+    // Hidden names are skipped before the stat, as QDir does.
+    DIR* dir = opendir(QFile::encodeName(dirPath).constData());
+    if (!dir) {
+        error = getListError(dirPath);
+        return result;
+    }
+    const int dirFd = dirfd(dir);
+    while (!cancelled) {
+        const dirent* entry = readdir(dir);
+        if (!entry)
+            break;
+        struct stat st;
+        if (entry->d_name[0] == '.' || fstatat(dirFd, entry->d_name, &st, 0) != 0 || !isListed(st.st_mode))
+            continue;
+        result.push_back(toVfsStat(QFile::decodeName(entry->d_name), st));
+    }
+    closedir(dir);
+#else
+    if (!QFileInfo(dirPath).isReadable()) {
+        error = getListError(dirPath);
+        return result;
+    }
+    QDirIterator iter(dirPath, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::AllDirs);
+    while (iter.hasNext() && !cancelled) {
+        iter.next();
+        result.push_back(toVfsStat(iter.fileName(), iter.fileInfo()));
+    }
+#endif
+    return result;
+}
+
+QStringList LocalVfs::listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+#ifdef Q_OS_UNIX
+    QStringList result;
+    DIR* dir = opendir(QFile::encodeName(dirPath).constData());
+    if (!dir) {
+        error = getListError(dirPath);
+        return result;
+    }
+    while (!cancelled) {
+        const dirent* entry = readdir(dir);
+        if (!entry)
+            break;
+        if (mayBeListed(*entry))
+            result.push_back(QFile::decodeName(entry->d_name));
+    }
+    closedir(dir);
+    return result;
+#else
+    Q_UNUSED(cancelled);
+    if (!QFileInfo(dirPath).isReadable()) {
+        error = getListError(dirPath);
+        return {};
+    }
+    return QDir(dirPath).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::AllDirs, QDir::NoSort);
+#endif
+}
+
+std::optional<VfsStat> LocalVfs::stat(const QString& path)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return std::nullopt;
+    return toVfsStat(QFileInfo(path).fileName(), st);
+#else
+    const QFileInfo info(path);
+    if (!info.exists())
+        return std::nullopt;
+    return toVfsStat(info.fileName(), info);
+#endif
+}
+
+std::vector<std::optional<VfsStat>> LocalVfs::statBatch(const QString& dirPath, const QStringList& names)
+{
+#ifdef Q_OS_UNIX
+    std::vector<std::optional<VfsStat>> result(static_cast<size_t>(names.size()));
+    const int dirFd = ::open(QFile::encodeName(dirPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0)
+        return result;
+    for (int i = 0; i < names.size(); ++i) {
+        const QByteArray name = QFile::encodeName(names[i]);
+#if defined(Q_OS_LINUX) && defined(STATX_BASIC_STATS)
+        // Asking for the listed fields only, without forcing a sync, lets
+        // network file systems answer from their attribute cache.
+        struct statx stx;
+        if (statx(dirFd, name.constData(), AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) == 0 && isListed(stx.stx_mode))
+            result[static_cast<size_t>(i)] = toVfsStat(names[i], stx);
+#else
+        struct stat st;
+        if (fstatat(dirFd, name.constData(), &st, 0) == 0 && isListed(st.st_mode))
+            result[static_cast<size_t>(i)] = toVfsStat(names[i], st);
+#endif
+    }
+    ::close(dirFd);
+    return result;
+#else
+    return IVfs::statBatch(dirPath, names);
+#endif
+}
+
+bool LocalVfs::listsInOnePass(const QString&)
+{
+#ifdef Q_OS_UNIX
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool LocalVfs::isLocal(const QString&)
+{
+    return true;
+}
+
+std::unique_ptr<QIODevice> LocalVfs::open(const QString& path, QIODevice::OpenMode mode, QString& error)
+{
+    auto file = std::make_unique<QFile>(path);
+    if (!file->open(mode)) {
+        error = QString("Cannot open %1: %2").arg(path, file->errorString());
+        return nullptr;
+    }
+    return file;
+}
+
+bool LocalVfs::rename(const QString& from, const QString& to, QString& error)
+{
+    return Platform::renameNoReplace(from, to, error);
+}
+
+bool LocalVfs::unlink(const QString& path, QString& error)
+{
+    const QFileInfo info(path);
+    const bool removed = info.isDir() && !info.isSymLink() ? QDir(path).removeRecursively() : QFile::remove(path);
+    if (!removed)
+        error = QString("Cannot remove %1").arg(path);
+    return removed;
+}
+
+bool LocalVfs::mkdir(const QString& path, QString& error)
+{
+    if (QFileInfo::exists(path) || !QDir().mkdir(path)) {
+        error = QString("Cannot create directory %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool LocalVfs::copy(const QString& from, const QString& to, QString& error)
+{
+    std::error_code err;
+    fs::copy(fs::path(from.toStdWString()), fs::path(to.toStdWString()), err);
+    if (err)
+        error = QString::fromStdString(err.message());
+    return !err;
+}
+
+
+ThrottledVfs::ThrottledVfs(std::unique_ptr<IVfs> inner, std::chrono::microseconds latency, qint64 bytesPerSecond)
+    : inner(std::move(inner))
+    , latency(latency)
+    , bytesPerSecond(bytesPerSecond)
+    , budgetFreeAt(std::chrono::steady_clock::now())
+{}
+
+std::vector<VfsStat> ThrottledVfs::list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+    waitLatency();
+    return inner->list(dirPath, cancelled, error);
+}
+
+QStringList ThrottledVfs::listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error)
+{
+    waitLatency();
+    return inner->listNames(dirPath, cancelled, error);
+}
+
+std::optional<VfsStat> ThrottledVfs::stat(const QString& path)
+{
+    waitLatency();
+    return inner->stat(path);
+}
+
+std::optional<VfsStat> ThrottledVfs::statQuick(const QString& path)
+{
+    waitLatency();
+    return inner->statQuick(path);
+}
+
+std::vector<std::optional<VfsStat>> ThrottledVfs::statBatch(const QString& dirPath, const QStringList& names)
+{
+    waitLatency();
+    return inner->statBatch(dirPath, names);
+}
+
+bool ThrottledVfs::listsInOnePass(const QString& dirPath)
+{
+    return inner->listsInOnePass(dirPath);
+}
+
+std::unique_ptr<QIODevice> ThrottledVfs::open(const QString& path, QIODevice::OpenMode mode, QString& error)
+{
+    waitLatency();
+    std::unique_ptr<QIODevice> device = inner->open(path, mode, error);
+    if (!device)
+        return nullptr;
+    return std::make_unique<ThrottledDevice>(std::move(device), *this);
+}
+
+bool ThrottledVfs::rename(const QString& from, const QString& to, QString& error)
+{
+    waitLatency();
+    return inner->rename(from, to, error);
+}
+
+bool ThrottledVfs::unlink(const QString& path, QString& error)
+{
+    waitLatency();
+    return inner->unlink(path, error);
+}
+
+bool ThrottledVfs::mkdir(const QString& path, QString& error)
+{
+    waitLatency();
+    return inner->mkdir(path, error);
+}
+
+bool ThrottledVfs::copy(const QString& from, const QString& to, QString& error)
+{
+    waitLatency();
+    if (const std::optional<VfsStat> source = inner->stat(from); source && !source->isDir)
+        transfer(source->size);
+    return inner->copy(from, to, error);
+}
+
+void ThrottledVfs::transfer(qint64 byteCount)
+{
+    if (bytesPerSecond <= 0 || byteCount <= 0)
+        return;
+    // Transfers queue up behind each other, as they would on one link.
+    const std::chrono::microseconds duration(byteCount * 1000000 / bytesPerSecond);
+    std::chrono::steady_clock::time_point doneAt;
+    {
+        std::lock_guard lock(budgetMutex);
+        budgetFreeAt = std::max(budgetFreeAt, std::chrono::steady_clock::now()) + duration;
+        doneAt = budgetFreeAt;
+    }
+    std::this_thread::sleep_until(doneAt);
+}
+
+void ThrottledVfs::waitLatency() const
+{
+    if (latency.count() > 0)
+        std::this_thread::sleep_for(latency);
+}
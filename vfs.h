@@ -0,0 +1,124 @@
+#pragma once
+#include <QIODevice>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+struct VfsStat {
+    QString name;
+    qint64 size; // -1 for directories
+    qint64 lastModified;
+    bool isDir;
+};
+
+
+// File system operations the model and the commands go through, so the
+// same code can run against a slow or remote backend. Implementations are
+// called from worker threads and must be thread-safe.
+class IVfs {
+public:
+    virtual ~IVfs() = default;
+
+    // A directory that cannot be read lists empty and sets error.
+    virtual std::vector<VfsStat> list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) = 0;
+    // Names list() would show, without stating them.
+    virtual QStringList listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) = 0;
+    virtual std::optional<VfsStat> stat(const QString& path) = 0;
+    // stat() for the GUI thread: answers from what is already known and
+    // starts slow preparation, such as indexing an archive, in the
+    // background instead of waiting for it. Paths it cannot decide yet
+    // come back as directories, to be checked when they are listed.
+    virtual std::optional<VfsStat> statQuick(const QString& path);
+    // Stats names inside dirPath, in one request where the backend can
+    // batch them. Names that are gone or that list() would skip come back
+    // empty. The default issues one stat() per name.
+    virtual std::vector<std::optional<VfsStat>> statBatch(const QString& dirPath, const QStringList& names);
+    // True when list() gets the stats together with the names, so listing
+    // the names first and stating them afterwards would only add requests.
+    virtual bool listsInOnePass(const QString& dirPath);
+    // True when path is a plain local path, so code needing what this
+    // interface does not offer (allocated blocks, hard links) may use the
+    // OS directly; everything else has to come through here.
+    virtual bool isLocal(const QString& path);
+    virtual std::unique_ptr<QIODevice> open(const QString& path, QIODevice::OpenMode mode, QString& error) = 0;
+    // Never replaces an existing destination.
+    virtual bool rename(const QString& from, const QString& to, QString& error) = 0;
+    // Removes a file, or a directory with everything in it. Symbolic links
+    // are removed themselves, never followed.
+    virtual bool unlink(const QString& path, QString& error) = 0;
+    // Creates one directory; fails when path exists already.
+    virtual bool mkdir(const QString& path, QString& error) = 0;
+    // Copies a file, or a directory and the files directly inside it.
+    virtual bool copy(const QString& from, const QString& to, QString& error) = 0;
+};
+
+
+// The backend used by the whole process. install() is meant to be called
+// once at startup, before any worker thread touches the file system.
+class Vfs {
+public:
+    static IVfs& get();
+    static void install(std::unique_ptr<IVfs> vfs);
+};
+
+
+// Local file system: readdir and fstatat on POSIX (statx with only the
+// listed fields on Linux), Qt elsewhere. There is no batched stat call, so
+// statBatch() is one statx per name relative to the open directory; on
+// Windows the directory enumeration already returns sizes and times, so
+// list() is done in one pass.
+class LocalVfs : public IVfs {
+public:
+    std::vector<VfsStat> list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    QStringList listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    std::optional<VfsStat> stat(const QString& path) override;
+    std::vector<std::optional<VfsStat>> statBatch(const QString& dirPath, const QStringList& names) override;
+    bool listsInOnePass(const QString& dirPath) override;
+    bool isLocal(const QString& path) override;
+    std::unique_ptr<QIODevice> open(const QString& path, QIODevice::OpenMode mode, QString& error) override;
+    bool rename(const QString& from, const QString& to, QString& error) override;
+    bool unlink(const QString& path, QString& error) override;
+    bool mkdir(const QString& path, QString& error) override;
+    bool copy(const QString& from, const QString& to, QString& error) override;
+};
+
+
+// Test backend wrapping another one (normally a LocalVfs over a scratch
+// directory) that delays every call, a whole statBatch() included, by one
+// fixed round trip and limits the data moved through open() and copy() to
+// a shared bytes-per-second budget, to see how the UI behaves over a slow
+// network mount. It never reports a path
+// as local, so nothing goes around it.
+class ThrottledVfs : public IVfs {
+public:
+    ThrottledVfs(std::unique_ptr<IVfs> inner, std::chrono::microseconds latency, qint64 bytesPerSecond);
+
+    std::vector<VfsStat> list(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    QStringList listNames(const QString& dirPath, const std::atomic_bool& cancelled, QString& error) override;
+    std::optional<VfsStat> stat(const QString& path) override;
+    std::optional<VfsStat> statQuick(const QString& path) override;
+    std::vector<std::optional<VfsStat>> statBatch(const QString& dirPath, const QStringList& names) override;
+    bool listsInOnePass(const QString& dirPath) override;
+    std::unique_ptr<QIODevice> open(const QString& path, QIODevice::OpenMode mode, QString& error) override;
+    bool rename(const QString& from, const QString& to, QString& error) override;
+    bool unlink(const QString& path, QString& error) override;
+    bool mkdir(const QString& path, QString& error) override;
+    bool copy(const QString& from, const QString& to, QString& error) override;
+
+    // Blocks until byteCount bytes fit into the throughput budget.
+    void transfer(qint64 byteCount);
+
+private:
+    void waitLatency() const;
+
+    std::unique_ptr<IVfs> inner;
+    std::chrono::microseconds latency;
+    qint64 bytesPerSecond;
+    std::mutex budgetMutex;
+    std::chrono::steady_clock::time_point budgetFreeAt;
+};
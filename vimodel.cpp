@@ -3,9 +3,16 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
-#include <QApplication>
+#include <QCoreApplication>
+#include <QSet>
 #include "util.h"
 #include "searchcontroller.h"
+#include "duplicatefinder.h"
+#include "checksummanifest.h"
+#include "renameplan.h"
+#include "parallel.h"
+#include "vfs.h"
+#include "archivepacker.h"
 
 
 void toStringg(EKey key, QString& result)
@@ -60,6 +67,33 @@ QString toString(const std::vector<EKey>& keys)
 }
 
 
+static const char* getOperationName(ENormalOperation operation)
+{
+    switch (operation) {
+    case ENormalOperation::NONE: return "none";
+    case ENormalOperation::VISUAL_MODE: return "visual_mode";
+    case ENormalOperation::OPEN_PARENT_DIRECTORY: return "open_parent_directory";
+    case ENormalOperation::OPEN_CURRENT_DIRECTORY: return "open_current_directory";
+    case ENormalOperation::SELECT_NEXT: return "select_next";
+    case ENormalOperation::SELECT_PREVIOUS: return "select_previous";
+    case ENormalOperation::SELECT_FIRST: return "select_first";
+    case ENormalOperation::SELECT_LAST: return "select_last";
+    case ENormalOperation::SELECT_HIGH: return "select_high";
+    case ENormalOperation::SELECT_LOW: return "select_low";
+    case ENormalOperation::SELECT_MIDDLE: return "select_middle";
+    case ENormalOperation::DELETE_FILE: return "delete_file";
+    case ENormalOperation::RENAME_FILE: return "rename_file";
+    case ENormalOperation::YANK_FILE: return "yank_file";
+    case ENormalOperation::PASTE_FILE: return "paste_file";
+    case ENormalOperation::SEARCH_NEXT: return "search_next";
+    case ENormalOperation::UNDO: return "undo";
+    case ENormalOperation::EXIT: return "exit";
+    case ENormalOperation::COUNT: break;
+    }
+    return "unknown";
+}
+
+
 bool isChar(EKey key)
 {
     return static_cast<int>(key) >= static_cast<int>(EKey::A) &&
@@ -70,9 +104,16 @@ bool isChar(EKey key)
 ViModel::ViModel(IViView& newView)
     : view(&newView)
     , searchController(newView)
+    , keyPressLatency(&LatencyStats::getHistogram("key"))
+    , commandLatency(&LatencyStats::getHistogram("command"))
 {
     using CommandOwner = ViModel;
 
+    for (size_t i = 0; i < normalOperationLatencies.size(); ++i) {
+        const auto operation = static_cast<ENormalOperation>(i);
+        normalOperationLatencies[i] = &LatencyStats::getHistogram(QString("normal.") + getOperationName(operation));
+    }
+
     normalMode.addCommand({ENormalOperation::VISUAL_MODE, {StaticKey<EKey::V>::result}});
     normalMode.addCommand({ENormalOperation::OPEN_PARENT_DIRECTORY, {StaticKey<EKey::H>::result}});
     normalMode.addCommand({ENormalOperation::OPEN_CURRENT_DIRECTORY, {StaticKey<EKey::L>::result}});
@@ -88,6 +129,7 @@ ViModel::ViModel(IViView& newView)
     normalMode.addCommand({ENormalOperation::YANK_FILE, {StaticKey<EKey::Y>::result, StaticKey<EKey::Y>::result}});
     normalMode.addCommand({ENormalOperation::PASTE_FILE, {StaticKey<EKey::P>::result}});
     normalMode.addCommand({ENormalOperation::SEARCH_NEXT, {StaticKey<EKey::N>::result}});
+    normalMode.addCommand({ENormalOperation::UNDO, {StaticKey<EKey::U>::result}});
     normalMode.addCommand({ENormalOperation::EXIT, {StaticKey<EKey::CONTROL, EKey::Q>::result}});
 
     normalOperations[static_cast<size_t>(ENormalOperation::VISUAL_MODE)] = &CommandOwner::switchToVisualMode;
@@ -105,6 +147,7 @@ ViModel::ViModel(IViView& newView)
     normalOperations[static_cast<size_t>(ENormalOperation::YANK_FILE)] = &CommandOwner::yankFile;
     normalOperations[static_cast<size_t>(ENormalOperation::PASTE_FILE)] = &CommandOwner::pasteFile;
     normalOperations[static_cast<size_t>(ENormalOperation::SEARCH_NEXT)] = &CommandOwner::searchNext;
+    normalOperations[static_cast<size_t>(ENormalOperation::UNDO)] = &CommandOwner::undo;
     normalOperations[static_cast<size_t>(ENormalOperation::EXIT)] = &CommandOwner::exit;
 
     commands = Commands({
@@ -112,7 +155,24 @@ ViModel::ViModel(IViView& newView)
         std::make_pair(QString("touch"), &CommandOwner::createEmptyFile),
         std::make_pair(QString("open"), &CommandOwner::openFile),
         std::make_pair(QString("mkdir"), &CommandOwner::makeDirectory),
-        std::make_pair(QString("colorscheme"), &CommandOwner::setColorScheme)
+        std::make_pair(QString("colorscheme"), &CommandOwner::setColorScheme),
+        std::make_pair(QString("dupes"), &CommandOwner::findDuplicates),
+        std::make_pair(QString("hash"), &CommandOwner::writeChecksums),
+        std::make_pair(QString("verify"), &CommandOwner::verifyChecksums),
+        std::make_pair(QString("pack"), &CommandOwner::packSelection),
+        std::make_pair(QString("preview"), &CommandOwner::setPreviewMode),
+        std::make_pair(QString("line"), &CommandOwner::scrollPreviewToLine),
+        std::make_pair(QString("sort"), &CommandOwner::setSortMode),
+        std::make_pair(QString("cachesize"), &CommandOwner::setCacheSize),
+        std::make_pair(QString("inflight"), &CommandOwner::setListingConcurrency),
+        std::make_pair(QString("stats"), &CommandOwner::showStats),
+        std::make_pair(QString("trace"), &CommandOwner::setTracing),
+        std::make_pair(QString("z"), &CommandOwner::jumpToDirectory),
+        std::make_pair(QString("rename"), &CommandOwner::bulkRename),
+        std::make_pair(QString("select"), &CommandOwner::selectByGlob),
+        std::make_pair(QString("deselect"), &CommandOwner::deselectByGlob),
+        std::make_pair(QString("selectre"), &CommandOwner::selectByRegex),
+        std::make_pair(QString("deselectre"), &CommandOwner::deselectByRegex)
     });
 
     pasteFileCommand.owner = this;
@@ -133,6 +193,17 @@ IViView &ViModel::getUi()
     return *view;
 }
 
+const IViView& ViModel::getUi() const
+{
+    return *view;
+}
+
+bool ViModel::takesPathArgument(const QString& command) const
+{
+    static const QSet<QString> pathCommands = {"cd", "touch", "mkdir", "hash", "verify", "pack", "trace"};
+    return pathCommands.contains(command);
+}
+
 //QString toStringgg(const KeySeq& keys)
 //{
 //    QString result;
@@ -164,6 +235,8 @@ IViView &ViModel::getUi()
 
 void ViModel::handleKeyPress(Key key)
 {
+    const ScopedLatency latency(*keyPressLatency);
+    const ScopedTrace trace("ViModel::handleKeyPress");
     switch (key.value) {
     case EKey::ESCAPE:
         switchToNormalMode();
@@ -190,6 +263,8 @@ void ViModel::handleKeyPress(Key key)
                     Q_ASSERT(operation != ENormalOperation::COUNT);
                     const size_t i = static_cast<size_t>(operation);
                     auto ptr = normalOperations[i];
+                    const ScopedLatency operationLatency(*normalOperationLatencies[i]);
+                    const ScopedTrace operationTrace(getOperationName(operation));
                     ((this)->*ptr)();
                     break;
                 }
@@ -204,7 +279,16 @@ void ViModel::handleKeyPress(Key key)
 void ViModel::handleCommandEnter(QString line)
 {
     Q_ASSERT(clStrategy);
+    const ScopedLatency latency(*commandLatency);
+    const ScopedTrace trace("ViModel::handleCommandEnter");
     clStrategy(std::move(line));
+    if (keepVisualMode) {
+        // Selection commands leave their result selected in visual mode,
+        // ready for a batched delete.
+        keepVisualMode = false;
+        view->activateFileViewer();
+        return;
+    }
     switchToNormalMode();
 }
 
@@ -259,7 +343,7 @@ void ViModel::switchToVisualMode()
 
 void ViModel::exit()
 {
-    qApp->exit();
+    QCoreApplication::exit();
 }
 
 bool ViModel::runIfHas(const QStringList &args)
@@ -354,29 +438,118 @@ void ViModel::renameCurrent()
     const QFileInfo fi(view->getCurrentFile());
     view->focusToCommandLine(fi.fileName());
     clStrategy = [=](QString newName) {
-        if (!newName.isEmpty())
-            QFile::rename(fi.filePath(), fi.path() / newName);
+        if (newName.isEmpty())
+            return;
+        const QString newPath = fi.path() / newName;
+        if (QString error; !Vfs::get().rename(fi.filePath(), newPath, error)) {
+            view->showStatus(error, 4);
+            return;
+        }
+        journal.record({{EJournalStep::MOVE, newPath, fi.filePath()}});
     };
 }
 
 void ViModel::removeCurrent()
 {
-    const QFileInfo fi(view->getCurrentFile());
-    if (!view->showQuestion(QString("Do you want to remove?\n%1").arg(fi.fileName())))
+    QStringList paths;
+    if (view->isMultiSelectionEnabled())
+        paths = view->getSelectedFiles();
+    if (paths.isEmpty())
+        paths.push_back(view->getCurrentFile());
+
+    const QString question = paths.size() == 1
+        ? QString("Do you want to remove?\n%1").arg(QFileInfo(paths.first()).fileName())
+        : QString("Do you want to remove %1 files?").arg(paths.size());
+    if (!view->showQuestion(question))
         return;
-    if (fi.isDir())
-        QDir(fi.filePath()).removeRecursively();
-    else
-        QFile::remove(fi.filePath());
+
+    // Files go to the trash rather than being unlinked, so u can bring
+    // them back with a rename.
+    OperationJournal::Batch batch;
+    QStringList removedPaths;
+    QStringList untrashedPaths;
+    for (const QString& path : paths) {
+        QString pathInTrash;
+        if (!QFile::moveToTrash(path, &pathInTrash)) {
+            untrashedPaths.push_back(path);
+            continue;
+        }
+        removedPaths.push_back(path);
+        if (!pathInTrash.isEmpty())
+            batch.push_back({EJournalStep::MOVE, pathInTrash, path});
+    }
+    journal.record(std::move(batch));
+
+    // Without a trash (some mounts, no home directory) files can still be
+    // deleted for good, once that has been confirmed separately.
+    if (!untrashedPaths.isEmpty()) {
+        const QString permanentQuestion = QString("%1 files cannot be moved to the trash. Delete them permanently?")
+            .arg(untrashedPaths.size());
+        if (view->showQuestion(permanentQuestion)) {
+            OperationJournal::Batch removals;
+            for (const QString& path : untrashedPaths) {
+                if (QString error; Vfs::get().unlink(path, error)) {
+                    removedPaths.push_back(path);
+                    removals.push_back({EJournalStep::REMOVE, path, {}});
+                }
+            }
+            journal.record(std::move(removals));
+        }
+    }
+    view->onFilesRemoved(removedPaths);
+    if (removedPaths.size() != paths.size())
+        view->showStatus(QString("%1 files could not be removed").arg(paths.size() - removedPaths.size()), 4);
+}
+
+void ViModel::undo()
+{
+    // A batch still being recorded would land on top of the journal
+    // after the one undone now, and two undos would replay concurrently.
+    if (runningJournalJobCount > 0) {
+        view->showStatus("Wait for the running operation to finish", 4);
+        return;
+    }
+    std::optional<OperationJournal::Batch> batch = journal.takeLastBatch();
+    if (!batch) {
+        view->showStatus("Nothing to undo", 4);
+        return;
+    }
+    view->showStatus("Undoing...");
+    view->setListingUpdatesEnabled(false);
+    ++runningJournalJobCount;
+    taskRunner.run([batch = std::move(*batch)](const std::atomic_bool&) {
+        QString error;
+        OperationJournal::Batch remaining = OperationJournal::undo(batch, error);
+        return std::make_pair(std::move(error), std::move(remaining));
+    }, [this](std::pair<QString, OperationJournal::Batch> result) {
+        auto& [error, remaining] = result;
+        --runningJournalJobCount;
+        view->setListingUpdatesEnabled(true);
+        if (remaining.empty()) {
+            view->showStatus(error.isEmpty() ? QString("Undone") : error, 4);
+            return;
+        }
+        // Whatever could not be undone stays on top of the journal, so the
+        // next u retries it.
+        journal.record(std::move(remaining));
+        view->showStatus(error, 4);
+    });
 }
 
 void ViModel::createEmptyFile(const QStringList& args)
 {
     const QString& currDir = view->getCurrentDirectory();
+    OperationJournal::Batch batch;
     for (int i = 1; i < args.length(); ++i) {
-        QFile newFile(currDir / args[i]);
-        newFile.open(QIODevice::WriteOnly);
+        const QString path = currDir / args[i];
+        const bool existed = Vfs::get().stat(path).has_value();
+        QString error;
+        if (!Vfs::get().open(path, QIODevice::WriteOnly, error))
+            view->showStatus(error, 4);
+        else if (!existed)
+            batch.push_back({EJournalStep::CREATE, path, {}});
     }
+    journal.record(std::move(batch));
 }
 
 void ViModel::changeDirectory(const QStringList& args)
@@ -391,7 +564,7 @@ void ViModel::changeDirectory(const QStringList& args)
         newDirInfo.setFile(view->getCurrentDirectory() / newDirPath);
         newDirPath = newDirInfo.absoluteFilePath();
     }
-    if (!newDirInfo.exists()) {
+    if (!Vfs::get().statQuick(newDirPath)) {
         view->showStatus("Target directory does not exist", 4);
         return;
     }
@@ -406,8 +579,16 @@ void ViModel::openFile(const QStringList&)
 
 void ViModel::makeDirectory(const QStringList& args)
 {
-    for (int i = 1; i < args.length(); ++i)
-        view->mkdir(args[i]);
+    const QString currDir = view->getCurrentDirectory();
+    OperationJournal::Batch batch;
+    for (int i = 1; i < args.length(); ++i) {
+        const QString path = currDir / args[i];
+        if (QString error; !Vfs::get().mkdir(path, error))
+            view->showStatus(error, 4);
+        else
+            batch.push_back({EJournalStep::CREATE, path, {}});
+    }
+    journal.record(std::move(batch));
 }
 
 void ViModel::setColorScheme(const QStringList& args)
@@ -419,6 +600,449 @@ void ViModel::setColorScheme(const QStringList& args)
     view->setColorSchemeName(args.back());
 }
 
+void ViModel::findDuplicates(const QStringList& args)
+{
+    if (args.size() > 1) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const QString rootPath = view->getCurrentDirectory();
+    view->showStatus("Searching for duplicates...");
+    duplicateRunner.cancel();
+    duplicateRunner.run([rootPath](const std::atomic_bool& cancelled) {
+        const ScopedLatency latency(LatencyStats::getHistogram("job.dupes"));
+        DuplicateFinder finder(rootPath);
+        DuplicateFinder::Groups groups = finder.find(cancelled);
+        return std::make_pair(finder.getScannedFileCount(), std::move(groups));
+    }, [this, rootPath](std::pair<size_t, DuplicateFinder::Groups> result) {
+        const auto& [scannedCount, groups] = result;
+        if (groups.empty()) {
+            view->showStatus(QString("No duplicates among %1 files").arg(scannedCount), 4);
+            return;
+        }
+        std::vector<FileListEntry> entries;
+        for (size_t i = 0; i < groups.size(); ++i) {
+            for (const QString& path : groups[i].paths)
+                entries.push_back({path, groups[i].fileSize, static_cast<int>(i) + 1});
+        }
+        const size_t fileCount = entries.size();
+        view->showFileList(rootPath, std::move(entries));
+        view->showStatus(QString("%1 duplicates in %2 groups").arg(fileCount).arg(groups.size()));
+    });
+}
+
+void ViModel::writeChecksums(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const QString currDir = view->getCurrentDirectory();
+    const QString manifestPath = QFileInfo(args[1]).isRelative() ? currDir / args[1] : args[1];
+    QStringList roots;
+    if (view->isMultiSelectionEnabled())
+        roots = view->getSelectedFiles();
+    if (roots.isEmpty())
+        roots.push_back(currDir);
+
+    view->showStatus("Hashing...");
+    taskRunner.run([manifestPath, roots](const std::atomic_bool& cancelled) {
+        const ScopedLatency latency(LatencyStats::getHistogram("job.hash"));
+        const QStringList files = ChecksumManifest::collectFiles(roots);
+        if (QString error; !ChecksumManifest::write(manifestPath, files, cancelled, error))
+            return error;
+        return QString("Checksums written to %1").arg(manifestPath);
+    }, [this](QString message) {
+        view->showStatus(message, 4);
+    });
+}
+
+void ViModel::verifyChecksums(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const QString manifestPath = QFileInfo(args[1]).isRelative()
+        ? view->getCurrentDirectory() / args[1]
+        : args[1];
+
+    view->showStatus("Verifying...");
+    taskRunner.run([manifestPath](const std::atomic_bool& cancelled) {
+        const ScopedLatency latency(LatencyStats::getHistogram("job.verify"));
+        QString error;
+        ChecksumManifest::VerifyResult result = ChecksumManifest::verify(manifestPath, cancelled, error);
+        return std::make_pair(std::move(error), std::move(result));
+    }, [this, manifestPath](std::pair<QString, ChecksumManifest::VerifyResult> outcome) {
+        const auto& [error, result] = outcome;
+        if (!error.isEmpty()) {
+            view->showStatus(error, 4);
+            return;
+        }
+        const QString summary = QString("%1 OK, %2 FAILED, %3 missing")
+            .arg(result.passedCount).arg(result.failed.size()).arg(result.missing.size());
+        if (result.failed.isEmpty() && result.missing.isEmpty()) {
+            view->showStatus(summary, 4);
+            return;
+        }
+        std::vector<FileListEntry> entries;
+        for (const QString& path : result.failed)
+            entries.push_back({path, QFileInfo(path).size(), 1});
+        for (const QString& path : result.missing)
+            entries.push_back({path, 0, 2});
+        view->showFileList(QFileInfo(manifestPath).absolutePath(), std::move(entries));
+        view->showStatus(summary);
+    });
+}
+
+void ViModel::packSelection(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const QString currDir = view->getCurrentDirectory();
+    const QString archivePath = QFileInfo(args[1]).isRelative() ? currDir / args[1] : args[1];
+    const std::optional<EArchiveFormat> format = ArchivePacker::getFormat(archivePath);
+    if (!format) {
+        view->showStatus("Archive name must end with .tar, .tar.gz or .tar.zst", 4);
+        return;
+    }
+    if (!ArchivePacker::isFormatAvailable(*format)) {
+        view->showStatus("This build cannot write that archive format", 4);
+        return;
+    }
+    if (Vfs::get().stat(archivePath)) {
+        view->showStatus(QString("%1 already exists").arg(archivePath), 4);
+        return;
+    }
+    QStringList sources;
+    if (view->isMultiSelectionEnabled())
+        sources = view->getSelectedFiles();
+    if (sources.isEmpty() && !view->getCurrentFile().isEmpty())
+        sources.push_back(view->getCurrentFile());
+    if (sources.isEmpty()) {
+        view->showStatus("Nothing to pack", 4);
+        return;
+    }
+
+    view->showStatus("Packing...");
+    ++runningJournalJobCount;
+    taskRunner.run([this, sources, archivePath, format = *format](const std::atomic_bool& cancelled) {
+        const ScopedLatency latency(LatencyStats::getHistogram("job.pack"));
+        QString error;
+        const bool packed = ArchivePacker::pack(sources, archivePath, format, cancelled,
+                                                [this](const ArchivePacker::Progress& progress) {
+            taskRunner.post([this, progress] {
+                view->showStatus(QString("Packing: %1 files, %2 MiB read, %3 MiB written")
+                    .arg(progress.fileCount)
+                    .arg(progress.bytesRead / (1024 * 1024))
+                    .arg(progress.bytesWritten / (1024 * 1024)));
+            });
+        }, error);
+        return packed ? QString() : error;
+    }, [this, archivePath](QString error) {
+        --runningJournalJobCount;
+        if (!error.isEmpty()) {
+            view->showStatus(error, 4);
+            return;
+        }
+        journal.record({{EJournalStep::CREATE, archivePath, {}}});
+        view->showStatus(QString("Packed %1").arg(QFileInfo(archivePath).fileName()), 4);
+    });
+}
+
+void ViModel::setPreviewMode(const QStringList& args)
+{
+    static const std::map<QString, EPreviewMode> previewModes = {
+        {"off", EPreviewMode::OFF},
+        {"auto", EPreviewMode::AUTO},
+        {"text", EPreviewMode::TEXT},
+        {"hex", EPreviewMode::HEX},
+    };
+    if (args.size() > 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    if (args.size() == 1) {
+        view->setPreviewMode(view->getPreviewMode() == EPreviewMode::OFF ? EPreviewMode::AUTO : EPreviewMode::OFF);
+        return;
+    }
+    const auto iter = previewModes.find(args[1]);
+    if (iter == previewModes.end()) {
+        view->showStatus("Unknown preview mode", 4);
+        return;
+    }
+    view->setPreviewMode(iter->second);
+}
+
+void ViModel::scrollPreviewToLine(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    bool isNumber = false;
+    const qint64 line = args[1].toLongLong(&isNumber);
+    if (!isNumber || line <= 0) {
+        view->showStatus("Line must be a positive number", 4);
+        return;
+    }
+    if (view->getPreviewMode() == EPreviewMode::OFF) {
+        view->showStatus("Preview is off", 4);
+        return;
+    }
+    if (!view->scrollPreviewToLine(line - 1))
+        view->showStatus(QString("Line %1 is not indexed yet").arg(line), 4);
+}
+
+void ViModel::setSortMode(const QStringList& args)
+{
+    static const std::map<QString, ESortMode> sortModes = {
+        {"name", ESortMode::NAME},
+        {"natural", ESortMode::NATURAL},
+        {"extension", ESortMode::EXTENSION},
+        {"size", ESortMode::SIZE},
+        {"mtime", ESortMode::MTIME},
+    };
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const auto iter = sortModes.find(args[1]);
+    if (iter == sortModes.end()) {
+        view->showStatus("Unknown sort mode", 4);
+        return;
+    }
+    view->setSortMode(iter->second);
+}
+
+void ViModel::setCacheSize(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    bool isNumber = false;
+    const qint64 megabytes = args[1].toLongLong(&isNumber);
+    if (!isNumber || megabytes <= 0) {
+        view->showStatus("Cache size must be a positive number of megabytes", 4);
+        return;
+    }
+    view->setMemoryBudget(megabytes * 1024 * 1024);
+}
+
+void ViModel::setListingConcurrency(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    bool isNumber = false;
+    const int inFlight = args[1].toInt(&isNumber);
+    if (!isNumber || inFlight <= 0) {
+        view->showStatus("The number of listing requests in flight must be positive", 4);
+        return;
+    }
+    view->setListingConcurrency(inFlight);
+}
+
+void ViModel::showStats(const QStringList& args)
+{
+    if (args.size() == 1) {
+        const QStringList lines = LatencyStats::report();
+        if (lines.isEmpty())
+            view->showStatus("No statistics recorded yet", 4);
+        else
+            view->showReport("Statistics", lines);
+        return;
+    }
+    if (args.size() == 2 && args[1] == "reset") {
+        LatencyStats::reset();
+        view->showStatus("Statistics reset", 4);
+        return;
+    }
+    if (args.size() == 3 && args[1] == "dump") {
+        const QString path = QFileInfo(args[2]).isRelative() ? view->getCurrentDirectory() / args[2] : args[2];
+        if (QString error; !LatencyStats::dump(path, error)) {
+            view->showStatus(error, 4);
+            return;
+        }
+        view->showStatus(QString("Statistics written to %1").arg(path), 4);
+        return;
+    }
+    view->showStatus("Invalid command signature", 4);
+}
+
+void ViModel::setTracing(const QStringList& args)
+{
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    if (args[1] == "stop") {
+        if (QString error; !EventTracer::stop(error)) {
+            view->showStatus(error, 4);
+            return;
+        }
+        view->showStatus("Trace written", 4);
+        return;
+    }
+    const QString path = QFileInfo(args[1]).isRelative() ? view->getCurrentDirectory() / args[1] : args[1];
+    if (!EventTracer::start(path)) {
+        view->showStatus("Tracing is already running", 4);
+        return;
+    }
+    view->showStatus(QString("Tracing to %1").arg(path), 4);
+}
+
+void ViModel::jumpToDirectory(const QStringList& args)
+{
+    if (args.size() < 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    // Candidates are checked only here, best first; remembered directories
+    // that no longer exist are forgotten on the way. The directory already
+    // shown is never the jump target.
+    const QString currDir = view->getCurrentDirectory();
+    for (const QString& dirPath : directoryHistory.findMatches(args.mid(1))) {
+        if (dirPath == currDir)
+            continue;
+        if (view->changeDirectoryIfCan(dirPath))
+            return;
+        directoryHistory.remove(dirPath);
+    }
+    view->showStatus("No matching directory", 4);
+}
+
+void ViModel::recordDirectoryVisit(const QString& dirPath)
+{
+    directoryHistory.addVisit(dirPath);
+}
+
+void ViModel::bulkRename(const QStringList& args)
+{
+    if (args.size() > 1) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    const QString currDir = view->getCurrentDirectory();
+    const QDir dir(currDir);
+    QStringList names;
+    if (view->isMultiSelectionEnabled()) {
+        for (const QString& path : view->getSelectedFiles())
+            names.push_back(dir.relativeFilePath(path));
+    } else {
+        // Rows in the order shown, so the buffer reads like the listing.
+        for (const QString& name : view->getRowNames())
+            names.push_back(dir.relativeFilePath(name));
+    }
+    if (names.isEmpty()) {
+        view->showStatus("Nothing to rename", 4);
+        return;
+    }
+
+    const std::optional<QStringList> editedNames = view->editLines("Rename", names);
+    if (!editedNames)
+        return;
+    if (editedNames->size() != names.size()) {
+        view->showStatus("The number of lines must not change", 4);
+        return;
+    }
+    std::vector<RenamePlan::Step> renames;
+    for (int i = 0; i < names.size(); ++i) {
+        // Leading and trailing spaces are legal in names; only a carriage
+        // return left by a pasted CRLF line is dropped.
+        QString newName = (*editedNames)[i];
+        if (newName.endsWith('\r'))
+            newName.chop(1);
+        if (newName.isEmpty()) {
+            view->showStatus("Names must not be empty", 4);
+            return;
+        }
+        if (newName != names[i])
+            renames.push_back({QDir::cleanPath(currDir / names[i]), QDir::cleanPath(dir.absoluteFilePath(newName))});
+    }
+    if (renames.empty())
+        return;
+
+    // The watcher would report every rename separately; the listing is
+    // refreshed once when updates are turned back on.
+    view->showStatus(QString("Renaming %1 files...").arg(renames.size()));
+    view->setListingUpdatesEnabled(false);
+    ++runningJournalJobCount;
+    taskRunner.run([renames = std::move(renames)](const std::atomic_bool& cancelled) mutable {
+        RenamePlan plan;
+        QString error;
+        if (!plan.build(std::move(renames), error) || !plan.apply(cancelled, error))
+            return std::make_pair(error, OperationJournal::Batch());
+        OperationJournal::Batch batch;
+        batch.reserve(plan.getSteps().size());
+        for (const RenamePlan::Step& step : plan.getSteps())
+            batch.push_back({EJournalStep::MOVE, step.to, step.from});
+        return std::make_pair(QString("Renamed %1 files").arg(plan.getRenameCount()), std::move(batch));
+    }, [this](std::pair<QString, OperationJournal::Batch> result) {
+        --runningJournalJobCount;
+        journal.record(std::move(result.second));
+        view->setListingUpdatesEnabled(true);
+        view->showStatus(result.first, 4);
+    });
+}
+
+void ViModel::selectByGlob(const QStringList& args)
+{
+    selectMatching(args, EPatternSyntax::GLOB, true);
+}
+
+void ViModel::deselectByGlob(const QStringList& args)
+{
+    selectMatching(args, EPatternSyntax::GLOB, false);
+}
+
+void ViModel::selectByRegex(const QStringList& args)
+{
+    selectMatching(args, EPatternSyntax::REGEX, true);
+}
+
+void ViModel::deselectByRegex(const QStringList& args)
+{
+    selectMatching(args, EPatternSyntax::REGEX, false);
+}
+
+void ViModel::selectMatching(const QStringList& args, EPatternSyntax syntax, bool selected)
+{
+    constexpr size_t matchChunkSize = 8192;
+
+    if (args.size() != 2) {
+        view->showStatus("Invalid command signature", 4);
+        return;
+    }
+    NameMatcher matcher;
+    if (QString error; !matcher.compile(args[1], syntax, error)) {
+        view->showStatus(error, 4);
+        return;
+    }
+
+    const QStringList names = view->getRowNames();
+    std::vector<char> matched(static_cast<size_t>(names.size()));
+    parallelForChunks(matched.size(), matchChunkSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            matched[i] = matcher.matches(names[static_cast<int>(i)]);
+    });
+    std::vector<int> rows;
+    for (size_t i = 0; i < matched.size(); ++i) {
+        if (matched[i])
+            rows.push_back(static_cast<int>(i));
+    }
+
+    if (!view->isMultiSelectionEnabled())
+        view->setMultiSelectionEnabled(true);
+    view->setRowsSelected(rows, selected);
+    keepVisualMode = true;
+    view->showStatus(QString("%1 %2").arg(rows.size()).arg(selected ? "selected" : "deselected"), 4);
+}
+
 int ViModel::findHighRow(int sourceRow)
 {
     for (int i = sourceRow; i > 0; --i) {
@@ -455,29 +1079,28 @@ void PasteFileCommand::paste()
     if (pathCopy.isEmpty())
         return;
 
-    const std::wstring_view srcPathStr = toWStringView(pathCopy);
-    const std::wstring_view name = getFileName(srcPathStr, '/');
-    const QString currDir = owner->getUi().getCurrentDirectory();
-    const fs::path destPath = gluePath(toWStringView(currDir), name, '/');
-
-    if (fs::exists(destPath)) {
-        owner->switchToFileRenameMode(toQString(name));
+    const QString name = QFileInfo(pathCopy).fileName();
+    const QString destPath = owner->getUi().getCurrentDirectory() / name;
+    if (Vfs::get().stat(destPath)) {
+        owner->switchToFileRenameMode(name);
         owner->getUi().showStatus("Set a new name for the destination file");
         return;
     }
-
-    const fs::path srcPath = srcPathStr;
-    if (std::error_code err; (fs::copy(srcPath, destPath, err), err))
-        owner->getUi().showStatus(toQString(err.message()), 4);
+    copyTo(destPath);
 }
 
 void PasteFileCommand::pasteWithNewName(QString newName)
 {
-    const QString currDir = owner->getUi().getCurrentDirectory();
-    const fs::path srcPath = toWStringView(pathCopy);
-    const std::wstring destPathStr = toWStringView(currDir) / toWStringView(newName);
-    if (std::error_code err; (fs::copy(srcPath, destPathStr, err), err))
-        owner->getUi().showStatus(toQString(err.message()), 4);
+    copyTo(owner->getUi().getCurrentDirectory() / newName);
+}
+
+void PasteFileCommand::copyTo(const QString& destPath)
+{
+    if (QString error; !Vfs::get().copy(pathCopy, destPath, error)) {
+        owner->getUi().showStatus(error, 4);
+        return;
+    }
+    owner->getJournal().record({{EJournalStep::CREATE, destPath, {}}});
 }
 
 
@@ -3,7 +3,18 @@
 #include <array>
 #include <QStringList>
 #include "searchcontroller.h"
+#include "taskrunner.h"
+#include "filelistmodel.h"
+#include "sortmode.h"
+#include "previewmode.h"
+#include "latencystats.h"
+#include "eventtracer.h"
+#include "pathcompletion.h"
+#include "directoryhistory.h"
+#include "namematcher.h"
+#include "operationjournal.h"
 #include <functional>
+#include <optional>
 #include <variant>
 
 
@@ -24,6 +35,7 @@ enum class ENormalOperation {
     YANK_FILE,
     PASTE_FILE,
     SEARCH_NEXT,
+    UNDO,
     EXIT,
 
     COUNT,
@@ -77,11 +89,10 @@ public:
 
 
 struct IViView : ICurrentDirectoryGetter, IStatusDisplayer,
-    ISearchControllerOwner, IRowSelectionStrategy, IRowInfo
+    ISearchControllerOwner, IRowSelectionStrategy, IRowInfo, IListingCache
 {
     virtual QString getCurrentFile() const = 0;
     virtual QString getCurrentDir() const = 0;
-    virtual void mkdir(const QString&) = 0;
     virtual bool changeDirectoryIfCan(const QString& dirPath) = 0;
     virtual void setColorSchemeName(const QString&) = 0;
     virtual void openCurrentDirectory() = 0;
@@ -92,6 +103,21 @@ struct IViView : ICurrentDirectoryGetter, IStatusDisplayer,
     virtual bool isMultiSelectionEnabled() const = 0;
     virtual bool showQuestion(const QString&) = 0;
     virtual bool isRowVisible(int) const = 0;
+    virtual QStringList getSelectedFiles() const = 0;
+    virtual void showFileList(const QString& rootPath, std::vector<FileListEntry>) = 0;
+    virtual void onFilesRemoved(const QStringList&) = 0;
+    virtual void setSortMode(ESortMode) = 0;
+    virtual void setMemoryBudget(qint64 bytes) = 0;
+    virtual void setListingConcurrency(int inFlight) = 0;
+    virtual void showReport(const QString& title, const QStringList& lines) = 0;
+    virtual std::optional<QStringList> editLines(const QString& title, const QStringList& lines) = 0;
+    virtual void setListingUpdatesEnabled(bool) = 0;
+    virtual QStringList getRowNames() const = 0;
+    virtual void setRowsSelected(const std::vector<int>& rows, bool selected) = 0;
+    virtual void setPreviewMode(EPreviewMode) = 0;
+    virtual EPreviewMode getPreviewMode() const = 0;
+    // Lines count from 0.
+    virtual bool scrollPreviewToLine(qint64 line) = 0;
 };
 
 
@@ -99,6 +125,7 @@ class ViModel;
 struct PasteFileCommand {
     void paste();
     void pasteWithNewName(QString);
+    void copyTo(const QString& destPath);
 
 public:
     ViModel* owner;
@@ -250,6 +277,7 @@ public:
     using Commands = std::map<QString, Command>;
     using OperationFunction = void(ViModel::*)();
     using NormalOperations = std::array<OperationFunction, static_cast<size_t>(ENormalOperation::COUNT)>;
+    using NormalOperationLatencies = std::array<LatencyHistogram*, static_cast<size_t>(ENormalOperation::COUNT)>;
 
     explicit ViModel(IViView&);
 
@@ -257,6 +285,8 @@ public:
     Commands::const_iterator cend() const;
 
     IViView& getUi();
+    const IViView& getUi() const;
+    bool takesPathArgument(const QString& command) const;
 
     void handleKeyPress(Key);
     void handleCommandEnter(QString);
@@ -268,6 +298,7 @@ public:
     void switchToVisualMode();
 
     SearchController& getSearchController() { return searchController; }
+    OperationJournal& getJournal() { return journal; }
 
     bool runIfHas(const QStringList& args);
 
@@ -285,6 +316,7 @@ public:
     void searchNext();
     void renameCurrent();
     void removeCurrent();
+    void undo();
     void exit();
 
     void createEmptyFile(const QStringList& args);
@@ -292,11 +324,32 @@ public:
     void openFile(const QStringList& args);
     void makeDirectory(const QStringList& args);
     void setColorScheme(const QStringList&);
+    void findDuplicates(const QStringList&);
+    void writeChecksums(const QStringList&);
+    void verifyChecksums(const QStringList&);
+    void packSelection(const QStringList&);
+    void setPreviewMode(const QStringList&);
+    void scrollPreviewToLine(const QStringList&);
+    void setSortMode(const QStringList&);
+    void setCacheSize(const QStringList&);
+    void setListingConcurrency(const QStringList&);
+    void showStats(const QStringList&);
+    void setTracing(const QStringList&);
+    void jumpToDirectory(const QStringList&);
+    void bulkRename(const QStringList&);
+    void selectByGlob(const QStringList&);
+    void deselectByGlob(const QStringList&);
+    void selectByRegex(const QStringList&);
+    void deselectByRegex(const QStringList&);
+    void recordDirectoryVisit(const QString& dirPath);
 
     int findHighRow(int sourceRow);
     int findLowRow(int sourceRow);
     int findMiddleRow(int sourceRow);
 
+private:
+    void selectMatching(const QStringList& args, EPatternSyntax, bool selected);
+
 public:
     NormalOperations normalOperations;
 
@@ -307,4 +360,17 @@ private:
     PasteFileCommand pasteFileCommand;
     std::function<void(QString)> clStrategy;
     NormalMode normalMode;
+    LatencyHistogram* keyPressLatency;
+    LatencyHistogram* commandLatency;
+    NormalOperationLatencies normalOperationLatencies;
+    DirectoryHistory directoryHistory;
+    OperationJournal journal;
+    // Jobs that record a journal batch when they finish: :rename, :pack, u.
+    int runningJournalJobCount = 0;
+    bool keepVisualMode = false;
+    TaskRunner taskRunner;
+    // Running :dupes again restarts the search, so it cancels only its own
+    // runner; cancelled jobs never call back, which would leave :hash, :pack
+    // or an undo on the shared runner without its result.
+    TaskRunner duplicateRunner;
 };